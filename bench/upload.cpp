@@ -0,0 +1,248 @@
+// Uploads a pile of small meshes twice: once the way load_using_staging used
+// to do it (a fresh staging allocation, a submit and a vkQueueWaitIdle per
+// buffer), and once through the upload service.
+#include <chrono>
+
+#include <vulkan/vulkan_core.h>
+#define GLFW_INCLUDE_VULKAN
+#include <GLFW/glfw3.h>
+
+#include "buffers.hpp"
+#include "commands.hpp"
+#include "device.hpp"
+#include "enumerate.hpp"
+#include "errors.hpp"
+#include "memory.hpp"
+#include "mesh.hpp"
+#include "present.hpp"
+#include "upload.hpp"
+
+namespace {
+
+using clock_type = std::chrono::steady_clock;
+
+struct mesh_buffers_t {
+    mv::vertex_buffer_t vertex_buffer;
+    mv::index_buffer_t index_buffer;
+};
+
+auto create_mesh_buffers(
+    const mv::vulkan_device_t &device,
+    mv::memory_allocator_t &allocator,
+    const std::vector<mv::mesh_t> &meshes
+) -> std::vector<mesh_buffers_t> {
+    std::vector<mesh_buffers_t> buffers;
+    buffers.reserve(meshes.size());
+
+    for (const auto &mesh : meshes) {
+        buffers.push_back({
+            mv::vertex_buffer_t::create(
+                device, allocator, mesh.vertices.size() * sizeof(mv::vertex_t)
+            ),
+            mv::index_buffer_t::create(
+                device, allocator, mesh.indices.size() * sizeof(uint32_t)
+            ),
+        });
+    }
+
+    return buffers;
+}
+
+// What load_using_staging used to do, minus the leaked command buffer.
+auto legacy_upload(
+    const mv::vulkan_device_t &device,
+    VkCommandPool command_pool,
+    const mv::buffer_t &destination,
+    const void *data,
+    VkDeviceSize size
+) -> void {
+    const VkBufferCreateInfo buffer_create_info{
+        .sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO,
+        .pNext = nullptr,
+        .flags = 0,
+        .size = size,
+        .usage = VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
+        .sharingMode = VK_SHARING_MODE_EXCLUSIVE,
+        .queueFamilyIndexCount = 0,
+        .pQueueFamilyIndices = nullptr,
+    };
+
+    VkBuffer staging;
+    VK_ERROR(
+        vkCreateBuffer(device.logical, &buffer_create_info, nullptr, &staging)
+    );
+
+    VkMemoryRequirements requirements;
+    vkGetBufferMemoryRequirements(device.logical, staging, &requirements);
+
+    const VkMemoryAllocateInfo allocate_info{
+        .sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO,
+        .pNext = nullptr,
+        .allocationSize = requirements.size,
+        .memoryTypeIndex = mv::get_memory_type_index(
+            device,
+            requirements.memoryTypeBits,
+            VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT |
+                VK_MEMORY_PROPERTY_HOST_COHERENT_BIT
+        ),
+    };
+
+    VkDeviceMemory memory;
+    VK_ERROR(vkAllocateMemory(device.logical, &allocate_info, nullptr, &memory)
+    );
+    VK_ERROR(vkBindBufferMemory(device.logical, staging, memory, 0));
+
+    void *mapped;
+    VK_ERROR(vkMapMemory(device.logical, memory, 0, size, 0, &mapped));
+    memcpy(mapped, data, size);
+    vkUnmapMemory(device.logical, memory);
+
+    const VkCommandBufferAllocateInfo command_buffer_allocate_info{
+        .sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO,
+        .pNext = nullptr,
+        .commandPool = command_pool,
+        .level = VK_COMMAND_BUFFER_LEVEL_PRIMARY,
+        .commandBufferCount = 1,
+    };
+
+    VkCommandBuffer command_buffer;
+    VK_ERROR(vkAllocateCommandBuffers(
+        device.logical, &command_buffer_allocate_info, &command_buffer
+    ));
+
+    const VkCommandBufferBeginInfo begin_info{
+        .sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO,
+        .pNext = nullptr,
+        .flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT,
+        .pInheritanceInfo = nullptr,
+    };
+
+    VK_ERROR(vkBeginCommandBuffer(command_buffer, &begin_info));
+    destination.record_copy_from(command_buffer, staging, 0, size);
+    VK_ERROR(vkEndCommandBuffer(command_buffer));
+
+    const VkSubmitInfo submit_info{
+        .sType = VK_STRUCTURE_TYPE_SUBMIT_INFO,
+        .pNext = nullptr,
+        .waitSemaphoreCount = 0,
+        .pWaitSemaphores = nullptr,
+        .pWaitDstStageMask = nullptr,
+        .commandBufferCount = 1,
+        .pCommandBuffers = &command_buffer,
+        .signalSemaphoreCount = 0,
+        .pSignalSemaphores = nullptr,
+    };
+
+    VK_ERROR(
+        vkQueueSubmit(device.graphics_queue, 1, &submit_info, VK_NULL_HANDLE)
+    );
+    VK_ERROR(vkQueueWaitIdle(device.graphics_queue));
+
+    vkFreeCommandBuffers(device.logical, command_pool, 1, &command_buffer);
+    vkDestroyBuffer(device.logical, staging, nullptr);
+    vkFreeMemory(device.logical, memory, nullptr);
+}
+
+auto milliseconds_since(clock_type::time_point start) -> double {
+    return std::chrono::duration<double, std::milli>(clock_type::now() - start)
+        .count();
+}
+
+} // namespace
+
+int main(int p_argc, const char *const *const p_argv) try {
+    bool enable_validation = false;
+    size_t mesh_count = 1000;
+
+    for (auto arg = p_argv; arg < p_argv + p_argc; ++arg) {
+        if (std::strcmp(*arg, "--validation") == 0) {
+            enable_validation = true;
+        } else if (std::strcmp(*arg, "--count") == 0 &&
+                   arg + 1 < p_argv + p_argc) {
+            mesh_count = std::strtoul(*(++arg), nullptr, 10);
+        }
+    }
+
+    if (!glfwInit()) {
+        throw mv::glfw_init_failed_exception{};
+    }
+
+    // The window never gets shown, it's only here for the surface.
+    const auto instance = mv::vulkan_instance_t::create(enable_validation);
+    auto window = mv::window_t::create(instance, "Upload benchmark", 64, 64);
+    const auto device = mv::vulkan_device_t::create(instance, window.surface);
+    auto allocator = mv::memory_allocator_t::create(device);
+    const auto command_pool = mv::command_pool_t::create(device);
+
+    std::vector<mv::mesh_t> meshes;
+    meshes.reserve(mesh_count);
+    VkDeviceSize total_bytes = 0;
+    for (size_t i = 0; i < mesh_count; i++) {
+        meshes.push_back(mv::mesh_t::create_cube(
+            static_cast<float>(i), 1.0f, glm::vec3(static_cast<float>(i))
+        ));
+        total_bytes += meshes.back().vertices.size() * sizeof(mv::vertex_t) +
+                       meshes.back().indices.size() * sizeof(uint32_t);
+    }
+
+    std::cout << "[INFO]: Uploading " << mesh_count << " meshes ("
+              << mesh_count * 2 << " buffers, " << total_bytes
+              << " bytes).\n";
+
+    {
+        const auto buffers = create_mesh_buffers(device, allocator, meshes);
+
+        const auto start = clock_type::now();
+        for (const auto [i, mesh] : enumerate(meshes.begin(), meshes.end())) {
+            legacy_upload(
+                device,
+                command_pool.pool,
+                buffers[i].vertex_buffer.buffer,
+                mesh.vertices.data(),
+                mesh.vertices.size() * sizeof(mv::vertex_t)
+            );
+            legacy_upload(
+                device,
+                command_pool.pool,
+                buffers[i].index_buffer.buffer,
+                mesh.indices.data(),
+                mesh.indices.size() * sizeof(uint32_t)
+            );
+        }
+
+        std::cout << "[INFO]: Staging buffer + wait idle per buffer: "
+                  << milliseconds_since(start) << " ms (" << mesh_count * 2
+                  << " submits).\n";
+    }
+
+    {
+        const auto buffers = create_mesh_buffers(device, allocator, meshes);
+        auto uploader = mv::upload_service_t::create(device, allocator);
+
+        const auto start = clock_type::now();
+        for (const auto [i, mesh] : enumerate(meshes.begin(), meshes.end())) {
+            uploader.upload_buffer(
+                buffers[i].vertex_buffer.buffer,
+                mesh.vertices.data(),
+                mesh.vertices.size() * sizeof(mv::vertex_t)
+            );
+            uploader.upload_buffer(
+                buffers[i].index_buffer.buffer,
+                mesh.indices.data(),
+                mesh.indices.size() * sizeof(uint32_t)
+            );
+        }
+        uploader.flush();
+
+        std::cout << "[INFO]: Upload service: " << milliseconds_since(start)
+                  << " ms (" << uploader.next_batch_id - 1 << " submits).\n";
+    }
+
+    vkDeviceWaitIdle(device.logical);
+} catch (const mv::vulkan_exception &e) {
+    std::cerr << "[ERROR]: Vulkan error " << e.error_code << '\n';
+    return EXIT_FAILURE;
+} catch (const std::exception &e) {
+    std::cerr << "[ERROR]: " << e.what() << '\n';
+    return EXIT_FAILURE;
+}
@@ -1,5 +1,7 @@
 #version 450
 
+#extension GL_EXT_nonuniform_qualifier : require
+
 #include "common.glsl"
 
 #define LIGHT_ID 2
@@ -7,14 +9,27 @@
 
 #define M_PI 3.1415926535897932384626433832795
 
+// Set per pipeline, see lighting_variant_t. Everything that depends on these
+// gets folded away when the pipeline is built, so none of it is a branch.
+layout (constant_id = 0) const bool SHADOWS = true;
+layout (constant_id = 1) const int PCF_SIZE = 1;
+layout (constant_id = 2) const int LIGHT_COUNT = 1;
+layout (constant_id = 3) const bool SPOTLIGHT = true;
+layout (constant_id = 4) const float SHADOW_BIAS = 0.0005;
+
+const int PCF_RADIUS = PCF_SIZE / 2;
+
 layout (location = 0) out vec4 frag_color;
 
 layout (push_constant) uniform push_constants_t {
     float t;
 } push_constants;
 
-layout (binding = 1) uniform sampler2D texture_samplers[2];
-layout (binding = 2) uniform sampler2D shadow_sampler;
+layout (binding = 1) uniform sampler2D shadow_sampler;
+
+// See texture_registry_t.
+layout (set = 1, binding = 0) uniform texture2D textures[];
+layout (set = 1, binding = 1) uniform sampler samplers[];
 
 layout (location = 0) in float x_pos;
 layout (location = 1) in vec2 uv;
@@ -23,6 +38,7 @@ layout (location = 3) in vec3 normal;
 layout (location = 4) flat in int id;
 layout (location = 6) in vec3 fragment_position;
 layout (location = 7) in vec4 shadow_position;
+layout (location = 8) flat in uint material;
 
 vec3 calculate_diffuse(vec3 normal, vec3 light_direction, vec3 light_color) {
     const float diffuse_factor = max(0.0, dot(normal, light_direction));
@@ -43,13 +59,22 @@ float calculate_shadow() {
     vec3 shadow_position_real = shadow_position.xyz / shadow_position.w;
     shadow_position_real.x = shadow_position_real.x * 0.5 + 0.5;
     shadow_position_real.y = shadow_position_real.y * 0.5 + 0.5;
-    const float distance = texture(shadow_sampler, shadow_position_real.st).r;
 
-    if (shadow_position_real.z - 0.0005 > distance) {
-        return 0.1;
+    const vec2 texel_size = 1.0 / vec2(textureSize(shadow_sampler, 0));
+
+    // The average over a PCF_SIZE by PCF_SIZE block of texels, which is just
+    // the one texel for a size of 1.
+    float lit = 0.0;
+    for (int x = -PCF_RADIUS; x <= PCF_RADIUS; x++) {
+        for (int y = -PCF_RADIUS; y <= PCF_RADIUS; y++) {
+            const vec2 offset = vec2(x, y) * texel_size;
+            const float distance = texture(shadow_sampler, shadow_position_real.st + offset).r;
+            lit += step(shadow_position_real.z - SHADOW_BIAS, distance);
+        }
     }
 
-    return 1.0;
+    lit /= float((2 * PCF_RADIUS + 1) * (2 * PCF_RADIUS + 1));
+    return mix(0.1, 1.0, lit);
 }
 
 void main() {
@@ -63,7 +88,7 @@ void main() {
     if (id == FLOOR_ID) {
         material_color = vec3(1.0, 1.0, 0.0);
     } else {
-        material_color = texture(texture_samplers[id], uv).rgb;
+        material_color = texture(sampler2D(textures[nonuniformEXT(material)], samplers[0]), uv).rgb;
     }
 
     const vec4 color_bands = vec4(1.0, sin(( push_constants.t + x_pos ) * 10), 0.0, 1.0);
@@ -84,12 +109,14 @@ void main() {
     const float offset = dot(-ubo.global_light_direction, light_direction);
     const float cutoff = cos(radians(45.0));
 
-    vec3 lighting;
-    if (offset > cutoff) {
-        lighting = (specular * attenuation * calculate_shadow() + ambient + diffuse * attenuation * calculate_shadow());
-    } else {
-        lighting = ambient;
-    }
+    const float spot = SPOTLIGHT ? step(cutoff, offset) : 1.0;
+    const float shadow = SHADOWS ? calculate_shadow() : 1.0;
+
+    // There is only the one light in the uniforms, so any count past that
+    // still means just the one.
+    const float lights = LIGHT_COUNT > 0 ? 1.0 : 0.0;
+
+    const vec3 lighting = ambient + (specular + diffuse) * attenuation * spot * shadow * lights;
 
     const vec3 color = material_color * lighting;
     frag_color = vec4(color, 1.0);
@@ -16,6 +16,9 @@ layout (location = 5) out vec3 light_position;
 layout (location = 6) out vec3 fragment_position;
 layout (location = 7) out vec4 shadow_position;
 
+// Which texture to use, which comes in as the draw's first instance.
+layout (location = 8) flat out uint material;
+
 void main() {
     gl_Position = (ubo.projection * ubo.view) * ubo.model * vec4(a_position, 1.0);
 
@@ -25,4 +28,5 @@ void main() {
     id = int(a_id);
     fragment_position = (ubo.model * vec4(a_position, 1.0)).xyz;
     shadow_position = ubo.light_mat * ubo.model * vec4(a_position, 1.0);
+    material = uint(gl_InstanceIndex);
 }
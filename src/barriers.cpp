@@ -0,0 +1,309 @@
+#include "errors.hpp"
+
+#include "barriers.hpp"
+
+namespace mv {
+
+auto get_layout_access_scope(VkImageLayout layout) -> access_scope_t {
+    switch (layout) {
+    case VK_IMAGE_LAYOUT_UNDEFINED:
+    case VK_IMAGE_LAYOUT_PREINITIALIZED:
+        return {VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, 0};
+    case VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL:
+        return {VK_PIPELINE_STAGE_TRANSFER_BIT, VK_ACCESS_TRANSFER_READ_BIT};
+    case VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL:
+        return {VK_PIPELINE_STAGE_TRANSFER_BIT, VK_ACCESS_TRANSFER_WRITE_BIT};
+    case VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL:
+        return {
+            VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, VK_ACCESS_SHADER_READ_BIT
+        };
+    case VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL:
+        return {
+            VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT,
+            VK_ACCESS_COLOR_ATTACHMENT_READ_BIT |
+                VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT,
+        };
+    case VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL:
+        return {
+            VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT |
+                VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT,
+            VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_READ_BIT |
+                VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT,
+        };
+    case VK_IMAGE_LAYOUT_DEPTH_STENCIL_READ_ONLY_OPTIMAL:
+        return {
+            VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT |
+                VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT |
+                VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT,
+            VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_READ_BIT |
+                VK_ACCESS_SHADER_READ_BIT,
+        };
+    case VK_IMAGE_LAYOUT_PRESENT_SRC_KHR:
+        return {VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, 0};
+    default:
+        // Anything else (GENERAL included) could be used by anything.
+        return {
+            VK_PIPELINE_STAGE_ALL_COMMANDS_BIT,
+            VK_ACCESS_MEMORY_READ_BIT | VK_ACCESS_MEMORY_WRITE_BIT,
+        };
+    }
+}
+
+auto barrier_builder_t::transition(
+    vulkan_image_t &image,
+    VkImageLayout new_layout,
+    std::optional<VkImageSubresourceRange> p_range
+) -> barrier_builder_t & {
+    auto range = p_range.value_or(image.get_subresource_range());
+
+    if (range.levelCount == VK_REMAINING_MIP_LEVELS) {
+        range.levelCount = image.mip_levels - range.baseMipLevel;
+    }
+    if (range.layerCount == VK_REMAINING_ARRAY_LAYERS) {
+        range.layerCount = image.array_layers - range.baseArrayLayer;
+    }
+
+    const auto first_layout =
+        image.get_layout(range.baseMipLevel, range.baseArrayLayer);
+
+    bool uniform = true;
+    for (auto layer = range.baseArrayLayer;
+         uniform && layer < range.baseArrayLayer + range.layerCount;
+         layer++) {
+        for (auto level = range.baseMipLevel;
+             level < range.baseMipLevel + range.levelCount;
+             level++) {
+            if (image.get_layout(level, layer) != first_layout) {
+                uniform = false;
+                break;
+            }
+        }
+    }
+
+    if (uniform) {
+        add_image_barrier(image, first_layout, new_layout, range);
+    } else {
+        // One barrier per run of layers that share a layout, for every level.
+        for (auto level = range.baseMipLevel;
+             level < range.baseMipLevel + range.levelCount;
+             level++) {
+            auto run_start = range.baseArrayLayer;
+            const auto end = range.baseArrayLayer + range.layerCount;
+
+            for (auto layer = run_start + 1; layer <= end; layer++) {
+                const auto run_layout = image.get_layout(level, run_start);
+                if (layer < end && image.get_layout(level, layer) == run_layout) {
+                    continue;
+                }
+
+                add_image_barrier(
+                    image,
+                    run_layout,
+                    new_layout,
+                    {
+                        .aspectMask = range.aspectMask,
+                        .baseMipLevel = level,
+                        .levelCount = 1,
+                        .baseArrayLayer = run_start,
+                        .layerCount = layer - run_start,
+                    }
+                );
+
+                run_start = layer;
+            }
+        }
+    }
+
+    image.set_layout(range, new_layout);
+
+    return *this;
+}
+
+auto barrier_builder_t::buffer(
+    VkBuffer p_buffer,
+    access_scope_t source,
+    access_scope_t destination,
+    VkDeviceSize offset,
+    VkDeviceSize size
+) -> barrier_builder_t & {
+    buffer_barriers.push_back({
+        .sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER_2,
+        .pNext = nullptr,
+        .srcStageMask = source.stage_mask,
+        .srcAccessMask = source.access_mask,
+        .dstStageMask = destination.stage_mask,
+        .dstAccessMask = destination.access_mask,
+        .srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+        .dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+        .buffer = p_buffer,
+        .offset = offset,
+        .size = size,
+    });
+
+    return *this;
+}
+
+auto barrier_builder_t::memory(
+    access_scope_t source, access_scope_t destination
+) -> barrier_builder_t & {
+    memory_barriers.push_back({
+        .sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER_2,
+        .pNext = nullptr,
+        .srcStageMask = source.stage_mask,
+        .srcAccessMask = source.access_mask,
+        .dstStageMask = destination.stage_mask,
+        .dstAccessMask = destination.access_mask,
+    });
+
+    return *this;
+}
+
+auto barrier_builder_t::add_image_barrier(
+    const vulkan_image_t &image,
+    VkImageLayout old_layout,
+    VkImageLayout new_layout,
+    const VkImageSubresourceRange &range
+) -> void {
+    const auto source = get_layout_access_scope(old_layout);
+    const auto destination = get_layout_access_scope(new_layout);
+
+    image_barriers.push_back({
+        .sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER_2,
+        .pNext = nullptr,
+        .srcStageMask = source.stage_mask,
+        .srcAccessMask = source.access_mask,
+        .dstStageMask = destination.stage_mask,
+        .dstAccessMask = destination.access_mask,
+        .oldLayout = old_layout,
+        .newLayout = new_layout,
+        .srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+        .dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+        .image = image.image,
+        .subresourceRange = range,
+    });
+}
+
+auto barrier_builder_t::record(VkCommandBuffer command_buffer) -> void {
+    if (empty()) {
+        return;
+    }
+
+    if (device.cmd_pipeline_barrier2 != nullptr) {
+        const VkDependencyInfo dependency_info{
+            .sType = VK_STRUCTURE_TYPE_DEPENDENCY_INFO,
+            .pNext = nullptr,
+            .dependencyFlags = 0,
+            .memoryBarrierCount =
+                static_cast<uint32_t>(memory_barriers.size()),
+            .pMemoryBarriers = memory_barriers.data(),
+            .bufferMemoryBarrierCount =
+                static_cast<uint32_t>(buffer_barriers.size()),
+            .pBufferMemoryBarriers = buffer_barriers.data(),
+            .imageMemoryBarrierCount =
+                static_cast<uint32_t>(image_barriers.size()),
+            .pImageMemoryBarriers = image_barriers.data(),
+        };
+
+        device.cmd_pipeline_barrier2(command_buffer, &dependency_info);
+    } else {
+        // Without synchronization2 every barrier has to share the same stage
+        // masks, so they all get merged together.
+        VkPipelineStageFlags src_stage_mask = 0;
+        VkPipelineStageFlags dst_stage_mask = 0;
+
+        std::vector<VkMemoryBarrier> legacy_memory_barriers;
+        legacy_memory_barriers.reserve(memory_barriers.size());
+        for (const auto &barrier : memory_barriers) {
+            src_stage_mask |=
+                static_cast<VkPipelineStageFlags>(barrier.srcStageMask);
+            dst_stage_mask |=
+                static_cast<VkPipelineStageFlags>(barrier.dstStageMask);
+
+            legacy_memory_barriers.push_back({
+                .sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER,
+                .pNext = nullptr,
+                .srcAccessMask =
+                    static_cast<VkAccessFlags>(barrier.srcAccessMask),
+                .dstAccessMask =
+                    static_cast<VkAccessFlags>(barrier.dstAccessMask),
+            });
+        }
+
+        std::vector<VkBufferMemoryBarrier> legacy_buffer_barriers;
+        legacy_buffer_barriers.reserve(buffer_barriers.size());
+        for (const auto &barrier : buffer_barriers) {
+            src_stage_mask |=
+                static_cast<VkPipelineStageFlags>(barrier.srcStageMask);
+            dst_stage_mask |=
+                static_cast<VkPipelineStageFlags>(barrier.dstStageMask);
+
+            legacy_buffer_barriers.push_back({
+                .sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER,
+                .pNext = nullptr,
+                .srcAccessMask =
+                    static_cast<VkAccessFlags>(barrier.srcAccessMask),
+                .dstAccessMask =
+                    static_cast<VkAccessFlags>(barrier.dstAccessMask),
+                .srcQueueFamilyIndex = barrier.srcQueueFamilyIndex,
+                .dstQueueFamilyIndex = barrier.dstQueueFamilyIndex,
+                .buffer = barrier.buffer,
+                .offset = barrier.offset,
+                .size = barrier.size,
+            });
+        }
+
+        std::vector<VkImageMemoryBarrier> legacy_image_barriers;
+        legacy_image_barriers.reserve(image_barriers.size());
+        for (const auto &barrier : image_barriers) {
+            src_stage_mask |=
+                static_cast<VkPipelineStageFlags>(barrier.srcStageMask);
+            dst_stage_mask |=
+                static_cast<VkPipelineStageFlags>(barrier.dstStageMask);
+
+            legacy_image_barriers.push_back({
+                .sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER,
+                .pNext = nullptr,
+                .srcAccessMask =
+                    static_cast<VkAccessFlags>(barrier.srcAccessMask),
+                .dstAccessMask =
+                    static_cast<VkAccessFlags>(barrier.dstAccessMask),
+                .oldLayout = barrier.oldLayout,
+                .newLayout = barrier.newLayout,
+                .srcQueueFamilyIndex = barrier.srcQueueFamilyIndex,
+                .dstQueueFamilyIndex = barrier.dstQueueFamilyIndex,
+                .image = barrier.image,
+                .subresourceRange = barrier.subresourceRange,
+            });
+        }
+
+        vkCmdPipelineBarrier(
+            command_buffer,
+            src_stage_mask != 0 ? src_stage_mask
+                                : static_cast<VkPipelineStageFlags>(
+                                      VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT
+                                  ),
+            dst_stage_mask != 0 ? dst_stage_mask
+                                : static_cast<VkPipelineStageFlags>(
+                                      VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT
+                                  ),
+            0,
+            static_cast<uint32_t>(legacy_memory_barriers.size()),
+            legacy_memory_barriers.data(),
+            static_cast<uint32_t>(legacy_buffer_barriers.size()),
+            legacy_buffer_barriers.data(),
+            static_cast<uint32_t>(legacy_image_barriers.size()),
+            legacy_image_barriers.data()
+        );
+    }
+
+    if (counters != nullptr) {
+        counters->barriers += memory_barriers.size() + buffer_barriers.size() +
+                              image_barriers.size();
+    }
+
+    memory_barriers.clear();
+    buffer_barriers.clear();
+    image_barriers.clear();
+}
+
+} // namespace mv
@@ -0,0 +1,78 @@
+#pragma once
+
+#include <vulkan/vulkan.h>
+
+#include "common.hpp"
+#include "counters.hpp"
+#include "device.hpp"
+#include "images.hpp"
+
+namespace mv {
+
+// One side of a barrier. The synchronization2 flags are used throughout, the
+// legacy bits have the same values so they can be used here too.
+struct access_scope_t {
+    VkPipelineStageFlags2 stage_mask;
+    VkAccessFlags2 access_mask;
+};
+
+// The stages and accesses that an image in the given layout is normally used
+// with. Works as either side of a barrier.
+auto get_layout_access_scope(VkImageLayout layout) -> access_scope_t;
+
+// Collects image, buffer and memory barriers and records all of them with a
+// single vkCmdPipelineBarrier2 if the device has synchronization2, or a single
+// vkCmdPipelineBarrier with the stage masks merged if it doesn't.
+struct barrier_builder_t {
+    const vulkan_device_t &device;
+
+    std::vector<VkMemoryBarrier2> memory_barriers;
+    std::vector<VkBufferMemoryBarrier2> buffer_barriers;
+    std::vector<VkImageMemoryBarrier2> image_barriers;
+
+    // If set, record() adds the barriers it records to it.
+    command_counters_t *counters{nullptr};
+
+    explicit barrier_builder_t(const vulkan_device_t &p_device)
+        : device(p_device) {}
+
+    // Transitions the given subresources (all of them by default) from
+    // whatever layout each one is in to `new_layout`. Subresources that are in
+    // different layouts get barriers of their own. The image's tracked layouts
+    // are updated right away.
+    auto transition(
+        vulkan_image_t &image,
+        VkImageLayout new_layout,
+        std::optional<VkImageSubresourceRange> range = std::nullopt
+    ) -> barrier_builder_t &;
+
+    auto buffer(
+        VkBuffer buffer,
+        access_scope_t source,
+        access_scope_t destination,
+        VkDeviceSize offset = 0,
+        VkDeviceSize size = VK_WHOLE_SIZE
+    ) -> barrier_builder_t &;
+
+    auto memory(access_scope_t source, access_scope_t destination)
+        -> barrier_builder_t &;
+
+    inline auto empty() const -> bool {
+        return memory_barriers.empty() && buffer_barriers.empty() &&
+               image_barriers.empty();
+    }
+
+    // Records everything collected so far and clears the builder. Does nothing
+    // if there is nothing to record.
+    auto record(VkCommandBuffer command_buffer) -> void;
+
+  private:
+    auto add_image_barrier(
+        const vulkan_image_t &image,
+        VkImageLayout old_layout,
+        VkImageLayout new_layout,
+        const VkImageSubresourceRange &range
+    ) -> void;
+};
+
+} // namespace mv
@@ -0,0 +1,356 @@
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <fstream>
+#include <iomanip>
+#include <numeric>
+#include <sstream>
+
+#include "errors.hpp"
+
+#include "benchmark.hpp"
+
+namespace mv {
+
+namespace {
+// Just enough of a JSON reader to get the summaries back out of the files that
+// write_json() produces.
+struct json_reader_t {
+    std::string_view text;
+    size_t position{0};
+
+    auto skip_whitespace() -> void {
+        while (position < text.size() &&
+               std::isspace(static_cast<unsigned char>(text[position]))) {
+            position++;
+        }
+    }
+
+    auto consume(char c) -> bool {
+        skip_whitespace();
+        if (position < text.size() && text[position] == c) {
+            position++;
+            return true;
+        }
+
+        return false;
+    }
+
+    auto read_string() -> std::optional<std::string> {
+        if (!consume('"')) {
+            return std::nullopt;
+        }
+
+        std::string string;
+        while (position < text.size() && text[position] != '"') {
+            if (text[position] != '\\') {
+                string += text[position++];
+                continue;
+            }
+
+            position++;
+            if (position >= text.size()) {
+                break;
+            }
+
+            const auto escaped = text[position++];
+            switch (escaped) {
+            case 'n':
+                string += '\n';
+                break;
+            case 't':
+                string += '\t';
+                break;
+            case 'r':
+                string += '\r';
+                break;
+            case 'b':
+                string += '\b';
+                break;
+            case 'f':
+                string += '\f';
+                break;
+            case 'u':
+                // write_json_string() only ever writes these for control
+                // characters, so the four digits always fit in a char.
+                if (position + 4 <= text.size()) {
+                    string += static_cast<char>(std::strtoul(
+                        std::string{text.substr(position, 4)}.c_str(),
+                        nullptr,
+                        16
+                    ));
+                    position += 4;
+                }
+                break;
+            default:
+                string += escaped;
+            }
+        }
+
+        if (!consume('"')) {
+            return std::nullopt;
+        }
+
+        return string;
+    }
+
+    auto read_number() -> std::optional<double> {
+        skip_whitespace();
+
+        const auto start = text.data() + position;
+        char *end;
+        const auto number = std::strtod(start, &end);
+        if (end == start) {
+            return std::nullopt;
+        }
+
+        position += static_cast<size_t>(end - start);
+        return number;
+    }
+};
+
+// Adds the sample to the series with that name, which is started if there
+// isn't one yet.
+auto add_sample(
+    std::vector<sample_series_t> &all, std::string_view name, double value
+) -> void {
+    auto series_it = std::find_if(all.begin(), all.end(), [&](const auto &s) {
+        return s.name == name;
+    });
+
+    if (series_it == all.end()) {
+        all.push_back({.name = std::string{name}, .samples = {}});
+        series_it = all.end() - 1;
+    }
+
+    series_it->samples.push_back(value);
+}
+} // namespace
+
+auto write_json_string(std::ostream &stream, std::string_view string)
+    -> void {
+    const auto flags = stream.flags();
+
+    stream << '"';
+    for (const auto c : string) {
+        switch (c) {
+        case '"':
+            stream << "\\\"";
+            break;
+        case '\\':
+            stream << "\\\\";
+            break;
+        case '\n':
+            stream << "\\n";
+            break;
+        case '\t':
+            stream << "\\t";
+            break;
+        case '\r':
+            stream << "\\r";
+            break;
+        default:
+            if (static_cast<unsigned char>(c) < 0x20) {
+                stream << "\\u" << std::hex << std::setw(4)
+                       << std::setfill('0')
+                       << static_cast<int>(static_cast<unsigned char>(c))
+                       << std::dec << std::setfill(' ');
+            } else {
+                stream << c;
+            }
+        }
+    }
+    stream << '"';
+
+    stream.flags(flags);
+}
+
+auto sample_series_t::summarize() const -> summary_t {
+    if (samples.empty()) {
+        return {0.0, 0.0, 0.0, 0.0, 0.0};
+    }
+
+    auto sorted = samples;
+    std::sort(sorted.begin(), sorted.end());
+
+    // Nearest rank, so every percentile is a frame that actually happened.
+    const auto percentile = [&](double p) {
+        const auto rank = static_cast<size_t>(
+            std::ceil(p / 100.0 * static_cast<double>(sorted.size()))
+        );
+        return sorted[std::clamp<size_t>(rank, 1, sorted.size()) - 1];
+    };
+
+    return {
+        .mean = std::accumulate(sorted.begin(), sorted.end(), 0.0) /
+                static_cast<double>(sorted.size()),
+        .p50 = percentile(50.0),
+        .p95 = percentile(95.0),
+        .p99 = percentile(99.0),
+        .max = sorted.back(),
+    };
+}
+
+auto benchmark_report_t::set(std::string_view key, std::string_view value)
+    -> void {
+    std::ostringstream stream;
+    write_json_string(stream, value);
+    metadata.emplace_back(key, stream.str());
+}
+
+auto benchmark_report_t::set(std::string_view key, double value) -> void {
+    std::ostringstream stream;
+    stream << value;
+    metadata.emplace_back(key, stream.str());
+}
+
+auto benchmark_report_t::add(std::string_view name, double milliseconds)
+    -> void {
+    add_sample(series, name, milliseconds);
+}
+
+auto benchmark_report_t::count(std::string_view name, double value) -> void {
+    add_sample(counters, name, value);
+}
+
+auto benchmark_report_t::write_json(std::ostream &stream) const -> void {
+    const auto flags = stream.flags();
+    stream << std::fixed << std::setprecision(4);
+
+    stream << "{\n";
+    for (const auto &[key, value] : metadata) {
+        stream << "  ";
+        write_json_string(stream, key);
+        stream << ": " << value << ",\n";
+    }
+
+    const auto write_section = [&](std::string_view name,
+                                   const std::vector<sample_series_t> &all) {
+        stream << "  ";
+        write_json_string(stream, name);
+        stream << ": {";
+
+        for (size_t i = 0; i < all.size(); i++) {
+            const auto summary = all[i].summarize();
+
+            stream << (i == 0 ? "\n    " : ",\n    ");
+            write_json_string(stream, all[i].name);
+            stream << ": {\"samples\": " << all[i].samples.size()
+                   << ", \"mean\": " << summary.mean
+                   << ", \"p50\": " << summary.p50
+                   << ", \"p95\": " << summary.p95
+                   << ", \"p99\": " << summary.p99
+                   << ", \"max\": " << summary.max << '}';
+        }
+
+        stream << "\n  }";
+    };
+
+    write_section("metrics", series);
+    stream << ",\n";
+    write_section("counters", counters);
+    stream << "\n}\n";
+
+    stream.flags(flags);
+}
+
+auto benchmark_report_t::read_summaries(std::string_view path)
+    -> std::map<std::string, sample_series_t::summary_t> {
+    std::ifstream file{std::string{path}};
+    if (!file.is_open()) {
+        throw file_exception(file_exception::type_t::open, path);
+    }
+
+    const std::string text{
+        std::istreambuf_iterator<char>{file}, std::istreambuf_iterator<char>{}
+    };
+
+    const auto metrics = text.find("\"metrics\"");
+    if (metrics == std::string::npos) {
+        throw file_exception(file_exception::type_t::read, path);
+    }
+
+    json_reader_t reader{.text = text, .position = metrics};
+    reader.read_string();
+    if (!reader.consume(':') || !reader.consume('{')) {
+        throw file_exception(file_exception::type_t::read, path);
+    }
+
+    std::map<std::string, sample_series_t::summary_t> summaries;
+    while (!reader.consume('}')) {
+        reader.consume(',');
+
+        const auto name = reader.read_string();
+        if (!name.has_value() || !reader.consume(':') || !reader.consume('{')) {
+            throw file_exception(file_exception::type_t::read, path);
+        }
+
+        sample_series_t::summary_t summary{0.0, 0.0, 0.0, 0.0, 0.0};
+        while (!reader.consume('}')) {
+            reader.consume(',');
+
+            const auto key = reader.read_string();
+            const auto value =
+                reader.consume(':') ? reader.read_number() : std::nullopt;
+            if (!key.has_value() || !value.has_value()) {
+                throw file_exception(file_exception::type_t::read, path);
+            }
+
+            if (*key == "mean") {
+                summary.mean = *value;
+            } else if (*key == "p50") {
+                summary.p50 = *value;
+            } else if (*key == "p95") {
+                summary.p95 = *value;
+            } else if (*key == "p99") {
+                summary.p99 = *value;
+            } else if (*key == "max") {
+                summary.max = *value;
+            }
+        }
+
+        summaries[*name] = summary;
+    }
+
+    return summaries;
+}
+
+auto benchmark_report_t::compare(
+    const std::map<std::string, sample_series_t::summary_t> &baseline,
+    double tolerance,
+    std::ostream &stream
+) const -> bool {
+    const auto flags = stream.flags();
+    stream << std::fixed << std::setprecision(1);
+
+    const auto change = [](double current, double previous) {
+        return previous > 0.0 ? (current - previous) / previous : 0.0;
+    };
+
+    auto passed = true;
+    for (const auto &s : series) {
+        const auto it = baseline.find(s.name);
+        if (it == baseline.end()) {
+            stream << "[INFO]: " << s.name << ": not in the baseline.\n";
+            continue;
+        }
+
+        const auto summary = s.summarize();
+        const auto mean_change = change(summary.mean, it->second.mean);
+        const auto p95_change = change(summary.p95, it->second.p95);
+        const auto regressed =
+            mean_change > tolerance || p95_change > tolerance;
+
+        stream << (regressed ? "[ERROR]: " : "[INFO]: ") << s.name
+               << ": mean " << std::showpos << mean_change * 100.0
+               << "%, p95 " << p95_change * 100.0 << '%' << std::noshowpos
+               << (regressed ? " (regression)" : "") << '\n';
+
+        passed = passed && !regressed;
+    }
+
+    stream.flags(flags);
+    return passed;
+}
+
+} // namespace mv
@@ -0,0 +1,69 @@
+#pragma once
+
+#include <map>
+#include <ostream>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+namespace mv {
+
+// Writes the string as a quoted JSON string, escaping whatever has to be.
+auto write_json_string(std::ostream &stream, std::string_view string) -> void;
+
+// Per-frame samples of one measurement.
+struct sample_series_t {
+    struct summary_t {
+        double mean;
+        double p50;
+        double p95;
+        double p99;
+        double max;
+    };
+
+    std::string name;
+    std::vector<double> samples;
+
+    auto summarize() const -> summary_t;
+};
+
+// Everything a benchmark run measured. Series are written out in the order
+// they were first added to.
+//
+// Timings and counts go in sections of their own. Only timings get compared
+// against a baseline, since more draws or more shader invocations aren't a
+// regression in themselves.
+struct benchmark_report_t {
+    // Written out as is, so the values have to be valid JSON already.
+    std::vector<std::pair<std::string, std::string>> metadata;
+
+    // In milliseconds.
+    std::vector<sample_series_t> series;
+
+    // Things counted per frame, like draws.
+    std::vector<sample_series_t> counters;
+
+    auto set(std::string_view key, std::string_view value) -> void;
+    auto set(std::string_view key, double value) -> void;
+
+    auto add(std::string_view name, double milliseconds) -> void;
+    auto count(std::string_view name, double value) -> void;
+
+    auto write_json(std::ostream &stream) const -> void;
+
+    // Reads the timing summaries back out of a file written by write_json().
+    static auto read_summaries(std::string_view path)
+        -> std::map<std::string, sample_series_t::summary_t>;
+
+    // Prints how every timing did against the baseline, and returns false if
+    // the mean or p95 of any of them got more than `tolerance` (a fraction)
+    // slower.
+    auto compare(
+        const std::map<std::string, sample_series_t::summary_t> &baseline,
+        double tolerance,
+        std::ostream &stream
+    ) const -> bool;
+};
+
+} // namespace mv
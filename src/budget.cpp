@@ -0,0 +1,129 @@
+#include <algorithm>
+#include <numeric>
+
+#include "budget.hpp"
+
+namespace mv {
+
+auto memory_budget_t::create(
+    memory_allocator_t &allocator, double high_water_mark
+) -> memory_budget_t {
+    return memory_budget_t{allocator, high_water_mark};
+}
+
+auto memory_budget_t::add(
+    const vulkan_memory_t &memory, std::function<void()> evict
+) -> uint64_t {
+    std::lock_guard lock{mutex};
+
+    const auto id = next_id++;
+    entries.push_back({
+        .id = id,
+        .heap_index = memory.heap_index,
+        .size = memory.size,
+        .evict = std::move(evict),
+    });
+    lookup[id] = std::prev(entries.end());
+
+    return id;
+}
+
+auto memory_budget_t::touch(uint64_t id) -> void {
+    std::lock_guard lock{mutex};
+
+    const auto it = lookup.find(id);
+    if (it != lookup.end()) {
+        entries.splice(entries.end(), entries, it->second);
+    }
+}
+
+auto memory_budget_t::remove(uint64_t id) -> void {
+    std::lock_guard lock{mutex};
+
+    const auto it = lookup.find(id);
+    if (it != lookup.end()) {
+        entries.erase(it->second);
+        lookup.erase(it);
+    }
+}
+
+auto memory_budget_t::enforce(
+    uint64_t collected_value, uint64_t retire_value
+) -> VkDeviceSize {
+    const auto budgets = allocator.get_heap_budgets();
+
+    std::vector<entry_t> victims;
+
+    {
+        std::lock_guard lock{mutex};
+
+        while (!pending.empty() && pending.front().value <= collected_value) {
+            pending.pop_front();
+        }
+
+        for (const auto &budget : budgets) {
+            const auto mark = static_cast<VkDeviceSize>(
+                static_cast<double>(budget.budget) * high_water_mark
+            );
+
+            // Freeing something only gives the memory back to the block it
+            // came out of, so the free space in the allocator's blocks doesn't
+            // count. Otherwise, evicting a small resource would never get the
+            // usage down, and everything else would go with it.
+            const auto &allocator_usage = budget.allocator_usage;
+            const auto sub_allocated = std::accumulate(
+                allocator_usage.categories.begin(),
+                allocator_usage.categories.end(),
+                VkDeviceSize{0}
+            );
+
+            auto unavailable = allocator_usage.allocated - sub_allocated;
+            for (const auto &evicted : pending) {
+                if (evicted.heap_index == budget.heap_index) {
+                    unavailable += evicted.size;
+                }
+            }
+
+            const auto usage =
+                budget.usage - std::min(budget.usage, unavailable);
+            if (usage <= mark) {
+                continue;
+            }
+
+            auto excess = usage - mark;
+            auto it = entries.begin();
+            while (it != entries.end() && excess > 0) {
+                if (it->heap_index != budget.heap_index) {
+                    ++it;
+                    continue;
+                }
+
+                excess -= std::min(excess, it->size);
+                pending.push_back({
+                    .value = retire_value,
+                    .heap_index = it->heap_index,
+                    .size = it->size,
+                });
+                lookup.erase(it->id);
+                victims.push_back(std::move(*it));
+                it = entries.erase(it);
+            }
+        }
+    }
+
+    // The callbacks free memory, which takes the allocator's lock, and might
+    // register something new, which takes this one.
+    VkDeviceSize evicted = 0;
+    for (auto &victim : victims) {
+        victim.evict();
+        evicted += victim.size;
+    }
+
+    std::lock_guard lock{mutex};
+    eviction_count += victims.size();
+    evicted_bytes += evicted;
+
+    return evicted;
+}
+
+} // namespace mv
@@ -0,0 +1,94 @@
+#pragma once
+
+#include <deque>
+#include <functional>
+#include <list>
+#include <mutex>
+#include <unordered_map>
+
+#include <vulkan/vulkan.h>
+
+#include "common.hpp"
+#include "memory.hpp"
+
+namespace mv {
+
+// Keeps the allocator's heaps under a high-water mark by throwing away
+// resources that can be recreated later, such as streamed textures or caches.
+// Those get registered with a callback that evicts them, and are kept in the
+// order they were last used. Whenever a heap is over the mark, enforce() calls
+// the callbacks for that heap oldest first, until enough has been evicted to
+// get back under it.
+//
+// Eviction callbacks usually can't destroy things right away because the GPU
+// may still be using them, so they would hand them to the frames' deletion
+// queue instead. enforce() counts the memory as gone as soon as the callback
+// returns, and keeps counting it that way until the deletion queue has freed
+// it, so that it doesn't evict more than it needs to in the meantime.
+struct memory_budget_t {
+    // A fraction of each heap's budget.
+    static constexpr double DEFAULT_HIGH_WATER_MARK = 0.9;
+
+    struct entry_t {
+        uint64_t id;
+        uint32_t heap_index;
+        VkDeviceSize size;
+        std::function<void()> evict;
+    };
+
+    memory_allocator_t &allocator;
+    double high_water_mark;
+
+    // Least recently used first.
+    std::list<entry_t> entries;
+    std::unordered_map<uint64_t, std::list<entry_t>::iterator> lookup;
+    uint64_t next_id{1};
+
+    // Evicted, but not freed yet.
+    struct pending_t {
+        // The timeline value the evicted memory was retired with.
+        uint64_t value;
+        uint32_t heap_index;
+        VkDeviceSize size;
+    };
+
+    std::deque<pending_t> pending;
+
+    uint64_t eviction_count{0};
+    VkDeviceSize evicted_bytes{0};
+
+    // Resources can be registered and used from any thread.
+    std::mutex mutex;
+
+    memory_budget_t(memory_allocator_t &p_allocator, double p_high_water_mark)
+        : allocator(p_allocator), high_water_mark(p_high_water_mark) {}
+
+    static auto create(
+        memory_allocator_t &allocator,
+        double high_water_mark = DEFAULT_HIGH_WATER_MARK
+    ) -> memory_budget_t;
+
+    NO_COPY(memory_budget_t);
+
+    // Registers the resource that owns `memory`, as the most recently used
+    // one. The returned id is what gets passed to touch() and remove().
+    auto add(const vulkan_memory_t &memory, std::function<void()> evict)
+        -> uint64_t;
+
+    // Marks the resource as just used.
+    auto touch(uint64_t id) -> void;
+
+    // For resources that are destroyed some other way. Does nothing if the
+    // resource was already evicted.
+    auto remove(uint64_t id) -> void;
+
+    // Evicts as much as is needed to bring every heap back under the
+    // high-water mark, and returns how many bytes that was. Should be called
+    // at a point where the callbacks are safe to run, like the start of a
+    // frame. `retire_value` is what the callbacks retire things with, and
+    // everything retired with `collected_value` or less must have been freed.
+    auto enforce(uint64_t collected_value, uint64_t retire_value)
+        -> VkDeviceSize;
+};
+
+} // namespace mv
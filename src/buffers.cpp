@@ -4,7 +4,10 @@
 
 namespace mv {
 auto buffer_t::create(
-    const mv::vulkan_device_t &p_device, VkDeviceSize p_size, type_t p_type
+    const mv::vulkan_device_t &p_device,
+    memory_allocator_t &p_allocator,
+    VkDeviceSize p_size,
+    type_t p_type
 ) -> buffer_t {
     const VkBufferCreateInfo buffer_create_info{
         .sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO,
@@ -32,6 +35,10 @@ auto buffer_t::create(
                     return static_cast<VkBufferUsageFlags>(
                         VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT
                     );
+                case type_t::readback:
+                    return static_cast<VkBufferUsageFlags>(
+                        VK_BUFFER_USAGE_TRANSFER_DST_BIT
+                    );
                 }
             }(),
         .sharingMode = VK_SHARING_MODE_EXCLUSIVE,
@@ -52,9 +59,6 @@ auto buffer_t::create(
         p_device.logical, buffer, &memory_requirements
     );
 
-    VkPhysicalDeviceMemoryProperties memory_properties;
-    vkGetPhysicalDeviceMemoryProperties(p_device.physical, &memory_properties);
-
     VkMemoryPropertyFlags memory_property_flags = [&]() {
         switch (p_type) {
         case type_t::vertex:
@@ -71,6 +75,7 @@ auto buffer_t::create(
                 VK_MEMORY_PROPERTY_HOST_COHERENT_BIT
             );
         case type_t::uniform:
+        case type_t::readback:
             return static_cast<VkMemoryPropertyFlags>(
                 VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT |
                 VK_MEMORY_PROPERTY_HOST_COHERENT_BIT
@@ -78,111 +83,87 @@ auto buffer_t::create(
         }
     }();
 
-    std::optional<uint32_t> memory_type_index;
-
-    for (uint32_t i = 0; i < memory_properties.memoryTypeCount; i++) {
-        const auto property_flags =
-            memory_properties.memoryTypes[i].propertyFlags;
-
-        const auto has_type_bit =
-            (memory_requirements.memoryTypeBits & (1 << i)) != 0;
-
-        const auto has_property_flags =
-            (property_flags & memory_property_flags) == memory_property_flags;
-
-        if (has_type_bit && has_property_flags) {
-            memory_type_index = i;
+    const auto category = [&]() {
+        switch (p_type) {
+        case type_t::vertex:
+        case type_t::index:
+            return memory_category_t::geometry;
+        case type_t::staging:
+        case type_t::readback:
+            return memory_category_t::staging;
+        case type_t::uniform:
+            return memory_category_t::uniforms;
         }
-    }
-
-    if (!memory_type_index.has_value()) {
-        throw std::runtime_error("Could not find suitable memory type.");
-    }
 
-    const VkMemoryAllocateInfo memory_allocate_info{
-        .sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO,
-        .pNext = nullptr,
-        .allocationSize = memory_requirements.size,
-        .memoryTypeIndex = memory_type_index.value(),
-    };
+        return memory_category_t::other;
+    }();
 
-    VkDeviceMemory memory;
-    result = vkAllocateMemory(
-        p_device.logical, &memory_allocate_info, nullptr, &memory
+    auto memory = p_allocator.allocate(
+        memory_requirements, memory_property_flags, true, category
     );
-    if (result != VK_SUCCESS) {
-        throw vulkan_exception{result};
-    }
-
-    vkBindBufferMemory(p_device.logical, buffer, memory, 0);
+    memory.bind_buffer(buffer);
 
-    return {buffer, memory, p_size, p_device};
+    return {buffer, std::move(memory), p_size, p_device};
 }
 
-auto buffer_t::copy_from(const buffer_t &p_other, VkCommandPool p_command_pool)
-    const -> void {
-    // Pick the smallest of the two sizes
-    const auto size = std::min(p_other.size, this->size);
-
-    const VkCommandBufferAllocateInfo command_buffer_allocate_info{
-        .sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO,
-        .pNext = nullptr,
-        .commandPool = p_command_pool,
-        .level = VK_COMMAND_BUFFER_LEVEL_PRIMARY,
-        .commandBufferCount = 1,
-    };
-
-    VkCommandBuffer p_command_buffer;
-    VK_ERROR(vkAllocateCommandBuffers(
-        device.logical, &command_buffer_allocate_info, &p_command_buffer
-    ));
-
-    const VkCommandBufferBeginInfo begin_info{
-        .sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO,
-        .pNext = nullptr,
-        .flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT,
-        .pInheritanceInfo = nullptr,
-    };
-
-    VK_ERROR(vkBeginCommandBuffer(p_command_buffer, &begin_info));
-
+auto buffer_t::record_copy_from(
+    VkCommandBuffer p_command_buffer,
+    VkBuffer p_source,
+    VkDeviceSize p_source_offset,
+    VkDeviceSize p_size,
+    VkDeviceSize p_offset
+) const -> void {
     const VkBufferCopy copy_region{
-        .srcOffset = 0,
-        .dstOffset = 0,
-        .size = size,
+        .srcOffset = p_source_offset,
+        .dstOffset = p_offset,
+        .size = p_size,
     };
 
-    vkCmdCopyBuffer(
-        p_command_buffer, p_other.buffer, this->buffer, 1, &copy_region
-    );
-
-    VK_ERROR(vkEndCommandBuffer(p_command_buffer));
+    vkCmdCopyBuffer(p_command_buffer, p_source, this->buffer, 1, &copy_region);
+}
 
-    const VkSubmitInfo submit_info{
-        .sType = VK_STRUCTURE_TYPE_SUBMIT_INFO,
-        .pNext = nullptr,
-        .waitSemaphoreCount = 0,
-        .pWaitSemaphores = nullptr,
-        .pWaitDstStageMask = nullptr,
-        .commandBufferCount = 1,
-        .pCommandBuffers = &p_command_buffer,
-        .signalSemaphoreCount = 0,
-        .pSignalSemaphores = nullptr,
+auto uniform_buffer_t::create_ring(
+    const mv::vulkan_device_t &p_device,
+    memory_allocator_t &p_allocator,
+    uint32_t p_frame_count,
+    VkDeviceSize p_frame_budget
+) -> uniform_buffer_t {
+    const auto alignment =
+        p_device.properties.limits.minUniformBufferOffsetAlignment;
+
+    // Every slice has to start on an aligned offset too.
+    const auto frame_size =
+        (p_frame_budget + alignment - 1) / alignment * alignment;
+
+    return uniform_buffer_t{
+        .buffer = mv::buffer_t::create(
+            p_device,
+            p_allocator,
+            frame_size * p_frame_count,
+            mv::buffer_t::type_t::uniform
+        ),
+        .frame_size = frame_size,
+        .alignment = alignment,
+        .frame_offset = 0,
+        .head = 0,
     };
+}
 
-    VK_ERROR(
-        vkQueueSubmit(device.graphics_queue, 1, &submit_info, VK_NULL_HANDLE)
+auto uniform_buffer_t::push(const void *p_data, VkDeviceSize p_size)
+    -> uint32_t {
+    const auto offset = (head + alignment - 1) / alignment * alignment;
+    if (offset + p_size > frame_size) {
+        throw std::runtime_error("uniform ring ran out of space for the frame.");
+    }
+
+    const auto dynamic_offset = frame_offset + offset;
+    memcpy(
+        static_cast<std::byte *>(buffer.memory.mapped) + dynamic_offset,
+        p_data,
+        p_size
     );
-}
 
-auto buffer_t::load_using_staging(
-    VkCommandPool p_command_pool, const void *p_data, VkDeviceSize size
-) -> void {
-    staging_buffer_t staging_buffer = staging_buffer_t::create(device, size);
-    const auto data = staging_buffer.map_memory();
-    memcpy(data, p_data, size);
-    staging_buffer.unmap_memory();
-    copy_from(staging_buffer.buffer, p_command_pool);
-    vkQueueWaitIdle(device.graphics_queue);
+    head = offset + p_size;
+    return static_cast<uint32_t>(dynamic_offset);
 }
 } // namespace mv
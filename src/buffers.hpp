@@ -4,48 +4,70 @@
 
 #include "common.hpp"
 #include "device.hpp"
+#include "memory.hpp"
 
 namespace mv {
 struct buffer_t {
     VkBuffer buffer;
-    VkDeviceMemory memory;
+    vulkan_memory_t memory;
     VkDeviceSize size;
 
-    enum class type_t { vertex, index, staging, uniform };
+    // Readback buffers are host visible and can be copied into, for getting
+    // things back off the GPU.
+    enum class type_t { vertex, index, staging, uniform, readback };
 
     const mv::vulkan_device_t &device;
 
     buffer_t(
-        VkBuffer p_buffer, VkDeviceMemory p_memory, VkDeviceSize p_size,
+        VkBuffer p_buffer, vulkan_memory_t &&p_memory, VkDeviceSize p_size,
         const mv::vulkan_device_t &p_device
     )
-        : buffer(p_buffer), memory(p_memory), size(p_size), device(p_device) {}
+        : buffer(p_buffer), memory(std::move(p_memory)), size(p_size),
+          device(p_device) {}
 
-    static auto
-    create(const mv::vulkan_device_t &device, VkDeviceSize size, type_t type)
-        -> buffer_t;
+    static auto create(
+        const mv::vulkan_device_t &device,
+        memory_allocator_t &allocator,
+        VkDeviceSize size,
+        type_t type
+    ) -> buffer_t;
 
     NO_COPY(buffer_t);
-    YES_MOVE(buffer_t);
 
-    auto copy_from(const buffer_t &other, VkCommandPool command_buffer) const
-        -> void;
+    inline buffer_t(buffer_t &&other) noexcept
+        : buffer(other.buffer), memory(std::move(other.memory)),
+          size(other.size), device(other.device) {
+        other.buffer = VK_NULL_HANDLE;
+        other.size = 0;
+    }
 
-    auto load_using_staging(VkCommandPool command_pool, const void* data, VkDeviceSize size) -> void;
+    auto record_copy_from(
+        VkCommandBuffer command_buffer,
+        VkBuffer source,
+        VkDeviceSize source_offset,
+        VkDeviceSize size,
+        VkDeviceSize offset = 0
+    ) const -> void;
 
     ~buffer_t() {
-        vkDestroyBuffer(device.logical, buffer, nullptr);
-        vkFreeMemory(device.logical, memory, nullptr);
+        if (buffer != VK_NULL_HANDLE) {
+            vkDestroyBuffer(device.logical, buffer, nullptr);
+        }
     }
 };
 
 struct vertex_buffer_t {
     buffer_t buffer;
 
-    inline static auto create(const mv::vulkan_device_t &device, size_t size)
-        -> vertex_buffer_t {
+    inline static auto create(
+        const mv::vulkan_device_t &device,
+        memory_allocator_t &allocator,
+        size_t size
+    ) -> vertex_buffer_t {
         return vertex_buffer_t{
-            mv::buffer_t::create(device, size, mv::buffer_t::type_t::vertex),
+            mv::buffer_t::create(
+                device, allocator, size, mv::buffer_t::type_t::vertex
+            ),
         };
     }
 
@@ -58,11 +80,15 @@ struct vertex_buffer_t {
 struct index_buffer_t {
     buffer_t buffer;
 
-    inline static auto
-    create(const mv::vulkan_device_t &device, VkDeviceSize size)
-        -> index_buffer_t {
+    inline static auto create(
+        const mv::vulkan_device_t &device,
+        memory_allocator_t &allocator,
+        VkDeviceSize size
+    ) -> index_buffer_t {
         return index_buffer_t{
-            mv::buffer_t::create(device, size, mv::buffer_t::type_t::index),
+            mv::buffer_t::create(
+                device, allocator, size, mv::buffer_t::type_t::index
+            ),
         };
     }
 
@@ -77,38 +103,54 @@ struct index_buffer_t {
 struct staging_buffer_t {
     buffer_t buffer;
 
-    inline static auto
-    create(const mv::vulkan_device_t &device, VkDeviceSize size)
-        -> staging_buffer_t {
+    inline static auto create(
+        const mv::vulkan_device_t &device,
+        memory_allocator_t &allocator,
+        VkDeviceSize size
+    ) -> staging_buffer_t {
         return staging_buffer_t{
-            mv::buffer_t::create(device, size, mv::buffer_t::type_t::staging),
+            mv::buffer_t::create(
+                device, allocator, size, mv::buffer_t::type_t::staging
+            ),
         };
     }
 
-    auto map_memory() -> void * {
-        void *data;
-        vkMapMemory(
-            buffer.device.logical, buffer.memory, 0, buffer.size, 0, &data
-        );
-        return data;
-    }
-
-    auto unmap_memory() -> void {
-        vkUnmapMemory(buffer.device.logical, buffer.memory);
+    // Staging memory is persistently mapped, so this is just the pointer.
+    auto map_memory() const -> void * {
+        return buffer.memory.mapped;
     }
 };
 
 struct uniform_buffer_t {
     buffer_t buffer;
 
-    inline static auto
-    create(const mv::vulkan_device_t &device, VkDeviceSize size)
-        -> uniform_buffer_t {
+    // Only used in ring mode (see create_ring). The buffer is split into one
+    // slice per frame in flight, and push() hands out aligned chunks of the
+    // current frame's slice, to be bound with dynamic offsets.
+    VkDeviceSize frame_size{0};
+    VkDeviceSize alignment{1};
+    VkDeviceSize frame_offset{0};
+    VkDeviceSize head{0};
+
+    inline static auto create(
+        const mv::vulkan_device_t &device,
+        memory_allocator_t &allocator,
+        VkDeviceSize size
+    ) -> uniform_buffer_t {
         return uniform_buffer_t{
-            mv::buffer_t::create(device, size, mv::buffer_t::type_t::uniform),
+            mv::buffer_t::create(
+                device, allocator, size, mv::buffer_t::type_t::uniform
+            ),
         };
     }
 
+    static auto create_ring(
+        const mv::vulkan_device_t &device,
+        memory_allocator_t &allocator,
+        uint32_t frame_count,
+        VkDeviceSize frame_budget
+    ) -> uniform_buffer_t;
+
     inline static auto get_set_layout_binding(
         uint32_t binding, uint32_t descriptor_count,
         VkShaderStageFlags stage_flags
@@ -122,6 +164,19 @@ struct uniform_buffer_t {
         };
     }
 
+    inline static auto get_dynamic_set_layout_binding(
+        uint32_t binding, uint32_t descriptor_count,
+        VkShaderStageFlags stage_flags
+    ) -> VkDescriptorSetLayoutBinding {
+        return {
+            .binding = binding,
+            .descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC,
+            .descriptorCount = descriptor_count,
+            .stageFlags = stage_flags,
+            .pImmutableSamplers = nullptr,
+        };
+    }
+
     inline auto get_descriptor_buffer_info() const -> VkDescriptorBufferInfo {
         return {
             .buffer = buffer.buffer,
@@ -130,16 +185,35 @@ struct uniform_buffer_t {
         };
     }
 
+    // For dynamic descriptors, the range is the size of whatever gets pushed,
+    // and the offset comes from push() at bind time.
+    inline auto get_descriptor_buffer_info(VkDeviceSize range) const
+        -> VkDescriptorBufferInfo {
+        return {
+            .buffer = buffer.buffer,
+            .offset = 0,
+            .range = range,
+        };
+    }
+
+    // Uniform memory is persistently mapped, so this is just the pointer.
     auto map_memory() const -> void * {
-        void *data;
-        vkMapMemory(
-            buffer.device.logical, buffer.memory, 0, buffer.size, 0, &data
-        );
-        return data;
+        return buffer.memory.mapped;
     }
 
-    auto unmap_memory() const -> void {
-        vkUnmapMemory(buffer.device.logical, buffer.memory);
+    // Starts handing out chunks from the given frame's slice. The caller has to
+    // make sure that the GPU is done with whatever that slice held before.
+    inline auto begin_frame(uint32_t frame_index) -> void {
+        frame_offset = frame_index * frame_size;
+        head = 0;
+    }
+
+    // Copies the data into the current frame's slice and returns the dynamic
+    // offset to bind it with.
+    auto push(const void *data, VkDeviceSize size) -> uint32_t;
+
+    template <typename T> inline auto push(const T &value) -> uint32_t {
+        return push(&value, sizeof(T));
     }
 };
 }
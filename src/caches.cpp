@@ -0,0 +1,203 @@
+#include <filesystem>
+#include <fstream>
+
+#include "errors.hpp"
+#include "profiler.hpp"
+
+#include "caches.hpp"
+
+namespace mv {
+
+namespace {
+auto is_compatible(
+    const vulkan_device_t &device, const std::vector<char> &data
+) -> bool {
+    VkPipelineCacheHeaderVersionOne header;
+    if (data.size() < sizeof(header)) {
+        return false;
+    }
+
+    std::memcpy(&header, data.data(), sizeof(header));
+
+    return header.headerSize >= sizeof(header) &&
+           header.headerVersion == VK_PIPELINE_CACHE_HEADER_VERSION_ONE &&
+           header.vendorID == device.properties.vendorID &&
+           header.deviceID == device.properties.deviceID &&
+           std::memcmp(
+               header.pipelineCacheUUID,
+               device.properties.pipelineCacheUUID,
+               VK_UUID_SIZE
+           ) == 0;
+}
+
+auto read_file_to_vector(std::string_view file_name) -> std::vector<char> {
+    PROFILE_ZONE("read_file_to_vector");
+
+    std::ifstream file{
+        std::string{file_name}, std::ios::ate | std::ios::binary
+    };
+
+    if (!file.is_open()) {
+        throw mv::file_exception{
+            mv::file_exception::type_t::open,
+            std::string{file_name},
+        };
+    }
+
+    const auto file_size = file.tellg();
+    std::vector<char> buffer(file_size);
+    file.seekg(0);
+    file.read(buffer.data(), file_size);
+
+    return buffer;
+}
+
+// 64 bit FNV-1a, which is plenty to tell a handful of shaders apart.
+auto hash_bytes(const std::vector<char> &bytes) -> uint64_t {
+    uint64_t hash = 0xcbf29ce484222325;
+    for (const auto byte : bytes) {
+        hash ^= static_cast<uint8_t>(byte);
+        hash *= 0x100000001b3;
+    }
+
+    return hash;
+}
+} // namespace
+
+auto pipeline_cache_t::create(
+    const vulkan_device_t &device, std::string_view path
+) -> pipeline_cache_t {
+    PROFILE_ZONE("pipeline_cache_t::create");
+
+    std::vector<char> data;
+    if (!path.empty()) {
+        std::ifstream file{std::string{path}, std::ios::ate | std::ios::binary};
+        if (file.is_open()) {
+            data.resize(static_cast<size_t>(file.tellg()));
+            file.seekg(0);
+            file.read(data.data(), static_cast<std::streamsize>(data.size()));
+
+            if (!file || !is_compatible(device, data)) {
+                std::cout << "[INFO]: Ignoring the pipeline cache at " << path
+                          << ", it's from a different device or driver.\n";
+                data.clear();
+            }
+        }
+    }
+
+    const VkPipelineCacheCreateInfo create_info{
+        .sType = VK_STRUCTURE_TYPE_PIPELINE_CACHE_CREATE_INFO,
+        .pNext = nullptr,
+        .flags = 0,
+        .initialDataSize = data.size(),
+        .pInitialData = data.empty() ? nullptr : data.data(),
+    };
+
+    VkPipelineCache cache;
+    VK_ERROR(
+        vkCreatePipelineCache(device.logical, &create_info, nullptr, &cache)
+    );
+
+    return pipeline_cache_t{cache, device, path, !data.empty()};
+}
+
+auto pipeline_cache_t::save() const -> void {
+    if (path.empty()) {
+        return;
+    }
+
+    size_t size;
+    VK_ERROR(vkGetPipelineCacheData(device.logical, cache, &size, nullptr));
+
+    std::vector<char> data(size);
+    VK_ERROR(
+        vkGetPipelineCacheData(device.logical, cache, &size, data.data())
+    );
+
+    const auto temporary_path = path + ".tmp";
+
+    {
+        std::ofstream file{temporary_path, std::ios::binary | std::ios::trunc};
+        file.write(data.data(), static_cast<std::streamsize>(size));
+
+        if (!file) {
+            throw file_exception(file_exception::type_t::write, temporary_path);
+        }
+    }
+
+    // Replaces the old file in one go.
+    std::filesystem::rename(temporary_path, path);
+}
+
+auto shader_module_cache_t::create(const vulkan_device_t &device)
+    -> shader_module_cache_t {
+    return shader_module_cache_t{device};
+}
+
+auto shader_module_cache_t::get(std::string_view p_path) -> VkShaderModule {
+    PROFILE_ZONE("shader_module_cache_t::get");
+
+    std::promise<VkShaderModule> promise;
+    std::shared_future<VkShaderModule> future;
+
+    {
+        std::lock_guard lock{mutex};
+
+        const auto [path, inserted] = paths.try_emplace(std::string{p_path});
+        if (inserted) {
+            path->second = promise.get_future().share();
+        } else {
+            hits += 1;
+            future = path->second;
+        }
+    }
+
+    // Somebody else has read it already, or is reading it right now.
+    if (future.valid()) {
+        return future.get();
+    }
+
+    try {
+        const auto code = read_file_to_vector(p_path);
+        const auto hash = hash_bytes(code);
+
+        std::lock_guard lock{mutex};
+        files_read += 1;
+
+        auto module = modules.find(hash);
+        if (module != modules.end()) {
+            hits += 1;
+        } else {
+            const VkShaderModuleCreateInfo create_info{
+                .sType = VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO,
+                .pNext = nullptr,
+                .flags = 0,
+                .codeSize = code.size(),
+                .pCode = reinterpret_cast<const uint32_t *>(code.data()),
+            };
+
+            VkShaderModule shader_module;
+            VK_ERROR(vkCreateShaderModule(
+                device.logical, &create_info, nullptr, &shader_module
+            ));
+
+            misses += 1;
+            module = modules.emplace(hash, shader_module).first;
+        }
+
+        promise.set_value(module->second);
+        return module->second;
+    } catch (...) {
+        // Anyone waiting on this path gets the same error.
+        promise.set_exception(std::current_exception());
+        throw;
+    }
+}
+
+shader_module_cache_t::~shader_module_cache_t() {
+    for (const auto &[hash, module] : modules) {
+        vkDestroyShaderModule(device.logical, module, nullptr);
+    }
+}
+
+} // namespace mv
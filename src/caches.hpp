@@ -0,0 +1,87 @@
+#pragma once
+
+#include <future>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+
+#include <vulkan/vulkan.h>
+
+#include "common.hpp"
+#include "device.hpp"
+
+namespace mv {
+
+// A VkPipelineCache that persists between runs. The file is only used if its
+// header says it came from the same driver on the same device, and is thrown
+// away otherwise, since drivers are free to reject or even misbehave on data
+// from somewhere else.
+struct pipeline_cache_t {
+    VkPipelineCache cache;
+    const vulkan_device_t &device;
+
+    // Empty for a cache that only lives in memory.
+    std::string path;
+
+    // Whether anything usable was loaded from the file.
+    bool loaded;
+
+    pipeline_cache_t(
+        VkPipelineCache p_cache,
+        const vulkan_device_t &p_device,
+        std::string_view p_path,
+        bool p_loaded
+    )
+        : cache(p_cache), device(p_device), path(p_path), loaded(p_loaded) {}
+
+    // Starts off empty if there is no file at `path`, or it doesn't fit.
+    static auto
+    create(const vulkan_device_t &device, std::string_view path = {})
+        -> pipeline_cache_t;
+
+    NO_COPY(pipeline_cache_t);
+
+    // Writes the cache to a temporary file next to `path` and renames it into
+    // place, so a crash halfway through never leaves a broken cache behind.
+    auto save() const -> void;
+
+    ~pipeline_cache_t() {
+        vkDestroyPipelineCache(device.logical, cache, nullptr);
+    }
+};
+
+// Shader modules shared between pipelines, so that permutations using the
+// same shader don't each read the file and create a module of their own. Each
+// path is only ever read once, and modules are keyed by a hash of the SPIR-V,
+// so identical binaries under different names end up as one module.
+//
+// It's safe to use from several threads at once. Whoever asks for a path
+// first reads it, and everyone else asking for it meanwhile waits for them.
+struct shader_module_cache_t {
+    const vulkan_device_t &device;
+
+    std::mutex mutex;
+    std::unordered_map<std::string, std::shared_future<VkShaderModule>> paths;
+    std::unordered_map<uint64_t, VkShaderModule> modules;
+
+    // Hits are requests that got a module that was already there, whether
+    // through the path or the hash. Misses are modules that had to be created.
+    uint32_t hits{0};
+    uint32_t misses{0};
+    uint32_t files_read{0};
+
+    explicit shader_module_cache_t(const vulkan_device_t &p_device)
+        : device(p_device) {}
+
+    static auto create(const vulkan_device_t &device) -> shader_module_cache_t;
+
+    NO_COPY(shader_module_cache_t);
+
+    // The module stays alive for as long as the cache does.
+    auto get(std::string_view path) -> VkShaderModule;
+
+    ~shader_module_cache_t();
+};
+
+} // namespace mv
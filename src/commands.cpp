@@ -15,12 +15,13 @@ auto command_pool_t::create(const vulkan_device_t &p_device) -> command_pool_t {
     return command_pool_t(pool, p_device);
 }
 
-auto command_pool_t::allocate_buffer() const -> VkCommandBuffer {
+auto command_pool_t::allocate_buffer(VkCommandBufferLevel level) const
+    -> VkCommandBuffer {
     VkCommandBufferAllocateInfo alloc_info{
         .sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO,
         .pNext = nullptr,
         .commandPool = pool,
-        .level = VK_COMMAND_BUFFER_LEVEL_PRIMARY,
+        .level = level,
         .commandBufferCount = 1,
     };
 
@@ -28,4 +29,96 @@ auto command_pool_t::allocate_buffer() const -> VkCommandBuffer {
     VK_ERROR(vkAllocateCommandBuffers(device.logical, &alloc_info, &buffer));
     return buffer;
 }
+
+auto command_pool_t::reset() const -> void {
+    VK_ERROR(vkResetCommandPool(device.logical, pool, 0));
+}
+
+auto immediate_context_t::create(const vulkan_device_t &device)
+    -> immediate_context_t {
+    const VkCommandPoolCreateInfo pool_info{
+        .sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO,
+        .pNext = nullptr,
+        .flags = VK_COMMAND_POOL_CREATE_TRANSIENT_BIT,
+        .queueFamilyIndex = device.graphics_family,
+    };
+
+    VkCommandPool pool;
+    VK_ERROR(vkCreateCommandPool(device.logical, &pool_info, nullptr, &pool));
+
+    // Resetting the pool resets this too, so it can be reused for every flush.
+    const VkCommandBufferAllocateInfo alloc_info{
+        .sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO,
+        .pNext = nullptr,
+        .commandPool = pool,
+        .level = VK_COMMAND_BUFFER_LEVEL_PRIMARY,
+        .commandBufferCount = 1,
+    };
+
+    VkCommandBuffer command_buffer;
+    VK_ERROR(
+        vkAllocateCommandBuffers(device.logical, &alloc_info, &command_buffer)
+    );
+
+    const VkFenceCreateInfo fence_info{
+        .sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO,
+        .pNext = nullptr,
+        .flags = 0,
+    };
+
+    VkFence fence;
+    VK_ERROR(vkCreateFence(device.logical, &fence_info, nullptr, &fence));
+
+    return immediate_context_t{device, pool, command_buffer, fence};
+}
+
+auto immediate_context_t::get_command_buffer() -> VkCommandBuffer {
+    if (!recording) {
+        const VkCommandBufferBeginInfo begin_info{
+            .sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO,
+            .pNext = nullptr,
+            .flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT,
+            .pInheritanceInfo = nullptr,
+        };
+
+        VK_ERROR(vkBeginCommandBuffer(command_buffer, &begin_info));
+        recording = true;
+    }
+
+    return command_buffer;
+}
+
+auto immediate_context_t::flush() -> void {
+    if (!recording) {
+        return;
+    }
+
+    VK_ERROR(vkEndCommandBuffer(command_buffer));
+    recording = false;
+
+    const VkSubmitInfo submit_info{
+        .sType = VK_STRUCTURE_TYPE_SUBMIT_INFO,
+        .pNext = nullptr,
+        .waitSemaphoreCount = 0,
+        .pWaitSemaphores = nullptr,
+        .pWaitDstStageMask = nullptr,
+        .commandBufferCount = 1,
+        .pCommandBuffers = &command_buffer,
+        .signalSemaphoreCount = 0,
+        .pSignalSemaphores = nullptr,
+    };
+
+    VK_ERROR(vkQueueSubmit(device.graphics_queue, 1, &submit_info, fence));
+    submit_count++;
+
+    VK_ERROR(vkWaitForFences(device.logical, 1, &fence, VK_TRUE, UINT64_MAX));
+    VK_ERROR(vkResetFences(device.logical, 1, &fence));
+    VK_ERROR(vkResetCommandPool(device.logical, pool, 0));
+}
+
+immediate_context_t::~immediate_context_t() {
+    // Anything that was recorded but never flushed just gets dropped.
+    vkDestroyFence(device.logical, fence, nullptr);
+    vkDestroyCommandPool(device.logical, pool, nullptr);
+}
 } // namespace mv
@@ -16,12 +16,59 @@ struct command_pool_t {
     static auto create(const vulkan_device_t &p_device) -> command_pool_t;
 
     NO_COPY(command_pool_t);
-    YES_MOVE(command_pool_t);
 
-    auto allocate_buffer() const -> VkCommandBuffer; 
+    inline command_pool_t(command_pool_t &&other) noexcept
+        : pool(other.pool), device(other.device) {
+        other.pool = VK_NULL_HANDLE;
+    }
+
+    auto allocate_buffer(
+        VkCommandBufferLevel level = VK_COMMAND_BUFFER_LEVEL_PRIMARY
+    ) const -> VkCommandBuffer;
+
+    // Puts every command buffer allocated from the pool back into the initial
+    // state in one go.
+    auto reset() const -> void;
 
     ~command_pool_t() {
         vkDestroyCommandPool(device.logical, pool, nullptr);
     }
 };
+
+// For setup work that has to be done before anything else can run. Everything
+// recorded between two flush() calls goes into one command buffer from a
+// transient pool, gets submitted once, and the pool is reset afterwards, so
+// nothing piles up over time.
+struct immediate_context_t {
+    const vulkan_device_t &device;
+
+    VkCommandPool pool;
+    VkCommandBuffer command_buffer;
+    VkFence fence;
+
+    bool recording{false};
+    uint32_t submit_count{0};
+
+    immediate_context_t(
+        const vulkan_device_t &p_device,
+        VkCommandPool p_pool,
+        VkCommandBuffer p_command_buffer,
+        VkFence p_fence
+    )
+        : device(p_device), pool(p_pool), command_buffer(p_command_buffer),
+          fence(p_fence) {}
+
+    static auto create(const vulkan_device_t &device) -> immediate_context_t;
+
+    NO_COPY(immediate_context_t);
+
+    // Starts recording if it hasn't yet.
+    auto get_command_buffer() -> VkCommandBuffer;
+
+    // Submits whatever has been recorded and waits for it. Does nothing if
+    // nothing was recorded.
+    auto flush() -> void;
+
+    ~immediate_context_t();
+};
 } // namespace mv
@@ -0,0 +1,26 @@
+#pragma once
+
+#include <cstdint>
+
+namespace mv {
+
+// What got recorded into a frame's command buffers, counted on the CPU as it
+// is recorded. Recording threads each keep their own and add them up after.
+struct command_counters_t {
+    uint64_t draws{0};
+    uint64_t pipeline_binds{0};
+    uint64_t descriptor_set_binds{0};
+    uint64_t barriers{0};
+
+    inline auto operator+=(const command_counters_t &other)
+        -> command_counters_t & {
+        draws += other.draws;
+        pipeline_binds += other.pipeline_binds;
+        descriptor_set_binds += other.descriptor_set_binds;
+        barriers += other.barriers;
+
+        return *this;
+    }
+};
+
+} // namespace mv
@@ -0,0 +1,44 @@
+#include "deletion.hpp"
+
+namespace mv {
+
+auto deletion_queue_t::push(uint64_t value, std::function<void()> destroy)
+    -> void {
+    std::lock_guard lock{mutex};
+    entries.push_back({.value = value, .destroy = std::move(destroy)});
+}
+
+auto deletion_queue_t::collect(uint64_t completed_value) -> size_t {
+    // Taken out of the queue first, so that a destructor retiring something
+    // else doesn't deadlock.
+    std::deque<entry_t> completed;
+
+    {
+        std::lock_guard lock{mutex};
+        while (!entries.empty() && entries.front().value <= completed_value) {
+            completed.push_back(std::move(entries.front()));
+            entries.pop_front();
+        }
+    }
+
+    for (auto &entry : completed) {
+        entry.destroy();
+    }
+
+    return completed.size();
+}
+
+auto deletion_queue_t::flush() -> void {
+    std::deque<entry_t> all;
+
+    {
+        std::lock_guard lock{mutex};
+        all.swap(entries);
+    }
+
+    for (auto &entry : all) {
+        entry.destroy();
+    }
+}
+
+} // namespace mv
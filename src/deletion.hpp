@@ -0,0 +1,60 @@
+#pragma once
+
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <type_traits>
+
+#include "common.hpp"
+
+namespace mv {
+
+// Holds on to things the GPU may still be using until a timeline has passed the
+// value they were tagged with, and only then destroys them. Values have to be
+// pushed in increasing order, so use one queue per timeline.
+struct deletion_queue_t {
+    struct entry_t {
+        uint64_t value;
+        std::function<void()> destroy;
+    };
+
+    std::deque<entry_t> entries;
+
+    // Streaming can retire things from other threads.
+    mutable std::mutex mutex;
+
+    deletion_queue_t() = default;
+
+    NO_COPY(deletion_queue_t);
+
+    auto push(uint64_t value, std::function<void()> destroy) -> void;
+
+    // Takes ownership of any of the RAII wrappers, which then get destroyed
+    // like everything else.
+    template <typename T> auto retire(uint64_t value, T &&object) -> void {
+        static_assert(!std::is_lvalue_reference_v<T>, "Move it in.");
+
+        // std::function has to be copyable, and the wrappers aren't.
+        auto retired = std::make_shared<T>(std::move(object));
+        push(value, [retired]() mutable { retired.reset(); });
+    }
+
+    // Destroys everything tagged with `completed_value` or less, and returns
+    // how many things that was.
+    auto collect(uint64_t completed_value) -> size_t;
+
+    // Destroys everything. Only safe once the device is idle.
+    auto flush() -> void;
+
+    inline auto size() const -> size_t {
+        std::lock_guard lock{mutex};
+        return entries.size();
+    }
+
+    inline ~deletion_queue_t() {
+        flush();
+    }
+};
+
+} // namespace mv
@@ -0,0 +1,318 @@
+#include <algorithm>
+#include <cmath>
+
+#include "errors.hpp"
+#include "profiler.hpp"
+
+#include "descriptors.hpp"
+
+namespace mv {
+
+namespace {
+auto is_image_descriptor(VkDescriptorType type) -> bool {
+    switch (type) {
+    case VK_DESCRIPTOR_TYPE_SAMPLER:
+    case VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER:
+    case VK_DESCRIPTOR_TYPE_SAMPLED_IMAGE:
+    case VK_DESCRIPTOR_TYPE_STORAGE_IMAGE:
+    case VK_DESCRIPTOR_TYPE_INPUT_ATTACHMENT:
+        return true;
+    default:
+        return false;
+    }
+}
+
+// Only the fields that matter for the type, since the rest of the union is
+// whatever was left there.
+auto get_descriptor_fields(VkDescriptorType type, const descriptor_data_t &data)
+    -> std::array<uint64_t, 3> {
+    if (is_image_descriptor(type)) {
+        return {
+            get_handle_value(data.image.sampler),
+            get_handle_value(data.image.imageView),
+            static_cast<uint64_t>(data.image.imageLayout),
+        };
+    }
+
+    switch (type) {
+    case VK_DESCRIPTOR_TYPE_UNIFORM_TEXEL_BUFFER:
+    case VK_DESCRIPTOR_TYPE_STORAGE_TEXEL_BUFFER:
+        return {get_handle_value(data.texel_buffer_view), 0, 0};
+    default:
+        return {
+            get_handle_value(data.buffer.buffer),
+            data.buffer.offset,
+            data.buffer.range,
+        };
+    }
+}
+
+auto hash_descriptors(
+    const descriptor_set_layout_t &layout,
+    std::span<const descriptor_data_t> data
+) -> uint64_t {
+    // FNV-1a, a word at a time.
+    uint64_t hash = 0xcbf29ce484222325;
+    const auto add = [&](uint64_t value) {
+        hash ^= value;
+        hash *= 0x100000001b3;
+    };
+
+    add(get_handle_value(layout.layout));
+    for (size_t i = 0; i < data.size(); i++) {
+        for (const auto field :
+             get_descriptor_fields(layout.descriptor_types[i], data[i])) {
+            add(field);
+        }
+    }
+
+    return hash;
+}
+
+auto same_descriptors(
+    const descriptor_set_layout_t &layout,
+    std::span<const descriptor_data_t> a,
+    std::span<const descriptor_data_t> b
+) -> bool {
+    for (size_t i = 0; i < a.size(); i++) {
+        const auto type = layout.descriptor_types[i];
+        if (get_descriptor_fields(type, a[i]) !=
+            get_descriptor_fields(type, b[i])) {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+// The handles among a descriptor's fields, which always come first.
+auto get_descriptor_handles(
+    const descriptor_set_layout_t &layout,
+    std::span<const descriptor_data_t> data
+) -> std::vector<uint64_t> {
+    std::vector<uint64_t> handles;
+    for (size_t i = 0; i < data.size(); i++) {
+        const auto type = layout.descriptor_types[i];
+        const auto fields = get_descriptor_fields(type, data[i]);
+        const size_t count = is_image_descriptor(type) ? 2 : 1;
+
+        for (size_t j = 0; j < count; j++) {
+            if (fields[j] != 0) {
+                handles.push_back(fields[j]);
+            }
+        }
+    }
+
+    return handles;
+}
+} // namespace
+
+auto descriptor_allocator_t::create(
+    const vulkan_device_t &p_device,
+    VkDescriptorPoolCreateFlags p_flags,
+    std::span<const pool_ratio_t> p_ratios,
+    uint32_t p_sets_per_pool
+) -> descriptor_allocator_t {
+    return descriptor_allocator_t{
+        p_device, p_flags, p_ratios, p_sets_per_pool
+    };
+}
+
+auto descriptor_allocator_t::allocate(VkDescriptorSetLayout p_layout)
+    -> VkDescriptorSet {
+    if (ready_pools.empty()) {
+        ready_pools.push_back(create_pool());
+    }
+
+    VkDescriptorSetAllocateInfo allocate_info{
+        .sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO,
+        .pNext = nullptr,
+        .descriptorPool = ready_pools.back(),
+        .descriptorSetCount = 1,
+        .pSetLayouts = &p_layout,
+    };
+
+    VkDescriptorSet set;
+    auto result =
+        vkAllocateDescriptorSets(device.logical, &allocate_info, &set);
+
+    // Either way the pool is no use for now, so it's on to the next one.
+    // That one has never had anything allocated from it since it was last
+    // reset, so if the set doesn't fit there, it doesn't fit anywhere.
+    while (result == VK_ERROR_OUT_OF_POOL_MEMORY ||
+           result == VK_ERROR_FRAGMENTED_POOL) {
+        full_pools.push_back(ready_pools.back());
+        ready_pools.pop_back();
+
+        const auto fresh = ready_pools.empty();
+        if (fresh) {
+            ready_pools.push_back(create_pool());
+        }
+
+        allocate_info.descriptorPool = ready_pools.back();
+        result = vkAllocateDescriptorSets(device.logical, &allocate_info, &set);
+
+        if (fresh) {
+            break;
+        }
+    }
+
+    if (result != VK_SUCCESS) {
+        std::cerr << "[ERROR]: A descriptor set didn't fit in a new pool.\n";
+        throw vulkan_exception{result};
+    }
+
+    if (flags & VK_DESCRIPTOR_POOL_CREATE_FREE_DESCRIPTOR_SET_BIT) {
+        owners[set] = allocate_info.descriptorPool;
+    }
+
+    allocation_count++;
+    return set;
+}
+
+auto descriptor_allocator_t::free(VkDescriptorSet p_set) -> void {
+    const auto owner = owners.find(p_set);
+    if (owner == owners.end()) {
+        return;
+    }
+
+    const auto pool = owner->second;
+    owners.erase(owner);
+    VK_ERROR(vkFreeDescriptorSets(device.logical, pool, 1, &p_set));
+
+    // It has room again. Put it in front, so that the pool being used stays
+    // the same.
+    const auto full = std::find(full_pools.begin(), full_pools.end(), pool);
+    if (full != full_pools.end()) {
+        full_pools.erase(full);
+        ready_pools.insert(ready_pools.begin(), pool);
+    }
+}
+
+auto descriptor_allocator_t::reset() -> void {
+    PROFILE_ZONE("descriptor_allocator_t::reset");
+
+    owners.clear();
+
+    for (const auto pool : ready_pools) {
+        VK_ERROR(vkResetDescriptorPool(device.logical, pool, 0));
+    }
+
+    for (const auto pool : full_pools) {
+        VK_ERROR(vkResetDescriptorPool(device.logical, pool, 0));
+        ready_pools.push_back(pool);
+    }
+
+    full_pools.clear();
+}
+
+auto descriptor_allocator_t::create_pool() -> VkDescriptorPool {
+    std::vector<VkDescriptorPoolSize> pool_sizes;
+    pool_sizes.reserve(ratios.size());
+    for (const auto &ratio : ratios) {
+        pool_sizes.push_back(VkDescriptorPoolSize{
+            .type = ratio.type,
+            .descriptorCount = static_cast<uint32_t>(
+                std::ceil(ratio.ratio * static_cast<float>(sets_per_pool))
+            ),
+        });
+    }
+
+    const VkDescriptorPoolCreateInfo pool_info{
+        .sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO,
+        .pNext = nullptr,
+        .flags = flags,
+        .maxSets = sets_per_pool,
+        .poolSizeCount = static_cast<uint32_t>(pool_sizes.size()),
+        .pPoolSizes = pool_sizes.data(),
+    };
+
+    VkDescriptorPool pool;
+    VK_ERROR(vkCreateDescriptorPool(device.logical, &pool_info, nullptr, &pool)
+    );
+
+    sets_per_pool = std::min(sets_per_pool * 2, MAX_SETS_PER_POOL);
+    return pool;
+}
+
+descriptor_allocator_t::~descriptor_allocator_t() {
+    for (const auto pool : ready_pools) {
+        vkDestroyDescriptorPool(device.logical, pool, nullptr);
+    }
+
+    for (const auto pool : full_pools) {
+        vkDestroyDescriptorPool(device.logical, pool, nullptr);
+    }
+}
+
+auto descriptor_set_cache_t::create(descriptor_allocator_t &p_allocator)
+    -> descriptor_set_cache_t {
+    return descriptor_set_cache_t{p_allocator};
+}
+
+auto descriptor_set_cache_t::get(
+    const descriptor_set_layout_t &p_layout,
+    std::span<const descriptor_data_t> p_data
+) -> VkDescriptorSet {
+    if (p_data.size() != p_layout.descriptor_types.size()) {
+        throw std::runtime_error("wrong number of descriptors for the set.");
+    }
+
+    const auto hash = hash_descriptors(p_layout, p_data);
+
+    const auto [first, last] = sets.equal_range(hash);
+    for (auto entry = first; entry != last; ++entry) {
+        if (entry->second.layout == p_layout.layout &&
+            same_descriptors(p_layout, entry->second.data, p_data)) {
+            hits++;
+            return entry->second.set;
+        }
+    }
+
+    PROFILE_ZONE("descriptor_set_cache_t::get (miss)");
+    misses++;
+
+    const auto set = allocator.allocate(p_layout);
+    p_layout.update(set, p_data);
+
+    sets.emplace(
+        hash,
+        entry_t{
+            .layout = p_layout.layout,
+            .data = {p_data.begin(), p_data.end()},
+            .set = set,
+            .handles = get_descriptor_handles(p_layout, p_data),
+        }
+    );
+
+    return set;
+}
+
+auto descriptor_set_cache_t::invalidate_handle(
+    uint64_t p_handle, deletion_queue_t &p_queue, uint64_t p_value
+) -> size_t {
+    if (p_handle == 0) {
+        return 0;
+    }
+
+    size_t count = 0;
+    for (auto entry = sets.begin(); entry != sets.end();) {
+        const auto &handles = entry->second.handles;
+        if (std::find(handles.begin(), handles.end(), p_handle) ==
+            handles.end()) {
+            ++entry;
+            continue;
+        }
+
+        p_queue.push(p_value, [this, set = entry->second.set]() {
+            allocator.free(set);
+        });
+
+        entry = sets.erase(entry);
+        count++;
+    }
+
+    return count;
+}
+
+} // namespace mv
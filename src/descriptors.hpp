@@ -0,0 +1,176 @@
+#pragma once
+
+#include <array>
+#include <cstdint>
+#include <span>
+#include <type_traits>
+#include <unordered_map>
+#include <vector>
+
+#include <vulkan/vulkan.h>
+
+#include "common.hpp"
+#include "deletion.hpp"
+#include "device.hpp"
+#include "graphics.hpp"
+
+namespace mv {
+
+// Non-dispatchable handles are pointers on 64 bit platforms and integers
+// everywhere else.
+template <typename T> auto get_handle_value(T handle) -> uint64_t {
+    if constexpr (std::is_pointer_v<T>) {
+        return static_cast<uint64_t>(reinterpret_cast<uintptr_t>(handle));
+    } else {
+        return static_cast<uint64_t>(handle);
+    }
+}
+
+// Hands out descriptor sets from a chain of pools instead of a single one
+// with hand-counted sizes. When a pool runs out of room, or is too
+// fragmented to fit another set, the next one gets used, and once there
+// isn't a next one a new pool is made, twice as big as the last.
+//
+// Sets are usually never freed one at a time. reset() hands all of them back
+// at once with vkResetDescriptorPool, so that for the driver, allocating is
+// not much more than bumping a pointer. Allocators for sets that live longer
+// than that can make their pools with FREE_DESCRIPTOR_SET_BIT instead, so
+// that free() can give single sets back.
+struct descriptor_allocator_t {
+    // How many descriptors of a type each pool has room for, per set.
+    struct pool_ratio_t {
+        VkDescriptorType type;
+        float ratio;
+    };
+
+    static constexpr uint32_t DEFAULT_SETS_PER_POOL = 16;
+    static constexpr uint32_t MAX_SETS_PER_POOL = 4096;
+
+    static constexpr std::array DEFAULT_RATIOS{
+        pool_ratio_t{VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, 1.0f},
+        pool_ratio_t{VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC, 1.0f},
+        pool_ratio_t{VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 2.0f},
+        pool_ratio_t{VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 1.0f},
+    };
+
+    const vulkan_device_t &device;
+    VkDescriptorPoolCreateFlags flags;
+    std::vector<pool_ratio_t> ratios;
+
+    // How many sets the next new pool will have room for.
+    uint32_t sets_per_pool;
+
+    // Pools that might still have room, with the one being used at the back,
+    // and pools that have run out.
+    std::vector<VkDescriptorPool> ready_pools;
+    std::vector<VkDescriptorPool> full_pools;
+
+    // Which pool each set came from, so that free() knows where to give it
+    // back. Only kept when the pools can free sets.
+    std::unordered_map<VkDescriptorSet, VkDescriptorPool> owners;
+
+    uint64_t allocation_count{0};
+
+    descriptor_allocator_t(
+        const vulkan_device_t &p_device,
+        VkDescriptorPoolCreateFlags p_flags,
+        std::span<const pool_ratio_t> p_ratios,
+        uint32_t p_sets_per_pool
+    )
+        : device(p_device), flags(p_flags),
+          ratios(p_ratios.begin(), p_ratios.end()),
+          sets_per_pool(p_sets_per_pool) {}
+
+    static auto create(
+        const vulkan_device_t &device,
+        VkDescriptorPoolCreateFlags flags = 0,
+        std::span<const pool_ratio_t> ratios = DEFAULT_RATIOS,
+        uint32_t sets_per_pool = DEFAULT_SETS_PER_POOL
+    ) -> descriptor_allocator_t;
+
+    NO_COPY(descriptor_allocator_t);
+
+    // Only throws if the set doesn't fit in an empty pool either.
+    auto allocate(VkDescriptorSetLayout layout) -> VkDescriptorSet;
+
+    inline auto allocate(const descriptor_set_layout_t &layout)
+        -> VkDescriptorSet {
+        return allocate(layout.layout);
+    }
+
+    // Gives the set back to its pool. Does nothing unless the pools were made
+    // with FREE_DESCRIPTOR_SET_BIT, or if the allocator has been reset since
+    // the set was allocated. The set can't be in use anymore.
+    auto free(VkDescriptorSet set) -> void;
+
+    // Frees every set from every pool. None of them can be in use anymore.
+    auto reset() -> void;
+
+    inline auto get_pool_count() const -> uint32_t {
+        return static_cast<uint32_t>(ready_pools.size() + full_pools.size());
+    }
+
+    ~descriptor_allocator_t();
+
+  private:
+    auto create_pool() -> VkDescriptorPool;
+};
+
+// Hands out sets with the given resources written to them, and the same set
+// again whenever the same layout comes with the same resources, so binding
+// those again is only a hash lookup. Sets that aren't there yet are written
+// with the layout's update template, in one call.
+//
+// Anything a set points to has to be invalidated when it's destroyed.
+// Otherwise, something created later with the same handle would get the old
+// set, which might not point to what it should anymore. The sets that get
+// dropped then are only freed if the allocator's pools can free sets.
+struct descriptor_set_cache_t {
+    struct entry_t {
+        VkDescriptorSetLayout layout;
+        std::vector<descriptor_data_t> data;
+        VkDescriptorSet set;
+
+        // The samplers, image views, buffers and buffer views in `data`.
+        std::vector<uint64_t> handles;
+    };
+
+    descriptor_allocator_t &allocator;
+
+    // Keyed by a hash of the layout and the resources. Different ones can
+    // end up with the same hash, so the entries still get compared.
+    std::unordered_multimap<uint64_t, entry_t> sets;
+
+    uint64_t hits{0};
+    uint64_t misses{0};
+
+    explicit descriptor_set_cache_t(descriptor_allocator_t &p_allocator)
+        : allocator(p_allocator) {}
+
+    static auto create(descriptor_allocator_t &allocator)
+        -> descriptor_set_cache_t;
+
+    NO_COPY(descriptor_set_cache_t);
+
+    auto get(
+        const descriptor_set_layout_t &layout,
+        std::span<const descriptor_data_t> data
+    ) -> VkDescriptorSet;
+
+    // Forgets every set that points to the sampler, image view, buffer or
+    // buffer view, and returns how many that was. Frames in flight may still
+    // be using those sets, so they are freed through the deletion queue, once
+    // the timeline has passed `value`. The cache has to outlive the queue.
+    template <typename T>
+    auto invalidate(T handle, deletion_queue_t &queue, uint64_t value)
+        -> size_t {
+        return invalidate_handle(get_handle_value(handle), queue, value);
+    }
+
+  private:
+    auto invalidate_handle(
+        uint64_t handle, deletion_queue_t &queue, uint64_t value
+    ) -> size_t;
+};
+
+} // namespace mv
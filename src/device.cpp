@@ -1,4 +1,5 @@
 #include <cstring>
+#include <set>
 
 #include <GLFW/glfw3.h>
 #include <vulkan/vulkan_core.h>
@@ -74,7 +75,8 @@ const VkDebugUtilsMessengerCreateInfoEXT MESSENGER_CREATE_INFO{
 };
 } // namespace
 
-auto vulkan_instance_t::create(bool p_enable_validation) -> vulkan_instance_t {
+auto vulkan_instance_t::create(bool p_enable_validation, bool p_headless)
+    -> vulkan_instance_t {
     if (p_enable_validation) {
         uint32_t layer_count;
         vkEnumerateInstanceLayerProperties(&layer_count, nullptr);
@@ -106,13 +108,17 @@ auto vulkan_instance_t::create(bool p_enable_validation) -> vulkan_instance_t {
         .apiVersion = VK_API_VERSION_1_2,
     };
 
-    uint32_t glfw_extension_count = 0;
-    const auto glfw_extensions =
-        glfwGetRequiredInstanceExtensions(&glfw_extension_count);
+    std::vector<const char *> enabled_extensions;
 
-    std::vector enabled_extensions(
-        glfw_extensions, glfw_extensions + glfw_extension_count
-    );
+    if (!p_headless) {
+        uint32_t glfw_extension_count = 0;
+        const auto glfw_extensions =
+            glfwGetRequiredInstanceExtensions(&glfw_extension_count);
+
+        enabled_extensions.assign(
+            glfw_extensions, glfw_extensions + glfw_extension_count
+        );
+    }
 
     if (p_enable_validation) {
         enabled_extensions.push_back(VK_EXT_DEBUG_UTILS_EXTENSION_NAME);
@@ -186,6 +192,8 @@ auto vulkan_device_t::create(VkInstance p_instance, VkSurfaceKHR p_surface)
     vkEnumeratePhysicalDevices(p_instance, &device_count, devices.data());
 
     vulkan_device_t device{};
+    bool enable_synchronization2 = false;
+    const auto headless = p_surface == VK_NULL_HANDLE;
 
     for (const auto &physical_device : devices) {
         uint32_t queue_family_count;
@@ -199,6 +207,7 @@ auto vulkan_device_t::create(VkInstance p_instance, VkSurfaceKHR p_surface)
         );
 
         std::optional<uint32_t> graphics_family, present_family;
+        std::optional<uint32_t> transfer_family, compute_family;
 
         for (auto [i, queue_family] :
              enumerate(queue_families.begin(), queue_families.end())) {
@@ -206,6 +215,25 @@ auto vulkan_device_t::create(VkInstance p_instance, VkSurfaceKHR p_surface)
                 graphics_family = i;
             }
 
+            // Compute families can always do transfers as well, even when they
+            // don't say so.
+            const auto flags = queue_family.queueFlags;
+            const auto is_graphics = (flags & VK_QUEUE_GRAPHICS_BIT) != 0;
+            const auto is_compute = (flags & VK_QUEUE_COMPUTE_BIT) != 0;
+            const auto is_transfer = (flags & VK_QUEUE_TRANSFER_BIT) != 0;
+
+            if (is_transfer && !is_graphics && !is_compute &&
+                !transfer_family.has_value()) {
+                transfer_family = i;
+            } else if (is_compute && !is_graphics &&
+                       !compute_family.has_value()) {
+                compute_family = i;
+            }
+
+            if (headless) {
+                continue;
+            }
+
             VkBool32 present_support = VK_FALSE;
             vkGetPhysicalDeviceSurfaceSupportKHR(
                 physical_device, i, p_surface, &present_support
@@ -216,6 +244,10 @@ auto vulkan_device_t::create(VkInstance p_instance, VkSurfaceKHR p_surface)
             }
         }
 
+        if (headless) {
+            present_family = graphics_family;
+        }
+
         uint32_t extension_count;
         vkEnumerateDeviceExtensionProperties(
             physical_device, nullptr, &extension_count, nullptr
@@ -227,31 +259,52 @@ auto vulkan_device_t::create(VkInstance p_instance, VkSurfaceKHR p_surface)
         );
 
         bool supports_swapchain = false;
+        bool supports_synchronization2 = false;
+        bool supports_memory_budget = false;
 
         for (const auto &extension : extensions) {
             if (std::strcmp(
                     extension.extensionName, VK_KHR_SWAPCHAIN_EXTENSION_NAME
                 ) == 0) {
                 supports_swapchain = true;
+            } else if (std::strcmp(
+                           extension.extensionName,
+                           VK_KHR_SYNCHRONIZATION_2_EXTENSION_NAME
+                       ) == 0) {
+                supports_synchronization2 = true;
+            } else if (std::strcmp(
+                           extension.extensionName,
+                           VK_EXT_MEMORY_BUDGET_EXTENSION_NAME
+                       ) == 0) {
+                supports_memory_budget = true;
             }
         }
 
-        uint32_t surface_format_count;
-        vkGetPhysicalDeviceSurfaceFormatsKHR(
-            physical_device, p_surface, &surface_format_count, nullptr
-        );
+        uint32_t surface_format_count = 0;
+        uint32_t present_mode_count = 0;
+        if (!headless) {
+            vkGetPhysicalDeviceSurfaceFormatsKHR(
+                physical_device, p_surface, &surface_format_count, nullptr
+            );
+            vkGetPhysicalDeviceSurfacePresentModesKHR(
+                physical_device, p_surface, &present_mode_count, nullptr
+            );
+        }
 
-        uint32_t present_mode_count;
-        vkGetPhysicalDeviceSurfacePresentModesKHR(
-            physical_device, p_surface, &present_mode_count, nullptr
-        );
+        const auto can_present = headless || (supports_swapchain &&
+                                              surface_format_count > 0 &&
+                                              present_mode_count > 0);
 
         if (graphics_family.has_value() && present_family.has_value() &&
-            supports_swapchain && surface_format_count > 0 &&
-            present_mode_count > 0) {
+            can_present) {
             device.physical = physical_device;
             device.graphics_family = graphics_family.value();
             device.present_family = present_family.value();
+            device.transfer_family = transfer_family.value_or(
+                compute_family.value_or(graphics_family.value())
+            );
+            enable_synchronization2 = supports_synchronization2;
+            device.memory_budget = supports_memory_budget;
             break;
         }
     }
@@ -260,57 +313,138 @@ auto vulkan_device_t::create(VkInstance p_instance, VkSurfaceKHR p_surface)
         throw no_adequate_devices_exception{};
     }
 
-    VkPhysicalDeviceProperties device_properties;
-    vkGetPhysicalDeviceProperties(device.physical, &device_properties);
+    vkGetPhysicalDeviceProperties(device.physical, &device.properties);
+    vkGetPhysicalDeviceMemoryProperties(
+        device.physical, &device.memory_properties
+    );
 
-    std::cout << "[INFO]: Selected the " << device_properties.deviceName
+    std::cout << "[INFO]: Selected the " << device.properties.deviceName
               << " graphics card.\n";
 
+    if (device.transfer_family != device.graphics_family) {
+        std::cout << "[INFO]: Uploading through queue family "
+                  << device.transfer_family << ".\n";
+    }
+
     std::vector<VkDeviceQueueCreateInfo> queue_create_infos;
 
-    float queue_priority = 1.0f;
-    if (device.graphics_family != device.present_family) {
-        std::array<uint32_t, 2> queue_family_indices{
-            device.graphics_family, device.present_family
-        };
+    const std::set<uint32_t> queue_family_indices{
+        device.graphics_family, device.present_family, device.transfer_family
+    };
 
-        for (auto index : queue_family_indices) {
-            queue_create_infos.push_back({
-                .sType = VK_STRUCTURE_TYPE_DEVICE_QUEUE_CREATE_INFO,
-                .pNext = nullptr,
-                .flags = 0,
-                .queueFamilyIndex = index,
-                .queueCount = 1,
-                .pQueuePriorities = &queue_priority,
-            });
-        }
-    } else {
+    float queue_priority = 1.0f;
+    for (auto index : queue_family_indices) {
         queue_create_infos.push_back({
             .sType = VK_STRUCTURE_TYPE_DEVICE_QUEUE_CREATE_INFO,
             .pNext = nullptr,
             .flags = 0,
-            .queueFamilyIndex = device.graphics_family,
+            .queueFamilyIndex = index,
             .queueCount = 1,
             .pQueuePriorities = &queue_priority,
         });
     }
 
-    const std::array<const char *, 1> enabled_extensions{
-        VK_KHR_SWAPCHAIN_EXTENSION_NAME
+    std::vector<const char *> enabled_extensions;
+    if (!headless) {
+        enabled_extensions.push_back(VK_KHR_SWAPCHAIN_EXTENSION_NAME);
+    }
+
+    // The extension being there doesn't mean the feature is.
+    VkPhysicalDeviceSynchronization2FeaturesKHR synchronization2_features{
+        .sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_SYNCHRONIZATION_2_FEATURES_KHR,
+        .pNext = nullptr,
+        .synchronization2 = VK_FALSE,
     };
 
+    if (enable_synchronization2) {
+        VkPhysicalDeviceFeatures2 features{
+            .sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2,
+            .pNext = &synchronization2_features,
+            .features = {},
+        };
+
+        vkGetPhysicalDeviceFeatures2(device.physical, &features);
+        enable_synchronization2 =
+            synchronization2_features.synchronization2 == VK_TRUE;
+    }
+
+    if (enable_synchronization2) {
+        enabled_extensions.push_back(VK_KHR_SYNCHRONIZATION_2_EXTENSION_NAME);
+        std::cout << "[INFO]: Using synchronization2 for barriers.\n";
+    }
+
+    if (device.memory_budget) {
+        enabled_extensions.push_back(VK_EXT_MEMORY_BUDGET_EXTENSION_NAME);
+    }
+
+    // Pipeline statistics are only used for profiling, so they're turned on
+    // if they're there and skipped if they aren't. Inherited queries let them
+    // cover passes that execute secondary command buffers.
+    VkPhysicalDeviceFeatures supported_features;
+    vkGetPhysicalDeviceFeatures(device.physical, &supported_features);
+
+    device.enabled_features = {};
+    device.enabled_features.pipelineStatisticsQuery =
+        supported_features.pipelineStatisticsQuery;
+    device.enabled_features.inheritedQueries =
+        supported_features.inheritedQueries;
+
+    VkPhysicalDeviceVulkan12Features supported_vulkan12_features{};
+    supported_vulkan12_features.sType =
+        VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_2_FEATURES;
+
+    {
+        VkPhysicalDeviceFeatures2 features{
+            .sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2,
+            .pNext = &supported_vulkan12_features,
+            .features = {},
+        };
+
+        vkGetPhysicalDeviceFeatures2(device.physical, &features);
+    }
+
+    // Timeline semaphores are core in 1.2, but still have to be turned on.
+    VkPhysicalDeviceVulkan12Features vulkan12_features{};
+    vulkan12_features.sType =
+        VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_2_FEATURES;
+    vulkan12_features.pNext =
+        enable_synchronization2 ? &synchronization2_features : nullptr;
+    vulkan12_features.timelineSemaphore = VK_TRUE;
+
+    // What a bindless texture array needs: an unsized array in the shader,
+    // slots that don't all hold something, writes while the set is bound or
+    // while frames using other slots are in flight, and indexing with values
+    // that aren't the same for the whole draw.
+    device.descriptor_indexing =
+        supported_vulkan12_features.runtimeDescriptorArray &&
+        supported_vulkan12_features.descriptorBindingPartiallyBound &&
+        supported_vulkan12_features
+            .descriptorBindingSampledImageUpdateAfterBind &&
+        supported_vulkan12_features.descriptorBindingUpdateUnusedWhilePending &&
+        supported_vulkan12_features.shaderSampledImageArrayNonUniformIndexing;
+
+    if (device.descriptor_indexing) {
+        vulkan12_features.runtimeDescriptorArray = VK_TRUE;
+        vulkan12_features.descriptorBindingPartiallyBound = VK_TRUE;
+        vulkan12_features.descriptorBindingSampledImageUpdateAfterBind =
+            VK_TRUE;
+        vulkan12_features.descriptorBindingUpdateUnusedWhilePending = VK_TRUE;
+        vulkan12_features.shaderSampledImageArrayNonUniformIndexing = VK_TRUE;
+    }
+
     const VkDeviceCreateInfo device_create_info{
         .sType = VK_STRUCTURE_TYPE_DEVICE_CREATE_INFO,
-        .pNext = nullptr,
+        .pNext = &vulkan12_features,
         .flags = 0,
         .queueCreateInfoCount =
             static_cast<uint32_t>(queue_create_infos.size()),
         .pQueueCreateInfos = queue_create_infos.data(),
         .enabledLayerCount = 0,
         .ppEnabledLayerNames = nullptr,
-        .enabledExtensionCount = enabled_extensions.size(),
+        .enabledExtensionCount =
+            static_cast<uint32_t>(enabled_extensions.size()),
         .ppEnabledExtensionNames = enabled_extensions.data(),
-        .pEnabledFeatures = nullptr,
+        .pEnabledFeatures = &device.enabled_features,
     };
 
     auto result = vkCreateDevice(
@@ -327,6 +461,16 @@ auto vulkan_device_t::create(VkInstance p_instance, VkSurfaceKHR p_surface)
     vkGetDeviceQueue(
         device.logical, device.present_family, 0, &device.present_queue
     );
+    vkGetDeviceQueue(
+        device.logical, device.transfer_family, 0, &device.transfer_queue
+    );
+
+    if (enable_synchronization2) {
+        device.cmd_pipeline_barrier2 =
+            reinterpret_cast<PFN_vkCmdPipelineBarrier2KHR>(
+                vkGetDeviceProcAddr(device.logical, "vkCmdPipelineBarrier2KHR")
+            );
+    }
 
     return device;
 }
@@ -8,8 +8,10 @@ struct vulkan_instance_t {
     VkInstance instance;
     VkDebugUtilsMessengerEXT messenger;
 
+    // Headless instances don't enable any of the surface extensions.
     // May throw vulkan_exception
-    static auto create(bool p_enable_validation) -> vulkan_instance_t;
+    static auto create(bool p_enable_validation, bool p_headless = false)
+        -> vulkan_instance_t;
 
     inline operator VkInstance() const noexcept {
         return instance;
@@ -42,9 +44,35 @@ struct vulkan_device_t {
     uint32_t graphics_family;
     uint32_t present_family;
 
+    // A transfer-only family if there is one, then an async compute family,
+    // and the graphics family if neither exists.
+    uint32_t transfer_family;
+
     VkQueue graphics_queue;
     VkQueue present_queue;
+    VkQueue transfer_queue;
+
+    VkPhysicalDeviceProperties properties;
+    VkPhysicalDeviceMemoryProperties memory_properties;
+
+    // Only the optional features that something checks for get turned on,
+    // and they show up as true here if they were.
+    VkPhysicalDeviceFeatures enabled_features;
+
+    // Null unless VK_KHR_synchronization2 is supported, in which case it gets
+    // enabled.
+    PFN_vkCmdPipelineBarrier2KHR cmd_pipeline_barrier2;
+
+    // Whether VK_EXT_memory_budget is enabled, which it is whenever it's
+    // supported.
+    bool memory_budget;
+
+    // Whether the descriptor indexing features that texture_registry_t needs
+    // are enabled, which they are whenever they're all supported.
+    bool descriptor_indexing;
 
+    // Without a surface, any device that can do graphics will do, and the
+    // present queue is just the graphics queue.
     // May throw vulkan_exception
     static auto create(VkInstance p_instance, VkSurfaceKHR p_surface)
         -> vulkan_device_t;
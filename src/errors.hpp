@@ -47,6 +47,7 @@ struct file_exception : public std::exception {
     enum class type_t {
         open,
         read,
+        write,
     } type;
 
     std::string file_name;
@@ -60,6 +61,8 @@ struct file_exception : public std::exception {
             return "Failed to open file.";
         case type_t::read:
             return "Failed to read file.";
+        case type_t::write:
+            return "Failed to write file.";
         }
     }
 };
@@ -74,6 +77,8 @@ auto operator<<(
         return p_ostream << "open";
     case mv::file_exception::type_t::read:
         return p_ostream << "read";
+    case mv::file_exception::type_t::write:
+        return p_ostream << "write";
     }
 }
 
@@ -0,0 +1,90 @@
+#include <chrono>
+
+#include "errors.hpp"
+#include "profiler.hpp"
+
+#include "frames.hpp"
+
+namespace mv {
+
+auto frame_context_t::worker_t::get_secondary_command_buffer(uint32_t index)
+    -> VkCommandBuffer {
+    while (secondary_command_buffers.size() <= index) {
+        secondary_command_buffers.push_back(
+            command_pool.allocate_buffer(VK_COMMAND_BUFFER_LEVEL_SECONDARY)
+        );
+    }
+
+    return secondary_command_buffers[index];
+}
+
+auto frame_contexts_t::create(
+    const vulkan_device_t &device,
+    uint32_t frames_in_flight,
+    uint32_t worker_count
+) -> frame_contexts_t {
+    std::vector<std::unique_ptr<frame_context_t>> frames;
+
+    for (uint32_t i = 0; i < frames_in_flight; i++) {
+        auto frame = std::unique_ptr<frame_context_t>{new frame_context_t{
+            .index = i,
+            .command_pool = command_pool_t::create(device),
+            .command_buffer = VK_NULL_HANDLE,
+            .timeline_value = 0,
+            .image_available_semaphore = vulkan_semaphore_t::create(device),
+            .render_done_semaphore = vulkan_semaphore_t::create(device),
+            .descriptors = descriptor_allocator_t::create(device),
+            .workers = {},
+        }};
+
+        frame->command_buffer = frame->command_pool.allocate_buffer();
+
+        for (uint32_t j = 0; j < worker_count; j++) {
+            frame->workers.push_back({
+                .command_pool = command_pool_t::create(device),
+                .secondary_command_buffers = {},
+            });
+        }
+        frames.push_back(std::move(frame));
+    }
+
+    return frame_contexts_t{
+        .device = device,
+        .frames = std::move(frames),
+        .current = 0,
+        .timeline = vulkan_timeline_semaphore_t::create(device),
+    };
+}
+
+auto frame_contexts_t::begin_frame() -> frame_context_t & {
+    PROFILE_ZONE("frame_contexts_t::begin_frame");
+
+    auto &frame = *frames[current];
+
+    const auto start = std::chrono::steady_clock::now();
+    timeline.wait(frame.timeline_value);
+    fence_wait_time += std::chrono::duration<double>(
+                           std::chrono::steady_clock::now() - start
+    )
+                           .count();
+
+    collected_value = timeline.get_value();
+    deletion_queue.collect(collected_value);
+
+    frame.command_pool.reset();
+    for (const auto &worker : frame.workers) {
+        worker.command_pool.reset();
+    }
+
+    frame.descriptors.reset();
+
+    return frame;
+}
+
+auto frame_contexts_t::end_frame() -> void {
+    frames[current]->timeline_value = get_signal_value();
+    current = (current + 1) % size();
+    frame_count++;
+}
+
+} // namespace mv
@@ -0,0 +1,115 @@
+#pragma once
+
+#include <memory>
+
+#include <vulkan/vulkan.h>
+
+#include "commands.hpp"
+#include "common.hpp"
+#include "deletion.hpp"
+#include "descriptors.hpp"
+#include "device.hpp"
+#include "sync.hpp"
+
+namespace mv {
+
+// Everything one frame needs that can't be touched again until the GPU is done
+// with that frame. The uniform ring's slice for the frame is picked with
+// `index`.
+struct frame_context_t {
+    // What one recording thread uses for the frame. Only the thread recording
+    // with it may touch it.
+    struct worker_t {
+        command_pool_t command_pool;
+        std::vector<VkCommandBuffer> secondary_command_buffers;
+
+        // Allocates the buffer the first time it's asked for.
+        auto get_secondary_command_buffer(uint32_t index) -> VkCommandBuffer;
+    };
+
+    uint32_t index;
+
+    command_pool_t command_pool;
+    VkCommandBuffer command_buffer;
+
+    // The value on the frame timeline that the last submit using this
+    // context signals.
+    uint64_t timeline_value{0};
+
+    vulkan_semaphore_t image_available_semaphore;
+    vulkan_semaphore_t render_done_semaphore;
+
+    // For sets that only live for the frame. They all go away at once when
+    // the context comes around again.
+    descriptor_allocator_t descriptors;
+
+    std::vector<worker_t> workers;
+};
+
+// Cycles through a fixed number of frame contexts, so that the CPU can record
+// the next frame while the GPU is still working on the previous ones. Frame N's
+// submit signals N on the timeline, which is what begin_frame() waits on.
+// Anything retired through here is destroyed once the frames that might have
+// used it are done, so nothing has to idle the device to get rid of things.
+struct frame_contexts_t {
+    static constexpr uint32_t DEFAULT_FRAMES_IN_FLIGHT = 2;
+
+    const vulkan_device_t &device;
+
+    // Behind pointers so that the contexts never move.
+    std::vector<std::unique_ptr<frame_context_t>> frames;
+    uint32_t current{0};
+
+    vulkan_timeline_semaphore_t timeline;
+    uint64_t frame_count{0};
+
+    deletion_queue_t deletion_queue{};
+
+    // Everything retired with this value or less has been destroyed.
+    uint64_t collected_value{0};
+
+    // How long begin_frame() has spent blocked on the timeline, in seconds.
+    double fence_wait_time{0.0};
+
+    static auto create(
+        const vulkan_device_t &device,
+        uint32_t frames_in_flight = DEFAULT_FRAMES_IN_FLIGHT,
+        uint32_t worker_count = 0
+    ) -> frame_contexts_t;
+
+    inline auto size() const -> uint32_t {
+        return static_cast<uint32_t>(frames.size());
+    }
+
+    // Waits until the GPU is done with the last frame that used the next
+    // context and resets its command and descriptor pools. Bailing out before
+    // submitting is fine, the next call just doesn't have to wait.
+    auto begin_frame() -> frame_context_t &;
+
+    // What the current frame's submit has to signal on the timeline.
+    inline auto get_signal_value() const -> uint64_t {
+        return frame_count + 1;
+    }
+
+    // Moves on to the next context. Call once the frame has been submitted.
+    auto end_frame() -> void;
+
+    // Destroys the object once the frame being recorded (or the next one, if
+    // called between frames) is done, as nothing after that can be using it.
+    template <typename T> auto retire(T &&object) -> void {
+        deletion_queue.retire(get_signal_value(), std::forward<T>(object));
+    }
+
+    // Blocks until every frame submitted so far is done.
+    inline auto wait_for_all() const -> void {
+        timeline.wait(frame_count);
+    }
+
+    inline auto get_average_fence_wait_time() const -> double {
+        return frame_count == 0 ? 0.0
+                                : fence_wait_time /
+                                      static_cast<double>(frame_count);
+    }
+};
+
+} // namespace mv
@@ -1,17 +1,14 @@
-#include <fstream>
 #include <span>
 
 #include <vulkan/vulkan_core.h>
 
 #include "common.hpp"
 #include "errors.hpp"
+#include "profiler.hpp"
 
+#include "caches.hpp"
 #include "graphics.hpp"
 
-namespace {
-auto read_file_to_vector(std::string_view file_name) -> std::vector<char>;
-} // namespace
-
 namespace mv {
 auto graphics_pipeline_t::create(
     const mv::vulkan_device_t &p_device,
@@ -19,8 +16,14 @@ auto graphics_pipeline_t::create(
     std::string_view p_vertex_shader_path,
     std::string_view p_fragment_shader_path,
     std::span<const VkPushConstantRange> push_constant_ranges,
-    std::span<const VkDescriptorSetLayout> p_descriptor_set_layouts
+    std::span<const VkDescriptorSetLayout> p_descriptor_set_layouts,
+    VkPipelineCache p_pipeline_cache,
+    shader_module_cache_t *p_shader_modules,
+    const VkSpecializationInfo *p_vertex_specialization,
+    const VkSpecializationInfo *p_fragment_specialization
 ) -> graphics_pipeline_t {
+    PROFILE_ZONE("graphics_pipeline_t::create");
+
     const VkPipelineLayoutCreateInfo pipeline_layout_create_info{
         .sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO,
         .pNext = nullptr,
@@ -45,50 +48,16 @@ auto graphics_pipeline_t::create(
         throw mv::vulkan_exception{result};
     }
 
-    const auto vertex_shader_code = read_file_to_vector(p_vertex_shader_path);
-    const auto fragment_shader_code =
-        read_file_to_vector(p_fragment_shader_path);
-
-    const VkShaderModuleCreateInfo vertex_shader_module_create_info{
-        .sType = VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO,
-        .pNext = nullptr,
-        .flags = 0,
-        .codeSize = vertex_shader_code.size(),
-        .pCode = reinterpret_cast<const uint32_t *>(vertex_shader_code.data()),
-    };
-
-    VkShaderModule vertex_shader_module;
-    result = vkCreateShaderModule(
-        p_device.logical,
-        &vertex_shader_module_create_info,
-        nullptr,
-        &vertex_shader_module
-    );
-
-    if (result != VK_SUCCESS) {
-        throw mv::vulkan_exception{result};
+    // Without a cache to share, the modules only live as long as this call.
+    std::optional<shader_module_cache_t> local_shader_modules;
+    if (p_shader_modules == nullptr) {
+        p_shader_modules = &local_shader_modules.emplace(p_device);
     }
 
-    const VkShaderModuleCreateInfo fragment_shader_module_create_info{
-        .sType = VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO,
-        .pNext = nullptr,
-        .flags = 0,
-        .codeSize = fragment_shader_code.size(),
-        .pCode =
-            reinterpret_cast<const uint32_t *>(fragment_shader_code.data()),
-    };
-
-    VkShaderModule fragment_shader_module;
-    result = vkCreateShaderModule(
-        p_device.logical,
-        &fragment_shader_module_create_info,
-        nullptr,
-        &fragment_shader_module
-    );
-
-    if (result != VK_SUCCESS) {
-        throw mv::vulkan_exception{result};
-    }
+    const auto vertex_shader_module =
+        p_shader_modules->get(p_vertex_shader_path);
+    const auto fragment_shader_module =
+        p_shader_modules->get(p_fragment_shader_path);
 
     const std::array<VkPipelineShaderStageCreateInfo, 2> shader_stages{
         VkPipelineShaderStageCreateInfo{
@@ -98,7 +67,7 @@ auto graphics_pipeline_t::create(
             .stage = VK_SHADER_STAGE_VERTEX_BIT,
             .module = vertex_shader_module,
             .pName = "main",
-            .pSpecializationInfo = nullptr
+            .pSpecializationInfo = p_vertex_specialization
         },
         VkPipelineShaderStageCreateInfo{
             .sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO,
@@ -107,7 +76,7 @@ auto graphics_pipeline_t::create(
             .stage = VK_SHADER_STAGE_FRAGMENT_BIT,
             .module = fragment_shader_module,
             .pName = "main",
-            .pSpecializationInfo = nullptr,
+            .pSpecializationInfo = p_fragment_specialization,
         },
     };
 
@@ -243,22 +212,22 @@ auto graphics_pipeline_t::create(
     };
 
     VkPipeline pipeline;
-    result = vkCreateGraphicsPipelines(
-        p_device.logical,
-        VK_NULL_HANDLE,
-        1,
-        &pipeline_create_info,
-        nullptr,
-        &pipeline
-    );
+    {
+        PROFILE_ZONE("vkCreateGraphicsPipelines");
+        result = vkCreateGraphicsPipelines(
+            p_device.logical,
+            p_pipeline_cache,
+            1,
+            &pipeline_create_info,
+            nullptr,
+            &pipeline
+        );
+    }
 
     if (result != VK_SUCCESS) {
         throw mv::vulkan_exception{result};
     }
 
-    vkDestroyShaderModule(p_device.logical, vertex_shader_module, nullptr);
-    vkDestroyShaderModule(p_device.logical, fragment_shader_module, nullptr);
-
     return {pipeline, p_render_pass, pipeline_layout, p_device};
 }
 
@@ -267,7 +236,8 @@ auto render_pass_t::create(
     std::optional<VkFormat> color_format,
     std::optional<VkFormat> p_depth_format,
     std::span<const VkSubpassDependency> p_dependencies,
-    VkImageLayout p_final_depth_layout
+    VkImageLayout p_final_depth_layout,
+    VkImageLayout p_final_color_layout
 ) -> render_pass_t {
     uint32_t attachment_counter = 0;
 
@@ -306,7 +276,7 @@ auto render_pass_t::create(
             .stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE,
             .stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE,
             .initialLayout = VK_IMAGE_LAYOUT_UNDEFINED,
-            .finalLayout = VK_IMAGE_LAYOUT_PRESENT_SRC_KHR,
+            .finalLayout = p_final_color_layout,
         };
 
         color_attachment_reference.attachment = attachment_counter;
@@ -390,12 +360,22 @@ auto create_framebuffer(
 
 auto descriptor_set_layout_t::create(
     const vulkan_device_t &p_device,
-    std::span<const VkDescriptorSetLayoutBinding> bindings
+    std::span<const VkDescriptorSetLayoutBinding> bindings,
+    std::span<const VkDescriptorBindingFlags> p_binding_flags,
+    VkDescriptorSetLayoutCreateFlags p_flags
 ) -> descriptor_set_layout_t {
+    const VkDescriptorSetLayoutBindingFlagsCreateInfo binding_flags_info{
+        .sType =
+            VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_BINDING_FLAGS_CREATE_INFO,
+        .pNext = nullptr,
+        .bindingCount = static_cast<uint32_t>(p_binding_flags.size()),
+        .pBindingFlags = p_binding_flags.data(),
+    };
+
     const VkDescriptorSetLayoutCreateInfo layout_info{
         .sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO,
-        .pNext = nullptr,
-        .flags = 0,
+        .pNext = p_binding_flags.empty() ? nullptr : &binding_flags_info,
+        .flags = p_flags,
         .bindingCount = static_cast<uint32_t>(bindings.size()),
         .pBindings = bindings.data(),
     };
@@ -404,64 +384,72 @@ auto descriptor_set_layout_t::create(
     VK_ERROR(vkCreateDescriptorSetLayout(
         p_device.logical, &layout_info, nullptr, &layout
     ));
-    return descriptor_set_layout_t{layout, p_device};
-}
 
-auto descriptor_pool_t::create(
-    const vulkan_device_t &p_device,
-    std::span<const VkDescriptorPoolSize> pool_sizes,
-    uint32_t max_sets
-) -> descriptor_pool_t {
-    const VkDescriptorPoolCreateInfo pool_info{
-        .sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO,
+    // The descriptors are packed one after the other, so each binding's
+    // entry starts where the previous binding's descriptors end.
+    std::vector<VkDescriptorUpdateTemplateEntry> entries;
+    std::vector<VkDescriptorType> descriptor_types;
+    for (const auto &binding : bindings) {
+        if (binding.descriptorCount == 0) {
+            continue;
+        }
+
+        entries.push_back(VkDescriptorUpdateTemplateEntry{
+            .dstBinding = binding.binding,
+            .dstArrayElement = 0,
+            .descriptorCount = binding.descriptorCount,
+            .descriptorType = binding.descriptorType,
+            .offset = descriptor_types.size() * sizeof(descriptor_data_t),
+            .stride = sizeof(descriptor_data_t),
+        });
+
+        descriptor_types.insert(
+            descriptor_types.end(),
+            binding.descriptorCount,
+            binding.descriptorType
+        );
+    }
+
+    const VkDescriptorUpdateTemplateCreateInfo template_info{
+        .sType = VK_STRUCTURE_TYPE_DESCRIPTOR_UPDATE_TEMPLATE_CREATE_INFO,
         .pNext = nullptr,
         .flags = 0,
-        .maxSets = max_sets,
-        .poolSizeCount = static_cast<uint32_t>(pool_sizes.size()),
-        .pPoolSizes = pool_sizes.data(),
+        .descriptorUpdateEntryCount = static_cast<uint32_t>(entries.size()),
+        .pDescriptorUpdateEntries = entries.data(),
+        .templateType = VK_DESCRIPTOR_UPDATE_TEMPLATE_TYPE_DESCRIPTOR_SET,
+        .descriptorSetLayout = layout,
+        .pipelineBindPoint = VK_PIPELINE_BIND_POINT_GRAPHICS,
+        .pipelineLayout = VK_NULL_HANDLE,
+        .set = 0,
     };
 
-    VkDescriptorPool pool;
-    VK_ERROR(
-        vkCreateDescriptorPool(p_device.logical, &pool_info, nullptr, &pool)
-    );
-    return descriptor_pool_t{pool, p_device};
-}
+    // A template can't be empty, and there's nothing to update anyway.
+    VkDescriptorUpdateTemplate update_template = VK_NULL_HANDLE;
+    if (!entries.empty()) {
+        VK_ERROR(vkCreateDescriptorUpdateTemplate(
+            p_device.logical, &template_info, nullptr, &update_template
+        ));
+    }
 
-auto descriptor_pool_t::allocate_descriptor_set(
-    const descriptor_set_layout_t &layout
-) const -> VkDescriptorSet {
-    VkDescriptorSetAllocateInfo alloc_info{
-        .sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO,
-        .pNext = nullptr,
-        .descriptorPool = pool,
-        .descriptorSetCount = 1,
-        .pSetLayouts = &layout.layout,
+    return descriptor_set_layout_t{
+        layout, update_template, std::move(descriptor_types), p_device
     };
-
-    VkDescriptorSet set;
-    VK_ERROR(vkAllocateDescriptorSets(device.logical, &alloc_info, &set));
-    return set;
 }
 
-} // namespace mv
-
-namespace {
-auto read_file_to_vector(std::string_view file_name) -> std::vector<char> {
-    std::ifstream file(file_name.data(), std::ios::ate | std::ios::binary);
-
-    if (!file.is_open()) {
-        throw mv::file_exception{
-            mv::file_exception::type_t::open,
-            file_name.data(),
-        };
+auto descriptor_set_layout_t::update(
+    VkDescriptorSet p_set, std::span<const descriptor_data_t> p_data
+) const -> void {
+    if (p_data.size() != descriptor_types.size()) {
+        throw std::runtime_error("wrong number of descriptors for the set.");
     }
 
-    const auto file_size = file.tellg();
-    std::vector<char> buffer(file_size);
-    file.seekg(0);
-    file.read(buffer.data(), file_size);
+    if (descriptor_types.empty()) {
+        return;
+    }
 
-    return buffer;
+    vkUpdateDescriptorSetWithTemplate(
+        device.logical, p_set, update_template, p_data.data()
+    );
 }
-} // namespace
+
+} // namespace mv
@@ -8,6 +8,7 @@
 
 namespace mv {
 struct render_pass_t;
+struct shader_module_cache_t;
 
 struct graphics_pipeline_t {
     VkPipeline pipeline;
@@ -32,7 +33,11 @@ struct graphics_pipeline_t {
         std::string_view vertex_shader_path,
         std::string_view fragment_shader_path,
         std::span<const VkPushConstantRange> push_constant_ranges,
-        std::span<const VkDescriptorSetLayout> descriptor_set_layouts
+        std::span<const VkDescriptorSetLayout> descriptor_set_layouts,
+        VkPipelineCache pipeline_cache = VK_NULL_HANDLE,
+        shader_module_cache_t *shader_modules = nullptr,
+        const VkSpecializationInfo *vertex_specialization = nullptr,
+        const VkSpecializationInfo *fragment_specialization = nullptr
     ) -> graphics_pipeline_t;
 
     NO_COPY(graphics_pipeline_t);
@@ -62,7 +67,8 @@ struct render_pass_t {
         std::optional<VkFormat> depth_format,
         std::span<const VkSubpassDependency> subpass_dependencies =
             std::array<VkSubpassDependency, 0>{},
-        VkImageLayout final_depth_layout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL
+        VkImageLayout final_depth_layout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL,
+        VkImageLayout final_color_layout = VK_IMAGE_LAYOUT_PRESENT_SRC_KHR
     ) -> render_pass_t;
 
     ~render_pass_t() {
@@ -127,49 +133,69 @@ constexpr static std::array vertex_attribute_descriptions{
     }
 };
 
+// What an update template reads for one descriptor. Which member it reads
+// depends on the type of the binding.
+union descriptor_data_t {
+    VkDescriptorImageInfo image;
+    VkDescriptorBufferInfo buffer;
+    VkBufferView texel_buffer_view;
+
+    descriptor_data_t(const VkDescriptorImageInfo &p_image) : image(p_image) {}
+    descriptor_data_t(const VkDescriptorBufferInfo &p_buffer)
+        : buffer(p_buffer) {}
+    descriptor_data_t(VkBufferView p_view) : texel_buffer_view(p_view) {}
+};
+
 struct descriptor_set_layout_t {
     VkDescriptorSetLayout layout;
+
+    // Writes the whole set in one call, from one descriptor_data_t per
+    // descriptor, binding by binding in the order the bindings were given.
+    VkDescriptorUpdateTemplate update_template;
+
+    // The type of each of those descriptors.
+    std::vector<VkDescriptorType> descriptor_types;
+
     const vulkan_device_t &device;
 
     descriptor_set_layout_t(
-        VkDescriptorSetLayout p_layout, const vulkan_device_t &p_device
+        VkDescriptorSetLayout p_layout,
+        VkDescriptorUpdateTemplate p_update_template,
+        std::vector<VkDescriptorType> p_descriptor_types,
+        const vulkan_device_t &p_device
     )
-        : layout(p_layout), device(p_device) {}
+        : layout(p_layout), update_template(p_update_template),
+          descriptor_types(std::move(p_descriptor_types)), device(p_device) {}
 
     NO_COPY(descriptor_set_layout_t);
-    YES_MOVE(descriptor_set_layout_t);
 
-    static auto create(
-        const vulkan_device_t &p_device,
-        std::span<const VkDescriptorSetLayoutBinding> bindings
-    ) -> descriptor_set_layout_t;
-
-    ~descriptor_set_layout_t() {
-        vkDestroyDescriptorSetLayout(device.logical, layout, nullptr);
+    // The moved-from layout is left with null handles, which are fine to
+    // destroy.
+    inline descriptor_set_layout_t(descriptor_set_layout_t &&other) noexcept
+        : layout(other.layout), update_template(other.update_template),
+          descriptor_types(std::move(other.descriptor_types)),
+          device(other.device) {
+        other.layout = VK_NULL_HANDLE;
+        other.update_template = VK_NULL_HANDLE;
     }
-};
-
-struct descriptor_pool_t {
-    VkDescriptorPool pool;
-    const vulkan_device_t &device;
-
-    descriptor_pool_t(VkDescriptorPool p_pool, const vulkan_device_t &p_device)
-        : pool(p_pool), device(p_device) {}
 
+    // The binding flags are either empty or one for each binding.
     static auto create(
         const vulkan_device_t &p_device,
-        std::span<const VkDescriptorPoolSize> pool_sizes,
-        uint32_t max_sets
-    ) -> descriptor_pool_t;
-
-    auto allocate_descriptor_set(const descriptor_set_layout_t &layout
-    ) const -> VkDescriptorSet;
+        std::span<const VkDescriptorSetLayoutBinding> bindings,
+        std::span<const VkDescriptorBindingFlags> binding_flags = {},
+        VkDescriptorSetLayoutCreateFlags flags = 0
+    ) -> descriptor_set_layout_t;
 
-    NO_COPY(descriptor_pool_t);
-    YES_MOVE(descriptor_pool_t);
+    // `data` needs an entry for every descriptor in the set.
+    auto update(VkDescriptorSet set, std::span<const descriptor_data_t> data)
+        const -> void;
 
-    ~descriptor_pool_t() {
-        vkDestroyDescriptorPool(device.logical, pool, nullptr);
+    ~descriptor_set_layout_t() {
+        vkDestroyDescriptorUpdateTemplate(
+            device.logical, update_template, nullptr
+        );
+        vkDestroyDescriptorSetLayout(device.logical, layout, nullptr);
     }
 };
 
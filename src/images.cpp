@@ -3,6 +3,7 @@
 #include <stb_image.h>
 #include <vulkan/vulkan_core.h>
 
+#include "barriers.hpp"
 #include "buffers.hpp"
 #include "common.hpp"
 #include "errors.hpp"
@@ -28,16 +29,21 @@ auto image_t::load_from_file(std::string_view file_path, int desired_channels)
 vulkan_image_t::vulkan_image_t(vulkan_image_t &&other) noexcept {
     image = other.image;
     format = other.format;
-    layout = other.layout;
     width = other.width;
     height = other.height;
+    mip_levels = other.mip_levels;
+    array_layers = other.array_layers;
+    layouts = std::move(other.layouts);
+    memory = std::move(other.memory);
     device = other.device;
 
     other.image = VK_NULL_HANDLE;
     other.format = VK_FORMAT_UNDEFINED;
-    other.layout = VK_IMAGE_LAYOUT_UNDEFINED;
     other.width = 0;
     other.height = 0;
+    other.mip_levels = 0;
+    other.array_layers = 0;
+    other.layouts.clear();
     other.device = nullptr;
 }
 
@@ -45,9 +51,12 @@ auto vulkan_image_t::operator=(vulkan_image_t &&other
 ) noexcept -> vulkan_image_t & {
     std::swap(image, other.image);
     std::swap(format, other.format);
-    std::swap(layout, other.layout);
     std::swap(width, other.width);
     std::swap(height, other.height);
+    std::swap(mip_levels, other.mip_levels);
+    std::swap(array_layers, other.array_layers);
+    std::swap(layouts, other.layouts);
+    std::swap(memory, other.memory);
     std::swap(device, other.device);
 
     return *this;
@@ -55,6 +64,7 @@ auto vulkan_image_t::operator=(vulkan_image_t &&other
 
 auto vulkan_image_t::create(
     const vulkan_device_t &device,
+    memory_allocator_t &allocator,
     uint32_t width,
     uint32_t height,
     VkFormat format
@@ -84,18 +94,31 @@ auto vulkan_image_t::create(
     VkMemoryRequirements memory_requirements;
     vkGetImageMemoryRequirements(device.logical, image, &memory_requirements);
 
+    auto memory = allocator.allocate(
+        memory_requirements,
+        VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+        false,
+        memory_category_t::textures
+    );
+    memory.bind_image(image);
+
     return {
         image,
         format,
         VK_IMAGE_LAYOUT_UNDEFINED,
         width,
         height,
+        std::move(memory),
         device,
     };
 }
 
 auto vulkan_image_t::create_depth_attachment(
-    const vulkan_device_t &device, uint32_t width, uint32_t height, bool p_sampled
+    const vulkan_device_t &device,
+    memory_allocator_t &allocator,
+    uint32_t width,
+    uint32_t height,
+    bool p_sampled
 ) -> vulkan_image_t {
     const std::array format_candiates{
         VK_FORMAT_D32_SFLOAT,
@@ -149,29 +172,83 @@ auto vulkan_image_t::create_depth_attachment(
     VK_ERROR(vkCreateImage(device.logical, &image_create_info, nullptr, &image)
     );
 
-    return {image, *format, VK_IMAGE_LAYOUT_UNDEFINED, width, height, device};
-}
+    VkMemoryRequirements memory_requirements;
+    vkGetImageMemoryRequirements(device.logical, image, &memory_requirements);
 
-auto vulkan_image_t::load_from_image(
-    const command_pool_t &command_pool, const image_t &image
-) -> void {
-    transition_layout(command_pool, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL);
+    auto memory = allocator.allocate(
+        memory_requirements,
+        VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+        false,
+        memory_category_t::attachments
+    );
+    memory.bind_image(image);
+
+    return {
+        image,
+        *format,
+        VK_IMAGE_LAYOUT_UNDEFINED,
+        width,
+        height,
+        std::move(memory),
+        device,
+    };
+}
 
-    auto staging_buffer =
-        staging_buffer_t::create(*device, width * height * 4 * sizeof(uint8_t));
+auto vulkan_image_t::create_color_attachment(
+    const vulkan_device_t &device,
+    memory_allocator_t &allocator,
+    uint32_t width,
+    uint32_t height,
+    VkFormat format
+) -> vulkan_image_t {
+    const VkImageCreateInfo image_create_info{
+        .sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO,
+        .pNext = nullptr,
+        .flags = 0,
+        .imageType = VK_IMAGE_TYPE_2D,
+        .format = format,
+        .extent =
+            {
+                .width = width,
+                .height = height,
+                .depth = 1,
+            },
+        .mipLevels = 1,
+        .arrayLayers = 1,
+        .samples = VK_SAMPLE_COUNT_1_BIT,
+        .tiling = VK_IMAGE_TILING_OPTIMAL,
+        .usage = VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT |
+                 VK_IMAGE_USAGE_TRANSFER_SRC_BIT,
+        .sharingMode = VK_SHARING_MODE_EXCLUSIVE,
+        .queueFamilyIndexCount = 0,
+        .pQueueFamilyIndices = nullptr,
+        .initialLayout = VK_IMAGE_LAYOUT_UNDEFINED,
+    };
 
-    memcpy(
-        staging_buffer.map_memory(),
-        image.data,
-        width * height * 4 * sizeof(uint8_t)
+    VkImage image;
+    VK_ERROR(vkCreateImage(device.logical, &image_create_info, nullptr, &image)
     );
-    staging_buffer.unmap_memory();
 
-    copy_from_buffer(staging_buffer.buffer, command_pool);
+    VkMemoryRequirements memory_requirements;
+    vkGetImageMemoryRequirements(device.logical, image, &memory_requirements);
 
-    vkQueueWaitIdle(device->graphics_queue);
+    auto memory = allocator.allocate(
+        memory_requirements,
+        VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+        false,
+        memory_category_t::attachments
+    );
+    memory.bind_image(image);
 
-    transition_layout(command_pool, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL);
+    return {
+        image,
+        format,
+        VK_IMAGE_LAYOUT_UNDEFINED,
+        width,
+        height,
+        std::move(memory),
+        device,
+    };
 }
 
 auto vulkan_image_t::create_sampler(VkSamplerAddressMode address_mode) const -> sampler_t {
@@ -204,22 +281,13 @@ auto vulkan_image_t::create_sampler(VkSamplerAddressMode address_mode) const ->
     return {sampler, *device};
 }
 
-auto vulkan_image_t::copy_from_buffer(
-    const buffer_t &p_source, const command_pool_t &p_command_pool
+auto vulkan_image_t::record_copy_from_buffer(
+    VkCommandBuffer p_command_buffer,
+    VkBuffer p_source,
+    VkDeviceSize p_source_offset
 ) const -> void {
-    const auto command_buffer = p_command_pool.allocate_buffer();
-
-    const VkCommandBufferBeginInfo begin_info{
-        .sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO,
-        .pNext = nullptr,
-        .flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT,
-        .pInheritanceInfo = nullptr,
-    };
-
-    VK_ERROR(vkBeginCommandBuffer(command_buffer, &begin_info));
-
     const VkBufferImageCopy copy_region{
-        .bufferOffset = 0,
+        .bufferOffset = p_source_offset,
         .bufferRowLength = 0,
         .bufferImageHeight = 0,
         .imageSubresource =
@@ -235,174 +303,93 @@ auto vulkan_image_t::copy_from_buffer(
     };
 
     vkCmdCopyBufferToImage(
-        command_buffer,
-        p_source.buffer,
+        p_command_buffer,
+        p_source,
         image,
         VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
         1,
         &copy_region
     );
-
-    VK_ERROR(vkEndCommandBuffer(command_buffer));
-
-    const VkSubmitInfo submit_info{
-        .sType = VK_STRUCTURE_TYPE_SUBMIT_INFO,
-        .pNext = nullptr,
-        .waitSemaphoreCount = 0,
-        .pWaitSemaphores = nullptr,
-        .pWaitDstStageMask = nullptr,
-        .commandBufferCount = 1,
-        .pCommandBuffers = &command_buffer,
-        .signalSemaphoreCount = 0,
-        .pSignalSemaphores = nullptr,
-    };
-
-    VK_ERROR(
-        vkQueueSubmit(device->graphics_queue, 1, &submit_info, VK_NULL_HANDLE)
-    );
 }
 
-auto vulkan_image_t::transition_layout(
-    const command_pool_t &command_pool, VkImageLayout p_new_layout
-) -> void {
-    const auto command_buffer = command_pool.allocate_buffer();
-
-    const VkCommandBufferBeginInfo begin_info{
-        .sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO,
-        .pNext = nullptr,
-        .flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT,
-        .pInheritanceInfo = nullptr,
-    };
-
-    VK_ERROR(vkBeginCommandBuffer(command_buffer, &begin_info));
-
-    struct masks_t {
-        VkAccessFlags src_access_mask;
-        VkPipelineStageFlags src_stage_mask;
-        VkAccessFlags dst_access_mask;
-        VkPipelineStageFlags dst_stage_mask;
-    } masks = [&]() -> masks_t {
-        if (this->layout == VK_IMAGE_LAYOUT_UNDEFINED &&
-            p_new_layout == VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL) {
-            return {
-                .src_access_mask = 0,
-                .src_stage_mask = VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT,
-                .dst_access_mask = VK_ACCESS_TRANSFER_WRITE_BIT,
-                .dst_stage_mask = VK_PIPELINE_STAGE_TRANSFER_BIT,
-            };
-        } else if (this->layout == VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL &&
-                   p_new_layout == VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL) {
-            return {
-                .src_access_mask = VK_ACCESS_TRANSFER_WRITE_BIT,
-                .src_stage_mask = VK_PIPELINE_STAGE_TRANSFER_BIT,
-                .dst_access_mask = VK_ACCESS_SHADER_READ_BIT,
-                .dst_stage_mask = VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT,
-            };
-        } else if (this->layout == VK_IMAGE_LAYOUT_UNDEFINED &&
-                   p_new_layout ==
-                       VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL) {
-            return {
-                .src_access_mask = 0,
-                .src_stage_mask = VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT,
-                .dst_access_mask = VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_READ_BIT |
-                                   VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT,
-                .dst_stage_mask = VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT,
-            };
-        } else if (this->layout == VK_IMAGE_LAYOUT_UNDEFINED &&
-                   p_new_layout == VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL) {
-            return {
-                .src_access_mask = 0,
-                .src_stage_mask = VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT,
-                .dst_access_mask = VK_ACCESS_COLOR_ATTACHMENT_READ_BIT |
-                                   VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT,
-                .dst_stage_mask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT,
-            };
-        } else if (this->layout == VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL && p_new_layout == VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL) {
-            return {
-                .src_access_mask = VK_ACCESS_COLOR_ATTACHMENT_READ_BIT |
-                                   VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT,
-                .src_stage_mask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT,
-                .dst_access_mask = VK_ACCESS_SHADER_READ_BIT,
-                .dst_stage_mask = VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT,
-            };
-        } else {
-            throw std::runtime_error(
-                std::string("unsupported layout transition.") +
-                std::to_string(this->layout) + " -> " +
-                std::to_string(p_new_layout)
-            );
-        }
-    }();
-
-    VkImageMemoryBarrier barrier{
-        .sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER,
-        .pNext = nullptr,
-        .srcAccessMask = masks.src_access_mask, // TODO
-        .dstAccessMask = masks.dst_access_mask, // TODO
-        .oldLayout = this->layout,
-        .newLayout = p_new_layout,
-        .srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
-        .dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
-        .image = image,
-        .subresourceRange =
+auto vulkan_image_t::record_copy_to_buffer(
+    VkCommandBuffer p_command_buffer,
+    VkBuffer p_destination,
+    VkDeviceSize p_destination_offset
+) const -> void {
+    const VkBufferImageCopy copy_region{
+        .bufferOffset = p_destination_offset,
+        .bufferRowLength = 0,
+        .bufferImageHeight = 0,
+        .imageSubresource =
             {
-                .aspectMask = [&]() -> VkImageAspectFlags {
-                    if (p_new_layout ==
-                        VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL) {
-
-                        const auto has_stencil_component =
-                            format == VK_FORMAT_D32_SFLOAT_S8_UINT ||
-                            format == VK_FORMAT_D24_UNORM_S8_UINT;
-
-                        if (has_stencil_component) {
-                            return VK_IMAGE_ASPECT_DEPTH_BIT |
-                                   VK_IMAGE_ASPECT_STENCIL_BIT;
-                        } else {
-                            return VK_IMAGE_ASPECT_DEPTH_BIT;
-                        }
-
-                    } else {
-                        return VK_IMAGE_ASPECT_COLOR_BIT;
-                    }
-                }(),
-                .baseMipLevel = 0,
-                .levelCount = 1,
+                .aspectMask = VK_IMAGE_ASPECT_COLOR_BIT,
+                .mipLevel = 0,
                 .baseArrayLayer = 0,
                 .layerCount = 1,
             },
+
+        .imageOffset = {0, 0, 0},
+        .imageExtent = {width, height, 1}
     };
 
-    vkCmdPipelineBarrier(
-        command_buffer,
-        masks.src_stage_mask,
-        masks.dst_stage_mask,
-        0,
-        0,
-        nullptr,
-        0,
-        nullptr,
+    vkCmdCopyImageToBuffer(
+        p_command_buffer,
+        image,
+        VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
+        p_destination,
         1,
-        &barrier
+        &copy_region
     );
-    VK_ERROR(vkEndCommandBuffer(command_buffer));
+}
 
-    const VkSubmitInfo submit_info{
-        .sType = VK_STRUCTURE_TYPE_SUBMIT_INFO,
-        .pNext = nullptr,
-        .waitSemaphoreCount = 0,
-        .pWaitSemaphores = nullptr,
-        .pWaitDstStageMask = nullptr,
-        .commandBufferCount = 1,
-        .pCommandBuffers = &command_buffer,
-        .signalSemaphoreCount = 0,
-        .pSignalSemaphores = nullptr,
-    };
+auto vulkan_image_t::transition_layout(
+    immediate_context_t &immediate, VkImageLayout p_new_layout
+) -> void {
+    record_transition_layout(immediate.get_command_buffer(), p_new_layout);
+}
 
-    VK_ERROR(
-        vkQueueSubmit(device->graphics_queue, 1, &submit_info, VK_NULL_HANDLE)
-    );
+auto vulkan_image_t::record_transition_layout(
+    VkCommandBuffer command_buffer, VkImageLayout p_new_layout
+) -> void {
+    barrier_builder_t barriers{*device};
+    barriers.transition(*this, p_new_layout);
+    barriers.record(command_buffer);
+}
 
-    this->layout = p_new_layout;
+auto vulkan_image_t::set_layout(
+    const VkImageSubresourceRange &range, VkImageLayout p_layout
+) -> void {
+    const auto level_count = range.levelCount == VK_REMAINING_MIP_LEVELS
+                                 ? mip_levels - range.baseMipLevel
+                                 : range.levelCount;
+    const auto layer_count = range.layerCount == VK_REMAINING_ARRAY_LAYERS
+                                 ? array_layers - range.baseArrayLayer
+                                 : range.layerCount;
+
+    for (auto layer = range.baseArrayLayer;
+         layer < range.baseArrayLayer + layer_count;
+         layer++) {
+        for (auto level = range.baseMipLevel;
+             level < range.baseMipLevel + level_count;
+             level++) {
+            layouts.at(layer * mip_levels + level) = p_layout;
+        }
+    }
+}
+
+auto vulkan_image_t::get_aspect_mask() const -> VkImageAspectFlags {
+    switch (format) {
+    case VK_FORMAT_D32_SFLOAT:
+    case VK_FORMAT_D16_UNORM:
+        return VK_IMAGE_ASPECT_DEPTH_BIT;
+    case VK_FORMAT_D32_SFLOAT_S8_UINT:
+    case VK_FORMAT_D24_UNORM_S8_UINT:
+    case VK_FORMAT_D16_UNORM_S8_UINT:
+        return VK_IMAGE_ASPECT_DEPTH_BIT | VK_IMAGE_ASPECT_STENCIL_BIT;
+    default:
+        return VK_IMAGE_ASPECT_COLOR_BIT;
+    }
 }
 
 auto vulkan_image_view_t::create(
@@ -7,10 +7,10 @@
 #include "commands.hpp"
 #include "common.hpp"
 #include "device.hpp"
+#include "memory.hpp"
 
 namespace mv {
 struct buffer_t;
-struct vulkan_memory_t;
 
 struct image_t {
     stbi_uc *data;
@@ -35,10 +35,17 @@ struct image_t {
 struct vulkan_image_t {
     VkImage image;
     VkFormat format;
-    VkImageLayout layout;
 
     uint32_t width;
     uint32_t height;
+    uint32_t mip_levels;
+    uint32_t array_layers;
+
+    // The current layout of every subresource, indexed by
+    // layer * mip_levels + mip_level.
+    std::vector<VkImageLayout> layouts;
+
+    vulkan_memory_t memory;
 
     const vulkan_device_t *device;
 
@@ -50,27 +57,46 @@ struct vulkan_image_t {
         VkImageLayout p_layout,
         uint32_t p_width,
         uint32_t p_height,
-        const vulkan_device_t &p_device
+        vulkan_memory_t &&p_memory,
+        const vulkan_device_t &p_device,
+        uint32_t p_mip_levels = 1,
+        uint32_t p_array_layers = 1
     )
-        : image(p_image), format(p_format), layout(p_layout), width(p_width),
-          height(p_height), device(&p_device) {}
+        : image(p_image), format(p_format), width(p_width), height(p_height),
+          mip_levels(p_mip_levels), array_layers(p_array_layers),
+          layouts(p_mip_levels * p_array_layers, p_layout),
+          memory(std::move(p_memory)), device(&p_device) {}
 
     NO_COPY(vulkan_image_t);
 
     vulkan_image_t(vulkan_image_t &&other) noexcept;
     auto operator=(vulkan_image_t &&other) noexcept -> vulkan_image_t &;
 
-    static auto
-    create(const vulkan_device_t &device, uint32_t width, uint32_t height, VkFormat format)
-        -> vulkan_image_t;
+    static auto create(
+        const vulkan_device_t &device,
+        memory_allocator_t &allocator,
+        uint32_t width,
+        uint32_t height,
+        VkFormat format
+    ) -> vulkan_image_t;
 
     static auto create_depth_attachment(
-        const vulkan_device_t &device, uint32_t width, uint32_t height, bool sampled = false
+        const vulkan_device_t &device,
+        memory_allocator_t &allocator,
+        uint32_t width,
+        uint32_t height,
+        bool sampled = false
     ) -> vulkan_image_t;
 
-    auto
-    load_from_image(const command_pool_t &command_pool, const image_t &image)
-        -> void;
+    // Something to render into instead of a swapchain image. It can be copied
+    // out of as well, so that it can be read back.
+    static auto create_color_attachment(
+        const vulkan_device_t &device,
+        memory_allocator_t &allocator,
+        uint32_t width,
+        uint32_t height,
+        VkFormat format
+    ) -> vulkan_image_t;
 
     struct sampler_t {
         VkSampler sampler;
@@ -88,14 +114,55 @@ struct vulkan_image_t {
 
     auto create_sampler(VkSamplerAddressMode address_mode = VK_SAMPLER_ADDRESS_MODE_REPEAT) const -> sampler_t;
 
-    auto copy_from_buffer(
-        const buffer_t &source, const command_pool_t &command_pool
+    // Records the copy into the given command buffer. The image has to be in
+    // the TRANSFER_DST_OPTIMAL layout by the time it executes.
+    auto record_copy_from_buffer(
+        VkCommandBuffer command_buffer,
+        VkBuffer source,
+        VkDeviceSize source_offset
     ) const -> void;
 
+    // The other way around. The image has to be in the TRANSFER_SRC_OPTIMAL
+    // layout, and the pixels end up tightly packed.
+    auto record_copy_to_buffer(
+        VkCommandBuffer command_buffer,
+        VkBuffer destination,
+        VkDeviceSize destination_offset
+    ) const -> void;
+
+    // Records the transition into the immediate context. It goes out with
+    // everything else on the context's next flush().
     auto transition_layout(
-        const command_pool_t &command_pool, VkImageLayout new_layout
+        immediate_context_t &immediate, VkImageLayout new_layout
     ) -> void;
 
+    // Transitions the whole image. Use a barrier_builder_t to transition
+    // parts of it, or to batch it with other barriers.
+    auto record_transition_layout(
+        VkCommandBuffer command_buffer, VkImageLayout new_layout
+    ) -> void;
+
+    inline auto get_layout(uint32_t mip_level = 0, uint32_t array_layer = 0)
+        const -> VkImageLayout {
+        return layouts.at(array_layer * mip_levels + mip_level);
+    }
+
+    // Only updates the tracked layouts, it doesn't record anything.
+    auto set_layout(const VkImageSubresourceRange &range, VkImageLayout layout)
+        -> void;
+
+    auto get_aspect_mask() const -> VkImageAspectFlags;
+
+    inline auto get_subresource_range() const -> VkImageSubresourceRange {
+        return {
+            .aspectMask = get_aspect_mask(),
+            .baseMipLevel = 0,
+            .levelCount = mip_levels,
+            .baseArrayLayer = 0,
+            .layerCount = array_layers,
+        };
+    }
+
     auto get_memory_requirements() const -> VkMemoryRequirements {
         VkMemoryRequirements memory_requirements;
         vkGetImageMemoryRequirements(
@@ -141,26 +208,33 @@ struct vulkan_image_view_t {
     // ure out how to move references.
     const vulkan_image_t *image;
 
+    // Kept separately so that the view can outlive the image object, e.g. when
+    // both are sitting in a deletion queue.
+    const vulkan_device_t *device;
+
     vulkan_image_view_t() = default;
 
     inline vulkan_image_view_t(
         VkImageView p_image_view, const vulkan_image_t &p_image
     )
-        : image_view(p_image_view), image(&p_image) {}
+        : image_view(p_image_view), image(&p_image), device(p_image.device) {}
 
     NO_COPY(vulkan_image_view_t);
 
     inline vulkan_image_view_t(vulkan_image_view_t&& other) {
         image_view = other.image_view;
         image = other.image;
+        device = other.device;
 
         other.image_view = VK_NULL_HANDLE;
         other.image = nullptr;
+        other.device = nullptr;
     }
 
     inline auto operator=(vulkan_image_view_t&& other) -> vulkan_image_view_t& {
         std::swap(image_view, other.image_view);
         std::swap(image, other.image);
+        std::swap(device, other.device);
         return *this;
     }
 
@@ -169,8 +243,8 @@ struct vulkan_image_view_t {
         -> vulkan_image_view_t;
 
     inline ~vulkan_image_view_t() {
-        if (image != nullptr &&  image->device != nullptr && image_view != VK_NULL_HANDLE) {
-            vkDestroyImageView(this->image->device->logical, image_view, nullptr);
+        if (device != nullptr && image_view != VK_NULL_HANDLE) {
+            vkDestroyImageView(device->logical, image_view, nullptr);
         }
     }
 };
@@ -1,25 +1,45 @@
+#include <chrono>
+#include <fstream>
+
 #include "images.hpp"
 #include <vulkan/vulkan_core.h>
 #define GLFW_INCLUDE_VULKAN
 #include <GLFW/glfw3.h>
+#include <stb_image_write.h>
 
+#include "barriers.hpp"
+#include "benchmark.hpp"
+#include "budget.hpp"
 #include "buffers.hpp"
+#include "caches.hpp"
 #include "cameras.hpp"
 #include "commands.hpp"
+#include "counters.hpp"
+#include "descriptors.hpp"
 #include "device.hpp"
 #include "enumerate.hpp"
 #include "errors.hpp"
+#include "frames.hpp"
 #include "graphics.hpp"
 #include "memory.hpp"
 #include "mesh.hpp"
+#include "pipelines.hpp"
+#include "pacing.hpp"
 #include "present.hpp"
+#include "profiler.hpp"
+#include "queries.hpp"
 #include "sync.hpp"
+#include "textures.hpp"
+#include "threads.hpp"
+#include "upload.hpp"
 
 using mv::vulkan_fence_t;
 using mv::vulkan_semaphore_t;
 
 namespace {
 
+using clock_type = std::chrono::steady_clock;
+
 struct push_constants_t {
     float t;
 };
@@ -41,87 +61,570 @@ struct shadow_uniform_buffer_object_t {
     alignas(16) glm::vec3 light_position;
 };
 
+struct draw_t {
+    uint32_t first_index;
+    uint32_t index_count;
+
+    // The index of the draw's texture in the texture registry. It goes in as
+    // the first instance, so it reaches the shaders without anything having
+    // to be bound or pushed between draws.
+    uint32_t material;
+};
+
+// Everything that's needed to record the draws for one of the passes.
+struct pass_t {
+    VkPipeline pipeline;
+    VkPipelineLayout layout;
+    VkDescriptorSet descriptor_set;
+
+    // Bound as set 1 if there is one.
+    VkDescriptorSet texture_set;
+
+    uint32_t dynamic_offset;
+    VkExtent2D extent;
+    VkBuffer vertex_buffer;
+    VkBuffer index_buffer;
+    std::optional<push_constants_t> push_constants;
+};
+
+auto record_draws(
+    VkCommandBuffer command_buffer,
+    const pass_t &pass,
+    std::span<const draw_t> draws,
+    mv::command_counters_t &counters
+) -> void {
+    PROFILE_ZONE("record_draws");
+
+    counters.pipeline_binds++;
+    counters.descriptor_set_binds++;
+    counters.draws += draws.size();
+
+    vkCmdBindPipeline(
+        command_buffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pass.pipeline
+    );
+
+    const std::array descriptor_sets{pass.descriptor_set, pass.texture_set};
+    vkCmdBindDescriptorSets(
+        command_buffer,
+        VK_PIPELINE_BIND_POINT_GRAPHICS,
+        pass.layout,
+        0,
+        pass.texture_set == VK_NULL_HANDLE ? 1 : 2,
+        descriptor_sets.data(),
+        1,
+        &pass.dynamic_offset
+    );
+
+    const VkViewport viewport{
+        .x = 0.0f,
+        .y = 0.0f,
+        .width = static_cast<float>(pass.extent.width),
+        .height = static_cast<float>(pass.extent.height),
+        .minDepth = 0.0f,
+        .maxDepth = 1.0f,
+    };
+
+    const VkRect2D scissor{
+        .offset = {0, 0},
+        .extent = pass.extent,
+    };
+
+    vkCmdSetViewport(command_buffer, 0, 1, &viewport);
+    vkCmdSetScissor(command_buffer, 0, 1, &scissor);
+
+    const VkDeviceSize offset = 0;
+    vkCmdBindVertexBuffers(command_buffer, 0, 1, &pass.vertex_buffer, &offset);
+
+    vkCmdBindIndexBuffer(
+        command_buffer, pass.index_buffer, 0, VK_INDEX_TYPE_UINT32
+    );
+
+    if (pass.push_constants.has_value()) {
+        vkCmdPushConstants(
+            command_buffer,
+            pass.layout,
+            VK_SHADER_STAGE_FRAGMENT_BIT,
+            0,
+            sizeof(push_constants_t),
+            &pass.push_constants.value()
+        );
+    }
+
+    for (const auto &draw : draws) {
+        vkCmdDrawIndexed(
+            command_buffer,
+            draw.index_count,
+            1,
+            draw.first_index,
+            0,
+            draw.material
+        );
+    }
+}
+
+auto record_secondary(
+    VkCommandBuffer command_buffer,
+    VkRenderPass render_pass,
+    VkFramebuffer framebuffer,
+    const pass_t &pass,
+    std::span<const draw_t> draws,
+    VkQueryPipelineStatisticFlags pipeline_statistics,
+    mv::command_counters_t &counters
+) -> void {
+    const VkCommandBufferInheritanceInfo inheritance_info{
+        .sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_INHERITANCE_INFO,
+        .pNext = nullptr,
+        .renderPass = render_pass,
+        .subpass = 0,
+        .framebuffer = framebuffer,
+        .occlusionQueryEnable = VK_FALSE,
+        .queryFlags = 0,
+        .pipelineStatistics = pipeline_statistics,
+    };
+
+    const VkCommandBufferBeginInfo begin_info{
+        .sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO,
+        .pNext = nullptr,
+        .flags = VK_COMMAND_BUFFER_USAGE_RENDER_PASS_CONTINUE_BIT |
+                 VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT,
+        .pInheritanceInfo = &inheritance_info,
+    };
+
+    VK_ERROR(vkBeginCommandBuffer(command_buffer, &begin_info));
+    record_draws(command_buffer, pass, draws, counters);
+    VK_ERROR(vkEndCommandBuffer(command_buffer));
+}
+
 auto recreate_swapchain(
-    const mv::window_t &window,
+    mv::window_t &window,
     const mv::vulkan_device_t &device,
-    const mv::command_pool_t &command_pool,
+    mv::memory_allocator_t &allocator,
+    mv::immediate_context_t &immediate,
+    mv::frame_contexts_t &frames,
     const mv::render_pass_t &render_pass,
     mv::swapchain_t &swapchain,
     mv::swapchain_t::framebuffers_t &framebuffers,
     mv::vulkan_image_t &depth_buffer,
     mv::vulkan_image_view_t &depth_buffer_view,
-    mv::vulkan_memory_t &depth_buffer_memory
+    mv::descriptor_set_cache_t &descriptor_sets
 ) -> void {
-    swapchain = mv::swapchain_t{};
-    depth_buffer_view = mv::vulkan_image_view_t{};
-    depth_buffer = mv::vulkan_image_t{};
-    framebuffers = mv::swapchain_t::framebuffers_t{};
-
-    swapchain = mv::swapchain_t::create(device, window);
-    depth_buffer = mv::vulkan_image_t::create_depth_attachment(
-        device, swapchain.extent.width, swapchain.extent.height
+    PROFILE_ZONE("recreate_swapchain");
+
+    // Frames still in flight may be presenting to the old swapchain or
+    // rendering into its framebuffers, so those go away once they are done.
+    // No set should be pointing to any of it, but none can be after this.
+    auto new_swapchain = mv::swapchain_t::create(
+        device, window, swapchain.policy, swapchain.swapchain
     );
-    const auto depth_buffer_memory_requirements =
-        depth_buffer.get_memory_requirements();
-    depth_buffer_memory = mv::vulkan_memory_t::allocate(
+    for (const auto view : swapchain.image_views) {
+        descriptor_sets.invalidate(
+            view, frames.deletion_queue, frames.get_signal_value()
+        );
+    }
+    frames.retire(std::move(framebuffers));
+    frames.retire(std::move(swapchain));
+    swapchain = std::move(new_swapchain);
+
+    // The depth buffer only has to be at least as big as the framebuffers, so
+    // it is only replaced when the window gets bigger than it has ever been.
+    if (swapchain.extent.width > depth_buffer.width ||
+        swapchain.extent.height > depth_buffer.height) {
+        const auto width = std::max(swapchain.extent.width, depth_buffer.width);
+        const auto height =
+            std::max(swapchain.extent.height, depth_buffer.height);
+
+        descriptor_sets.invalidate(
+            depth_buffer_view.image_view,
+            frames.deletion_queue,
+            frames.get_signal_value()
+        );
+        frames.retire(std::move(depth_buffer_view));
+        frames.retire(std::move(depth_buffer));
+
+        depth_buffer = mv::vulkan_image_t::create_depth_attachment(
+            device, allocator, width, height
+        );
+        depth_buffer_view = mv::vulkan_image_view_t::create(
+            depth_buffer, VK_IMAGE_ASPECT_DEPTH_BIT
+        );
+        depth_buffer.transition_layout(
+            immediate, VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL
+        );
+        immediate.flush();
+    }
+
+    framebuffers =
+        swapchain.create_framebuffers(render_pass, depth_buffer_view);
+    window.resized = false;
+}
+
+// The offscreen target is left in TRANSFER_SRC_OPTIMAL by the main pass.
+auto save_screenshot(
+    const mv::vulkan_device_t &device,
+    mv::memory_allocator_t &allocator,
+    mv::immediate_context_t &immediate,
+    const mv::vulkan_image_t &image,
+    const char *path
+) -> void {
+    const auto row_size = static_cast<VkDeviceSize>(image.width) * 4;
+    const auto readback = mv::buffer_t::create(
         device,
-        std::array{depth_buffer_memory_requirements},
-        VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT
+        allocator,
+        row_size * image.height,
+        mv::buffer_t::type_t::readback
     );
-    depth_buffer_memory.bind_offset = 0;
-    depth_buffer_memory.bind_image(
-        depth_buffer, depth_buffer_memory_requirements
+
+    const auto command_buffer = immediate.get_command_buffer();
+
+    mv::barrier_builder_t barriers{device};
+    barriers.memory(
+        {VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT,
+         VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT},
+        {VK_PIPELINE_STAGE_TRANSFER_BIT, VK_ACCESS_TRANSFER_READ_BIT}
     );
-    depth_buffer_view = mv::vulkan_image_view_t::create(
-        depth_buffer, VK_IMAGE_ASPECT_DEPTH_BIT
+    barriers.record(command_buffer);
+
+    image.record_copy_to_buffer(command_buffer, readback.buffer, 0);
+
+    barriers.memory(
+        {VK_PIPELINE_STAGE_TRANSFER_BIT, VK_ACCESS_TRANSFER_WRITE_BIT},
+        {VK_PIPELINE_STAGE_HOST_BIT, VK_ACCESS_HOST_READ_BIT}
     );
-    depth_buffer.transition_layout(
-        command_pool, VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL
+    barriers.record(command_buffer);
+
+    immediate.flush();
+
+    const auto written = stbi_write_png(
+        path,
+        static_cast<int>(image.width),
+        static_cast<int>(image.height),
+        4,
+        readback.memory.mapped,
+        static_cast<int>(row_size)
     );
-    framebuffers =
-        swapchain.create_framebuffers(render_pass, depth_buffer_view);
+
+    if (written == 0) {
+        throw mv::file_exception(mv::file_exception::type_t::write, path);
+    }
+
+    std::cout << "[INFO]: Saved the last frame to " << path << ".\n";
+}
+
+auto milliseconds_since(clock_type::time_point start) -> double {
+    return std::chrono::duration<double, std::milli>(clock_type::now() - start)
+        .count();
+}
+
+auto print_heap_budgets(const mv::memory_allocator_t &allocator) -> void {
+    const auto megabytes = [](VkDeviceSize bytes) {
+        return static_cast<double>(bytes) / (1024.0 * 1024.0);
+    };
+
+    for (const auto &budget : allocator.get_heap_budgets()) {
+        std::cout << "[INFO]: Heap " << budget.heap_index
+                  << (budget.device_local ? " (device local)" : "") << ": "
+                  << megabytes(budget.usage) << " of "
+                  << megabytes(budget.budget) << " MiB used";
+
+        const auto &usage = budget.allocator_usage;
+        if (usage.allocated > 0) {
+            std::cout << ", " << megabytes(usage.allocated)
+                      << " MiB allocated here (";
+
+            for (size_t i = 0; i < mv::MEMORY_CATEGORY_COUNT; i++) {
+                std::cout << (i == 0 ? "" : ", ")
+                          << mv::get_memory_category_name(
+                                 static_cast<mv::memory_category_t>(i)
+                             )
+                          << " " << megabytes(usage.categories[i]);
+            }
+
+            std::cout << ")";
+        }
+
+        std::cout << ".\n";
+    }
 }
 } // namespace
 //
 
 #define SHADOW_SIZE 4096
+#define UNIFORM_FRAME_BUDGET (64 * 1024)
+
+// How long the window has to stay the same size before a resize is acted on,
+// in seconds.
+#define RESIZE_SETTLE_TIME 0.05
+
+// What headless mode renders into, and how far the animations move on each
+// frame, so that runs are repeatable.
+#define OFFSCREEN_FORMAT VK_FORMAT_R8G8B8A8_SRGB
+#define FIXED_FRAME_TIME (1.0 / 60.0)
+
+// The bench target is this same program with the benchmark on by default.
+#ifdef MV_BENCHMARK
+#define BENCHMARK_BY_DEFAULT true
+#else
+#define BENCHMARK_BY_DEFAULT false
+#endif
+
+// Where the pipeline cache is kept between runs.
+#define PIPELINE_CACHE_PATH "pipeline_cache.bin"
+
+// The width of the block of shadow map texels that get averaged for each
+// fragment. 1 is a single lookup.
+#define SHADOW_PCF_SIZE 1
+
+// How much closer to the light than the shadow map a fragment has to be to
+// count as lit.
+#define SHADOW_BIAS 0.0005f
+
+// How full a heap can get, as a percentage of its budget, before resources
+// registered with the memory budget start getting evicted.
+#define HIGH_WATER_MARK 90.0
+
+#define BENCHMARK_WARMUP_FRAMES 120
+#define BENCHMARK_FRAMES 1000
+#define BENCHMARK_TOLERANCE 0.1
+
+// How many frames the benchmark camera takes to go round the scene once.
+#define SCRIPTED_CAMERA_PERIOD 600
+
+namespace {
+// Circles the cubes, always looking at the middle of them, so that every run
+// of the benchmark renders exactly the same frames.
+auto move_scripted_camera(mv::first_person_camera_t &camera, uint64_t frame)
+    -> void {
+    const glm::vec3 center{0.0f, 1.0f, 1.5f};
+    const auto angle = glm::radians(
+        360.0f * static_cast<float>(frame % SCRIPTED_CAMERA_PERIOD) /
+        static_cast<float>(SCRIPTED_CAMERA_PERIOD)
+    );
+
+    camera.position = center + glm::vec3(
+                                   std::cos(angle) * 4.0f,
+                                   -1.5f,
+                                   std::sin(angle) * 4.0f
+                               );
+
+    const auto direction = glm::normalize(center - camera.position);
+    camera.yaw = glm::degrees(std::atan2(direction.z, direction.x));
+    camera.pitch = glm::degrees(std::asin(direction.y));
+    camera.update_vectors();
+}
+} // namespace
 
 int main(int p_argc, const char *const *const p_argv) try {
     bool enable_validation = false;
+    uint32_t frames_in_flight = mv::frame_contexts_t::DEFAULT_FRAMES_IN_FLIGHT;
+    uint32_t recording_threads = 1;
+    uint32_t extra_cubes = 0;
+    mv::present_policy_t present_policy{};
+    std::optional<VkExtent2D> headless_extent;
+    uint64_t frame_limit = 0;
+    const char *screenshot_path = nullptr;
+    bool benchmark = BENCHMARK_BY_DEFAULT;
+    uint64_t warmup_frames = BENCHMARK_WARMUP_FRAMES;
+    const char *json_path = nullptr;
+    const char *baseline_path = nullptr;
+    double tolerance = BENCHMARK_TOLERANCE;
+    const char *trace_path = nullptr;
+    bool collect_pipeline_statistics = false;
+    double high_water_mark = HIGH_WATER_MARK;
+    const char *pipeline_cache_path = PIPELINE_CACHE_PATH;
+    mv::lighting_variant_t lighting{
+        .shadows = true,
+        .pcf_size = SHADOW_PCF_SIZE,
+        .light_count = 1,
+        .spotlight = true,
+        .shadow_bias = SHADOW_BIAS,
+    };
 
     for (auto arg = p_argv; arg < p_argv + p_argc; ++arg) {
         if (std::strcmp(*arg, "--validation") == 0) {
             enable_validation = true;
             std::cout << "[INFO]: Enabling validation layers.\n";
+        } else if (std::strcmp(*arg, "--frames-in-flight") == 0 &&
+                   arg + 1 < p_argv + p_argc) {
+            frames_in_flight = std::max<uint32_t>(
+                1, std::strtoul(*(++arg), nullptr, 10)
+            );
+        } else if (std::strcmp(*arg, "--threads") == 0 &&
+                   arg + 1 < p_argv + p_argc) {
+            // Zero means one per core.
+            recording_threads = std::strtoul(*(++arg), nullptr, 10);
+        } else if (std::strcmp(*arg, "--cubes") == 0 &&
+                   arg + 1 < p_argv + p_argc) {
+            extra_cubes = std::strtoul(*(++arg), nullptr, 10);
+        } else if (std::strcmp(*arg, "--present") == 0 &&
+                   arg + 1 < p_argv + p_argc) {
+            const auto policy = mv::present_policy_t::parse(*(++arg));
+            if (policy.has_value()) {
+                present_policy = policy.value();
+            } else {
+                std::cerr << "[ERROR]: Unknown present policy " << *arg
+                          << ", expected low-latency, max-throughput, "
+                             "power-saving, or a frame rate.\n";
+            }
+        } else if (std::strcmp(*arg, "--headless") == 0 &&
+                   arg + 1 < p_argv + p_argc) {
+            // The size is given as WIDTHxHEIGHT.
+            char *end;
+            const auto width = std::strtoul(*(++arg), &end, 10);
+            const auto height =
+                *end == 'x' ? std::strtoul(end + 1, nullptr, 10) : 0;
+
+            if (width > 0 && height > 0) {
+                headless_extent = VkExtent2D{
+                    .width = static_cast<uint32_t>(width),
+                    .height = static_cast<uint32_t>(height),
+                };
+            } else {
+                std::cerr << "[ERROR]: Expected the headless size as WxH, got "
+                          << *arg << ".\n";
+                return EXIT_FAILURE;
+            }
+        } else if (std::strcmp(*arg, "--frames") == 0 &&
+                   arg + 1 < p_argv + p_argc) {
+            frame_limit = std::strtoull(*(++arg), nullptr, 10);
+        } else if (std::strcmp(*arg, "--screenshot") == 0 &&
+                   arg + 1 < p_argv + p_argc) {
+            screenshot_path = *(++arg);
+        } else if (std::strcmp(*arg, "--benchmark") == 0) {
+            benchmark = true;
+        } else if (std::strcmp(*arg, "--warmup") == 0 &&
+                   arg + 1 < p_argv + p_argc) {
+            warmup_frames = std::strtoull(*(++arg), nullptr, 10);
+        } else if (std::strcmp(*arg, "--json") == 0 &&
+                   arg + 1 < p_argv + p_argc) {
+            json_path = *(++arg);
+        } else if (std::strcmp(*arg, "--baseline") == 0 &&
+                   arg + 1 < p_argv + p_argc) {
+            baseline_path = *(++arg);
+        } else if (std::strcmp(*arg, "--tolerance") == 0 &&
+                   arg + 1 < p_argv + p_argc) {
+            // Given in percent.
+            tolerance = std::strtod(*(++arg), nullptr) / 100.0;
+        } else if (std::strcmp(*arg, "--trace") == 0 &&
+                   arg + 1 < p_argv + p_argc) {
+            trace_path = *(++arg);
+        } else if (std::strcmp(*arg, "--pipeline-statistics") == 0) {
+            collect_pipeline_statistics = true;
+        } else if (std::strcmp(*arg, "--high-water-mark") == 0 &&
+                   arg + 1 < p_argv + p_argc) {
+            // Given in percent.
+            high_water_mark = std::strtod(*(++arg), nullptr);
+        } else if (std::strcmp(*arg, "--pipeline-cache") == 0 &&
+                   arg + 1 < p_argv + p_argc) {
+            pipeline_cache_path = *(++arg);
+        } else if (std::strcmp(*arg, "--no-shadows") == 0) {
+            lighting.shadows = false;
+        } else if (std::strcmp(*arg, "--no-spotlight") == 0) {
+            lighting.spotlight = false;
+        } else if (std::strcmp(*arg, "--pcf") == 0 &&
+                   arg + 1 < p_argv + p_argc) {
+            lighting.pcf_size = std::max(
+                1ul, std::strtoul(*(++arg), nullptr, 10)
+            );
+        } else if (std::strcmp(*arg, "--lights") == 0 &&
+                   arg + 1 < p_argv + p_argc) {
+            lighting.light_count = std::strtoul(*(++arg), nullptr, 10);
         }
     }
 
+    // Anything basic.frag can't do would only build a copy of a pipeline it
+    // can, so the report says what was really rendered.
+    const auto requested_lighting = lighting;
+    lighting = lighting.normalized();
+    if (lighting != requested_lighting) {
+        std::cout << "[INFO]: Using a PCF size of " << lighting.pcf_size
+                  << " and " << lighting.light_count
+                  << " light(s), which is what the shader supports.\n";
+    }
+
+    PROFILE_THREAD("main");
+
+    // Without --json, the benchmark's results go to stdout, and everything
+    // else goes to stderr instead, so that stdout can be redirected to a
+    // baseline file as it is.
+    std::ostream results{std::cout.rdbuf()};
+    if (benchmark && json_path == nullptr) {
+        std::cout.rdbuf(std::cerr.rdbuf());
+    }
+
+    if (benchmark) {
+        // --frames counts the measured frames, the warm-up comes on top.
+        frame_limit =
+            (frame_limit == 0 ? BENCHMARK_FRAMES : frame_limit) + warmup_frames;
+    }
+
+    const auto headless = headless_extent.has_value();
+    if (headless && frame_limit == 0) {
+        // There is no window to close, so it has to stop by itself.
+        frame_limit = 1;
+    }
+
+    if (headless) {
+        // Nothing gets shown, but the timer and the event loop still get
+        // used, and the null platform works without a display.
+        glfwInitHint(GLFW_PLATFORM, GLFW_PLATFORM_NULL);
+    }
+
     if (!glfwInit()) {
         throw mv::glfw_init_failed_exception{};
     }
 
-    const auto instance = mv::vulkan_instance_t::create(enable_validation);
-    auto window = mv::window_t::create(instance, "Hello!", 1280, 720);
+    const auto instance =
+        mv::vulkan_instance_t::create(enable_validation, headless);
+    auto window = headless
+                      ? mv::window_t::create_headless(
+                            static_cast<int>(headless_extent->width),
+                            static_cast<int>(headless_extent->height)
+                        )
+                      : mv::window_t::create(instance, "Hello!", 1280, 720);
     window.set_user_pointer();
-    glfwSetInputMode(window.window, GLFW_CURSOR, GLFW_CURSOR_DISABLED);
+    if (!headless) {
+        glfwSetInputMode(window.window, GLFW_CURSOR, GLFW_CURSOR_DISABLED);
+    }
     const auto device = mv::vulkan_device_t::create(instance, window.surface);
-    auto swapchain = mv::swapchain_t::create(device, window);
-    const auto command_pool = mv::command_pool_t::create(device);
-    auto depth_buffer = mv::vulkan_image_t::create_depth_attachment(
-        device, swapchain.extent.width, swapchain.extent.height
-    );
-
-    auto depth_buffer_memory_requirements =
-        depth_buffer.get_memory_requirements();
-
-    auto depth_buffer_memory = mv::vulkan_memory_t::allocate(
-        device,
-        std::array{depth_buffer_memory_requirements},
-        VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT
-    );
+    auto allocator = mv::memory_allocator_t::create(device);
+    auto memory_budget =
+        mv::memory_budget_t::create(allocator, high_water_mark / 100.0);
+    auto uploader = mv::upload_service_t::create(device, allocator);
+    auto swapchain = headless ? mv::swapchain_t{}
+                              : mv::swapchain_t::create(
+                                    device, window, present_policy
+                                );
+
+    if (headless) {
+        std::cout << "[INFO]: Rendering " << frame_limit << " frame(s) at "
+                  << headless_extent->width << "x" << headless_extent->height
+                  << " without a window.\n";
+    } else {
+        std::cout << "[INFO]: Presenting with "
+                  << mv::get_present_mode_name(swapchain.present_mode)
+                  << " and " << swapchain.images.size() << " images.\n";
+    }
 
-    depth_buffer_memory.bind_image(
-        depth_buffer, depth_buffer_memory_requirements
+    // Stands in for the swapchain images in headless mode.
+    auto offscreen = headless ? mv::vulkan_image_t::create_color_attachment(
+                                    device,
+                                    allocator,
+                                    headless_extent->width,
+                                    headless_extent->height,
+                                    OFFSCREEN_FORMAT
+                                )
+                              : mv::vulkan_image_t{};
+    const auto offscreen_view =
+        headless ? mv::vulkan_image_view_t::create(
+                       offscreen, VK_IMAGE_ASPECT_COLOR_BIT
+                   )
+                 : mv::vulkan_image_view_t{};
+
+    const auto initial_extent =
+        headless ? headless_extent.value() : swapchain.extent;
+    auto immediate = mv::immediate_context_t::create(device);
+    auto depth_buffer = mv::vulkan_image_t::create_depth_attachment(
+        device, allocator, initial_extent.width, initial_extent.height
     );
 
     auto depth_buffer_view = mv::vulkan_image_view_t::create(
@@ -129,59 +632,39 @@ int main(int p_argc, const char *const *const p_argv) try {
     );
 
     depth_buffer.transition_layout(
-        command_pool, VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL
+        immediate, VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL
     );
 
     const auto texture_image =
         mv::image_t::load_from_file("textures/can-pooper.png", 4);
     auto texture = mv::vulkan_image_t::create(
         device,
+        allocator,
         texture_image.width,
         texture_image.height,
         VK_FORMAT_R8G8B8A8_SRGB
     );
-    const auto texture_memory_requirements = texture.get_memory_requirements();
 
     const auto another_texture_image =
         mv::image_t::load_from_file("textures/neng-face.jpg", 4);
     auto another_texture = mv::vulkan_image_t::create(
         device,
+        allocator,
         another_texture_image.width,
         another_texture_image.height,
         VK_FORMAT_R8G8B8A8_SRGB
     );
-    const auto another_texture_memory_requirements =
-        another_texture.get_memory_requirements();
-
-    auto shadow_depth_buffer =
-        mv::vulkan_image_t::create_depth_attachment(device, SHADOW_SIZE, SHADOW_SIZE, true);
-    const auto shadow_depth_buffer_memory_requirements =
-        shadow_depth_buffer.get_memory_requirements();
-
-    const std::array memory_requirements{
-        texture_memory_requirements,
-        another_texture_memory_requirements,
-        shadow_depth_buffer_memory_requirements,
-    };
-
-    auto image_memory = mv::vulkan_memory_t::allocate(
-        device, memory_requirements, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT
-    );
 
-    image_memory.bind_image(texture, texture_memory_requirements);
-    image_memory.bind_image(
-        another_texture, another_texture_memory_requirements
-    );
-    image_memory.bind_image(
-        shadow_depth_buffer, shadow_depth_buffer_memory_requirements
+    auto shadow_depth_buffer = mv::vulkan_image_t::create_depth_attachment(
+        device, allocator, SHADOW_SIZE, SHADOW_SIZE, true
     );
 
-    texture.load_from_image(command_pool, texture_image);
-    another_texture.load_from_image(command_pool, another_texture_image);
+    uploader.upload_image(texture, texture_image);
+    uploader.upload_image(another_texture, another_texture_image);
     const auto texture_view =
         mv::vulkan_image_view_t::create(texture, VK_IMAGE_ASPECT_COLOR_BIT);
 
-    const auto another_texture_view = mv::vulkan_image_view_t::create(
+    auto another_texture_view = mv::vulkan_image_view_t::create(
         another_texture, VK_IMAGE_ASPECT_COLOR_BIT
     );
 
@@ -193,20 +676,39 @@ int main(int p_argc, const char *const *const p_argv) try {
 
     const auto render_pass = mv::render_pass_t::create(
         device,
-        swapchain.format,
+        headless ? offscreen.format : swapchain.format,
         depth_buffer.format,
         std::array{VkSubpassDependency{
             .srcSubpass = VK_SUBPASS_EXTERNAL,
             .dstSubpass = 0,
-            .srcStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT,
-            .dstStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT,
-            .srcAccessMask = 0,
-            .dstAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT,
+            // The depth buffer (and the offscreen target, when headless) is
+            // shared between the frames in flight, so the previous frame has
+            // to be done with it too.
+            .srcStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT |
+                            VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT,
+            .dstStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT |
+                            VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT,
+            .srcAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT |
+                             VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT,
+            .dstAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT |
+                             VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT,
             .dependencyFlags = 0,
-        }}
+        }},
+        VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL,
+        headless ? VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL
+                 : VK_IMAGE_LAYOUT_PRESENT_SRC_KHR
     );
     auto framebuffers =
-        swapchain.create_framebuffers(render_pass, depth_buffer_view);
+        headless ? mv::swapchain_t::framebuffers_t::create(
+                       device,
+                       render_pass,
+                       std::array{offscreen_view.image_view},
+                       depth_buffer_view,
+                       initial_extent
+                   )
+                 : swapchain.create_framebuffers(
+                       render_pass, depth_buffer_view
+                   );
 
     const auto shadow_render_pass = mv::render_pass_t::create(
         device,
@@ -242,23 +744,24 @@ int main(int p_argc, const char *const *const p_argv) try {
     const auto descriptor_set_layout = mv::descriptor_set_layout_t::create(
         device,
         std::array{
-            mv::uniform_buffer_t::get_set_layout_binding(
+            mv::uniform_buffer_t::get_dynamic_set_layout_binding(
                 0, 1, VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_FRAGMENT_BIT
             ),
             mv::vulkan_image_t::get_set_layout_binding(
-                1, 2, VK_SHADER_STAGE_FRAGMENT_BIT
-            ),
-            mv::vulkan_image_t::get_set_layout_binding(
-                2, 1, VK_SHADER_STAGE_FRAGMENT_BIT
+                1, 1, VK_SHADER_STAGE_FRAGMENT_BIT
             ),
         }
     );
 
+    // The textures are in a set of their own, which is the same for every
+    // draw no matter which textures it uses.
+    auto textures = mv::texture_registry_t::create(device);
+
     const auto shadow_descriptor_set_layout =
         mv::descriptor_set_layout_t::create(
             device,
             std::array{
-                mv::uniform_buffer_t::get_set_layout_binding(
+                mv::uniform_buffer_t::get_dynamic_set_layout_binding(
                     0,
                     1,
                     VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_FRAGMENT_BIT
@@ -266,31 +769,48 @@ int main(int p_argc, const char *const *const p_argv) try {
             }
         );
 
-    const auto pipeline = mv::graphics_pipeline_t::create(
-        device,
-        render_pass,
-        "shaders/basic.vert.spv",
-        "shaders/basic.frag.spv",
-        std::array<VkPushConstantRange, 1>{VkPushConstantRange{
+    const mv::pipeline_description_t pipeline_description{
+        .render_pass = render_pass,
+        .vertex_shader_path = "shaders/basic.vert.spv",
+        .fragment_shader_path = "shaders/basic.frag.spv",
+        .push_constant_ranges = {VkPushConstantRange{
             .stageFlags = VK_SHADER_STAGE_FRAGMENT_BIT,
             .offset = 0,
             .size = sizeof(push_constants_t),
         }},
-        std::array<VkDescriptorSetLayout, 1>{
+        .descriptor_set_layouts = {
             descriptor_set_layout.layout,
-        }
-    );
+            textures.layout.layout,
+        },
+    };
 
-    const auto shadow_pipeline = mv::graphics_pipeline_t::create(
-        device,
-        shadow_render_pass,
-        "shaders/shadow.vert.spv",
-        "shaders/shadow.frag.spv",
-        std::array<VkPushConstantRange, 0>{},
-        std::array{shadow_descriptor_set_layout.layout}
-    );
+    const mv::pipeline_description_t shadow_pipeline_description{
+        .render_pass = shadow_render_pass,
+        .vertex_shader_path = "shaders/shadow.vert.spv",
+        .fragment_shader_path = "shaders/shadow.frag.spv",
+        .push_constant_ranges = {},
+        .descriptor_set_layouts = {shadow_descriptor_set_layout.layout},
+    };
+
+    // The same workers record the draws later on. Until then, they build the
+    // pipelines while the rest of the setup happens here.
+    auto recording_pool = mv::thread_pool_t::create(recording_threads);
+    const auto threaded = recording_pool.size() > 1;
+
+    const auto pipeline_cache =
+        mv::pipeline_cache_t::create(device, pipeline_cache_path);
 
-    const auto command_buffer = command_pool.allocate_buffer();
+    auto shader_modules = mv::shader_module_cache_t::create(device);
+
+    const auto pipeline_creation_start = clock_type::now();
+    auto pipelines = mv::pipeline_build_queue_t::create(
+        device, recording_pool, pipeline_cache.cache, &shader_modules
+    );
+    auto lit_pipelines =
+        mv::lighting_pipelines_t::create(pipelines, pipeline_description);
+    const auto main_pipeline_handle = lit_pipelines.request(lighting);
+    const auto shadow_pipeline_handle =
+        pipelines.submit("shadow", shadow_pipeline_description);
 
     const glm::vec3 light_position{1.5f, -1.7f, -1.8f};
 
@@ -299,160 +819,144 @@ int main(int p_argc, const char *const *const p_argv) try {
     cube.append_cube(2.0f, 0.5f, light_position);
     cube.append_cube(3.0f, 100.0f, glm::vec3(0.0f, 53.0f, 0.0f));
 
+    // A grid of small cubes on the floor, to give the renderer more draws.
+    for (uint32_t i = 0; i < extra_cubes; i++) {
+        cube.append_cube(
+            static_cast<float>(i % 2),
+            0.25f,
+            glm::vec3(
+                static_cast<float>(i % 64) * 0.5f - 16.0f,
+                2.875f,
+                static_cast<float>(i / 64) * 0.5f + 4.0f
+            )
+        );
+    }
+
+    // Sampler 0, which basic.frag uses for everything.
+    const auto texture_sampler = texture.create_sampler();
+    textures.add_sampler(texture_sampler.sampler);
+
+    // Indexed by the cubes' IDs. The light and the floor don't get textures.
+    const std::array materials{
+        textures.add(texture_view.image_view),
+        textures.add(another_texture_view.image_view),
+    };
+
+    // One draw per cube, so that there's something to split between threads.
+    std::vector<draw_t> draws;
+    for (uint32_t first = 0; first < cube.indices.size();
+         first += mv::mesh_t::CUBE_INDEX_COUNT) {
+        const auto id = static_cast<uint32_t>(
+            cube.vertices.at(cube.indices.at(first)).id
+        );
+
+        draws.push_back({
+            .first_index = first,
+            .index_count = mv::mesh_t::CUBE_INDEX_COUNT,
+            .material = id < materials.size() ? materials[id] : 0,
+        });
+    }
+
     auto vertex_buffer = mv::vertex_buffer_t::create(
-        device, cube.vertices.size() * sizeof(mv::vertex_t)
+        device, allocator, cube.vertices.size() * sizeof(mv::vertex_t)
     );
 
-    vertex_buffer.buffer.load_using_staging(
-        command_pool.pool,
+    uploader.upload_buffer(
+        vertex_buffer.buffer,
         cube.vertices.data(),
         cube.vertices.size() * sizeof(mv::vertex_t)
     );
 
     auto index_buffer = mv::index_buffer_t::create(
-        device, cube.indices.size() * sizeof(uint32_t)
+        device, allocator, cube.indices.size() * sizeof(uint32_t)
     );
-    index_buffer.buffer.load_using_staging(
-        command_pool.pool,
+    uploader.upload_buffer(
+        index_buffer.buffer,
         cube.indices.data(),
         cube.indices.size() * sizeof(uint32_t)
     );
 
-    const auto uniform_buffer =
-        mv::uniform_buffer_t::create(device, sizeof(uniform_buffer_object_t));
+    // Everything above goes out in one submit for the uploads and one for the
+    // rest of the setup.
+    uploader.flush();
+    immediate.flush();
+
+    std::cout << "[INFO]: Setup took " << uploader.next_batch_id - 1
+              << " upload submit(s) and " << immediate.submit_count
+              << " immediate submit(s).\n";
+
+    // Both passes push their uniforms into the same ring every frame.
+    auto uniform_ring = mv::uniform_buffer_t::create_ring(
+        device, allocator, frames_in_flight, UNIFORM_FRAME_BUDGET
+    );
+
+    for (const auto &block : allocator.get_statistics().blocks) {
+        std::cout << "[INFO]: Memory block of type " << block.memory_type_index
+                  << ": " << block.used << " of " << block.size
+                  << " bytes used by " << block.allocation_count
+                  << " allocations (largest free node is "
+                  << block.largest_free << " bytes).\n";
+    }
+
+    std::cout << "[INFO]: Recording on " << recording_pool.size()
+              << " thread(s).\n";
 
-    const auto shadow_uniform_buffer = mv::uniform_buffer_t::create(
-        device, sizeof(shadow_uniform_buffer_object_t)
+    // For the sets that last until something they point to goes away. Those
+    // get freed one at a time through the frames' deletion queue, so both of
+    // these have to outlive `frames`.
+    auto descriptors = mv::descriptor_allocator_t::create(
+        device, VK_DESCRIPTOR_POOL_CREATE_FREE_DESCRIPTOR_SET_BIT
     );
 
-    const auto frame_fence = vulkan_fence_t::create(device);
-    const auto image_available_semaphore = vulkan_semaphore_t::create(device);
+    // The main pass asks for its set every frame. That's only a lookup,
+    // unless something it points to has changed since the last time.
+    auto descriptor_sets = mv::descriptor_set_cache_t::create(descriptors);
+
+    auto frames = mv::frame_contexts_t::create(
+        device, frames_in_flight, threaded ? recording_pool.size() : 0
+    );
+    std::cout << "[INFO]: Using " << frames.size() << " frames in flight.\n";
+
     const auto shadow_done_semaphore = vulkan_semaphore_t::create(device);
     const auto shadow_texture_layout_done_semaphore =
         vulkan_semaphore_t::create(device);
-    const auto render_done_semaphore = vulkan_semaphore_t::create(device);
 
-    const auto descriptor_pool = mv::descriptor_pool_t::create(
-        device,
-        std::array{
-            VkDescriptorPoolSize{
-                .type = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER,
-                .descriptorCount = 1,
-            },
-            VkDescriptorPoolSize{
-                .type = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER,
-                .descriptorCount = 1,
-            },
-            VkDescriptorPoolSize{
-                .type = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER,
-                .descriptorCount = 2,
+    // The second texture is the one thing that can be thrown away when memory
+    // runs short. The cubes that used it fall back to the first one.
+    const auto another_texture_budget_id =
+        memory_budget.add(another_texture.memory, [&]() {
+            for (auto &draw : draws) {
+                if (draw.material == materials[1]) {
+                    draw.material = materials[0];
+                }
             }
-        },
-        2
-    );
-
-    const auto texture_sampler = texture.create_sampler();
-
-    const auto descriptor_set =
-        descriptor_pool.allocate_descriptor_set(descriptor_set_layout);
 
-    {
-        const auto buffer_info = uniform_buffer.get_descriptor_buffer_info();
-        const auto image_info = texture.get_descriptor_image_info(
-            texture_sampler.sampler, texture_view.image_view
-        );
-        const auto image2_info = another_texture.get_descriptor_image_info(
-            texture_sampler.sampler, another_texture_view.image_view
-        );
+            textures.remove(materials[1], frames);
+            descriptor_sets.invalidate(
+                another_texture_view.image_view,
+                frames.deletion_queue,
+                frames.get_signal_value()
+            );
+            frames.retire(std::move(another_texture_view));
+            frames.retire(std::move(another_texture));
+        });
 
-        const VkDescriptorImageInfo shadow_info{
+    const std::array<mv::descriptor_data_t, 2> main_descriptors{
+        uniform_ring.get_descriptor_buffer_info(
+            sizeof(uniform_buffer_object_t)
+        ),
+        VkDescriptorImageInfo{
             .sampler = shadow_sampler.sampler,
             .imageView = shadow_depth_buffer_view.image_view,
             .imageLayout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_READ_ONLY_OPTIMAL,
-        };
-
-        const std::array set_writes{
-            VkWriteDescriptorSet{
-                .sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET,
-                .pNext = nullptr,
-                .dstSet = descriptor_set,
-                .dstBinding = 0,
-                .dstArrayElement = 0,
-                .descriptorCount = 1,
-                .descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER,
-                .pImageInfo = nullptr,
-                .pBufferInfo = &buffer_info,
-                .pTexelBufferView = nullptr,
-            },
-            VkWriteDescriptorSet{
-                .sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET,
-                .pNext = nullptr,
-                .dstSet = descriptor_set,
-                .dstBinding = 1,
-                .dstArrayElement = 0,
-                .descriptorCount = 1,
-                .descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER,
-                .pImageInfo = &image_info,
-                .pBufferInfo = nullptr,
-                .pTexelBufferView = nullptr,
-            },
-            VkWriteDescriptorSet{
-                .sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET,
-                .pNext = nullptr,
-                .dstSet = descriptor_set,
-                .dstBinding = 1,
-                .dstArrayElement = 1,
-                .descriptorCount = 1,
-                .descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER,
-                .pImageInfo = &image2_info,
-                .pBufferInfo = nullptr,
-                .pTexelBufferView = nullptr,
-            },
-            VkWriteDescriptorSet{
-                .sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET,
-                .pNext = nullptr,
-                .dstSet = descriptor_set,
-                .dstBinding = 2,
-                .dstArrayElement = 0,
-                .descriptorCount = 1,
-                .descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER,
-                .pImageInfo = &shadow_info,
-                .pBufferInfo = nullptr,
-                .pTexelBufferView = nullptr,
-            }
-        };
-
-        vkUpdateDescriptorSets(
-            device.logical, set_writes.size(), set_writes.data(), 0, nullptr
-        );
-    }
-
-    const auto shadow_descriptor_set =
-        descriptor_pool.allocate_descriptor_set(shadow_descriptor_set_layout);
-
-    {
-        const auto buffer_info =
-            shadow_uniform_buffer.get_descriptor_buffer_info();
-
-        const std::array set_writes{
-            VkWriteDescriptorSet{
-                .sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET,
-                .pNext = nullptr,
-                .dstSet = shadow_descriptor_set,
-                .dstBinding = 0,
-                .dstArrayElement = 0,
-                .descriptorCount = 1,
-                .descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER,
-                .pImageInfo = nullptr,
-                .pBufferInfo = &buffer_info,
-                .pTexelBufferView = nullptr,
-            },
-        };
+        },
+    };
 
-        vkUpdateDescriptorSets(
-            device.logical, set_writes.size(), set_writes.data(), 0, nullptr
-        );
-    }
+    const std::array<mv::descriptor_data_t, 1> shadow_descriptors{
+        uniform_ring.get_descriptor_buffer_info(
+            sizeof(shadow_uniform_buffer_object_t)
+        ),
+    };
 
     const auto light_direction = glm::normalize(glm::vec3(-1.7f, 2.0f, 3.0f));
 
@@ -499,75 +1003,244 @@ int main(int p_argc, const char *const *const p_argv) try {
 
     double delta_time = 0.0;
     double time = 0.0;
+    double total_time = 0.0;
+    double recording_time = 0.0;
 
     double previous_mouse_x = 0.0;
     double previous_mouse_y = 0.0;
     bool has_mouse_set = false;
     bool should_follow_mouse = true;
 
-    glfwShowWindow(window.window);
-    while (!glfwWindowShouldClose(window.window)) {
-        const auto start_time = glfwGetTime();
+    if (!headless) {
+        glfwShowWindow(window.window);
+    }
 
-        const float speed = 1.0;
-        const auto bob_rate = window.height * 0.00000025;
-        const auto bob_factor = time * 15.0;
-        auto should_update_time = false;
-        const auto move_direction = camera.direction;
-        if (glfwGetKey(window.window, GLFW_KEY_W)) {
-            camera.position += (float)delta_time * speed * move_direction;
+    if (device.memory_budget) {
+        std::cout << "[INFO]: Using VK_EXT_memory_budget for heap usage.\n";
+    }
+    print_heap_budgets(allocator);
 
-            should_update_time = true;
-        }
-        if (glfwGetKey(window.window, GLFW_KEY_S)) {
-            camera.position -= (float)delta_time * speed * move_direction;
+    auto limiter = mv::frame_limiter_t::create(
+        present_policy.type == mv::present_policy_t::type_t::capped
+            ? present_policy.fps
+            : 0.0
+    );
 
-            should_update_time = true;
-        }
-        if (glfwGetKey(window.window, GLFW_KEY_A)) {
-            camera.position -= (float)delta_time * speed * camera.right;
+    auto gpu_profiler = mv::gpu_profiler_t::create(device, frames.size());
+    if (!gpu_profiler.is_supported()) {
+        std::cout << "[INFO]: The graphics queue can't write timestamps, so "
+                     "there won't be any GPU times.\n";
+    }
 
-            should_update_time = true;
-        }
-        if (glfwGetKey(window.window, GLFW_KEY_D)) {
-            camera.position += (float)delta_time * speed * camera.right;
+    auto pipeline_statistics = mv::pipeline_statistics_t::create(
+        device, frames.size(), collect_pipeline_statistics, threaded
+    );
+    if (collect_pipeline_statistics && !pipeline_statistics.is_enabled()) {
+        std::cout << "[INFO]: The device can't collect pipeline statistics"
+                  << (threaded ? " with secondary command buffers" : "")
+                  << ".\n";
+    }
 
-            should_update_time = true;
+    // Only now does anything need the pipelines.
+    const auto pipeline_wait_start = clock_type::now();
+    const auto &pipeline = pipelines.get(main_pipeline_handle);
+    const auto &shadow_pipeline = pipelines.get(shadow_pipeline_handle);
+    const auto pipeline_wait_time = milliseconds_since(pipeline_wait_start);
+    const auto pipeline_creation_time =
+        milliseconds_since(pipeline_creation_start);
+
+    std::cout << "[INFO]: Building " << pipelines.entries.size()
+              << " pipelines took " << pipelines.get_build_milliseconds()
+              << " ms on the workers and " << pipeline_creation_time
+              << " ms from start to finish, " << pipeline_wait_time
+              << " ms of which the setup spent waiting for them, with "
+              << (pipeline_cache.loaded ? "the pipeline cache from "
+                                        : "nothing loaded from ")
+              << pipeline_cache_path << ".\n";
+
+    std::cout << "[INFO]: Shader module cache: " << shader_modules.hits
+              << " hit(s), " << shader_modules.misses << " miss(es), "
+              << shader_modules.files_read << " file(s) read.\n";
+
+    // The benchmark also builds them twice more with a cache of its own, once
+    // while it's still empty and once after, to compare the two. Only now,
+    // so that those builds don't hold up the real ones or end up in their
+    // times. The driver may have a cache of its own too, so the cold time can
+    // still be better than a true first run.
+    auto cold_pipeline_creation_time = 0.0;
+    auto cold_pipeline_wall_time = 0.0;
+    auto warm_pipeline_creation_time = 0.0;
+    auto warm_pipeline_wall_time = 0.0;
+    if (benchmark) {
+        const auto cache = mv::pipeline_cache_t::create(device);
+
+        const auto build_all = [&](double &build_time, double &wall_time) {
+            const auto start = clock_type::now();
+
+            auto queue = mv::pipeline_build_queue_t::create(
+                device, recording_pool, cache.cache
+            );
+            mv::lighting_pipelines_t::create(queue, pipeline_description)
+                .request(lighting);
+            queue.submit("shadow", shadow_pipeline_description);
+            queue.wait_all();
+
+            build_time = queue.get_build_milliseconds();
+            wall_time = milliseconds_since(start);
+        };
+
+        build_all(cold_pipeline_creation_time, cold_pipeline_wall_time);
+        build_all(warm_pipeline_creation_time, warm_pipeline_wall_time);
+
+        std::cout << "[INFO]: With a cold pipeline cache, building them took "
+                  << cold_pipeline_creation_time << " ms on the workers and "
+                  << cold_pipeline_wall_time << " ms from start to finish. "
+                  << "With a warm one, " << warm_pipeline_creation_time
+                  << " ms and " << warm_pipeline_wall_time << " ms.\n";
+    }
+
+    // Summed over every frame, to get the averages at the end.
+    mv::command_counters_t total_counters{};
+
+    mv::benchmark_report_t report{};
+    const auto add_gpu_timings = [&](const auto &timings) {
+        for (const auto &timing : timings) {
+            report.add("gpu_" + timing.name + "_ms", timing.milliseconds);
         }
-        if (glfwGetKey(window.window, GLFW_KEY_ESCAPE)) {
-            glfwSetInputMode(window.window, GLFW_CURSOR, GLFW_CURSOR_NORMAL);
-            should_follow_mouse = false;
+    };
+    const auto add_pass_statistics = [&](const auto &passes) {
+        for (const auto &pass : passes) {
+            const auto &values = pass.values;
+            const auto add = [&](std::string_view name, uint64_t value) {
+                report.count(
+                    pass.name + "_" + std::string{name},
+                    static_cast<double>(value)
+                );
+            };
+
+            add("input_vertices", values.input_vertices);
+            add("input_primitives", values.input_primitives);
+            add("vertex_invocations", values.vertex_invocations);
+            add("clipping_primitives", values.clipping_primitives);
+            add("fragment_invocations", values.fragment_invocations);
         }
-        if (glfwGetMouseButton(window.window, GLFW_MOUSE_BUTTON_LEFT)) {
-            glfwSetInputMode(window.window, GLFW_CURSOR, GLFW_CURSOR_DISABLED);
-            should_follow_mouse = true;
-            has_mouse_set = false;
+    };
+
+    while ((frame_limit == 0 || frames.frame_count < frame_limit) &&
+           (headless || !glfwWindowShouldClose(window.window))) {
+        PROFILE_ZONE("frame");
+
+        const auto start_time = glfwGetTime();
+
+        // Frames from before the warm-up is over don't get counted.
+        const auto measuring = benchmark && frames.frame_count >= warmup_frames;
+
+        // Everything the frame spends blocked, in milliseconds, which is taken
+        // off the frame time to get the time the CPU actually spent on it.
+        auto blocked_time = 0.0;
+
+        // Input gets sampled right after this, so that it's as fresh as it
+        // can be when the frame goes out.
+        const auto limiter_wait_time = limiter.wait_time;
+        limiter.wait();
+        blocked_time += (limiter.wait_time - limiter_wait_time) * 1000.0;
+        glfwPollEvents();
+
+        // Nothing to render to while minimised.
+        if (window.width == 0 || window.height == 0) {
+            glfwWaitEvents();
+            continue;
         }
 
-        if (!has_mouse_set) {
-            glfwGetCursorPos(
-                window.window, &previous_mouse_x, &previous_mouse_y
+        if (window.resized &&
+            start_time - window.last_resize_time > RESIZE_SETTLE_TIME) {
+            recreate_swapchain(
+                window,
+                device,
+                allocator,
+                immediate,
+                frames,
+                render_pass,
+                swapchain,
+                framebuffers,
+                depth_buffer,
+                depth_buffer_view,
+                descriptor_sets
             );
-            has_mouse_set = true;
         }
 
-        if (should_follow_mouse) {
-            double mouse_x, mouse_y;
-            const auto mouse_sensitivity = 0.1;
-            glfwGetCursorPos(window.window, &mouse_x, &mouse_y);
-            camera.yaw += (mouse_x - previous_mouse_x) * mouse_sensitivity;
-            camera.pitch -= (previous_mouse_y - mouse_y) * mouse_sensitivity;
+        const float speed = 1.0;
+        const auto bob_rate = window.height * 0.00000025;
+        const auto bob_factor = time * 15.0;
+        auto should_update_time = false;
+        const auto move_direction = camera.direction;
+        // The benchmark follows a fixed path instead of the input, and there is
+        // nothing to take input from when headless.
+        if (benchmark) {
+            move_scripted_camera(camera, frames.frame_count);
+        } else if (!headless) {
+            PROFILE_ZONE("input");
+
+            if (glfwGetKey(window.window, GLFW_KEY_W)) {
+                camera.position += (float)delta_time * speed * move_direction;
 
-            if (camera.pitch > 89.0f) {
-                camera.pitch = 89.0f;
+                should_update_time = true;
             }
-            if (camera.pitch < -89.0f) {
-                camera.pitch = -89.0f;
+            if (glfwGetKey(window.window, GLFW_KEY_S)) {
+                camera.position -= (float)delta_time * speed * move_direction;
+
+                should_update_time = true;
             }
+            if (glfwGetKey(window.window, GLFW_KEY_A)) {
+                camera.position -= (float)delta_time * speed * camera.right;
 
-            camera.update_vectors();
-            previous_mouse_x = mouse_x;
-            previous_mouse_y = mouse_y;
+                should_update_time = true;
+            }
+            if (glfwGetKey(window.window, GLFW_KEY_D)) {
+                camera.position += (float)delta_time * speed * camera.right;
+
+                should_update_time = true;
+            }
+            if (glfwGetKey(window.window, GLFW_KEY_ESCAPE)) {
+                glfwSetInputMode(
+                    window.window, GLFW_CURSOR, GLFW_CURSOR_NORMAL
+                );
+                should_follow_mouse = false;
+            }
+            if (glfwGetMouseButton(window.window, GLFW_MOUSE_BUTTON_LEFT)) {
+                glfwSetInputMode(
+                    window.window, GLFW_CURSOR, GLFW_CURSOR_DISABLED
+                );
+                should_follow_mouse = true;
+                has_mouse_set = false;
+            }
+
+            if (!has_mouse_set) {
+                glfwGetCursorPos(
+                    window.window, &previous_mouse_x, &previous_mouse_y
+                );
+                has_mouse_set = true;
+            }
+
+            if (should_follow_mouse) {
+                double mouse_x, mouse_y;
+                const auto mouse_sensitivity = 0.1;
+                glfwGetCursorPos(window.window, &mouse_x, &mouse_y);
+                camera.yaw += (mouse_x - previous_mouse_x) * mouse_sensitivity;
+                camera.pitch -=
+                    (previous_mouse_y - mouse_y) * mouse_sensitivity;
+
+                if (camera.pitch > 89.0f) {
+                    camera.pitch = 89.0f;
+                }
+                if (camera.pitch < -89.0f) {
+                    camera.pitch = -89.0f;
+                }
+
+                camera.update_vectors();
+                previous_mouse_x = mouse_x;
+                previous_mouse_y = mouse_y;
+            }
         }
 
         ubo.camera_position = camera.position;
@@ -587,46 +1260,76 @@ int main(int p_argc, const char *const *const p_argv) try {
             100.0f
         );
 
-        vkWaitForFences(
-            device.logical, 1, &frame_fence.fence, VK_TRUE, UINT64_MAX
-        );
+        const auto frame_wait_start = clock_type::now();
+        auto &frame = frames.begin_frame();
+        const auto command_buffer = frame.command_buffer;
+        const auto frame_wait_time = milliseconds_since(frame_wait_start);
+        blocked_time += frame_wait_time;
 
-        uint32_t image_index;
-        auto result = vkAcquireNextImageKHR(
-            device.logical,
-            swapchain.swapchain,
-            UINT64_MAX,
-            image_available_semaphore.semaphore,
-            VK_NULL_HANDLE,
-            &image_index
+        // Eviction callbacks should retire what they evict through `frames`,
+        // so that it stays alive until the frames using it are done.
+        memory_budget.enforce(
+            frames.collected_value, frames.get_signal_value()
         );
+        memory_budget.touch(another_texture_budget_id);
+
+        // The last frame that used this context is done by now. It only
+        // counts towards the benchmark if it came after the warm-up as well.
+        const auto gpu_timings = gpu_profiler.collect(frame.index);
+        const auto pass_statistics = pipeline_statistics.collect(frame.index);
+        if (benchmark && frames.frame_count >= warmup_frames + frames.size()) {
+            add_gpu_timings(gpu_timings);
+            add_pass_statistics(pass_statistics);
+        }
 
-        if (result == VK_ERROR_OUT_OF_DATE_KHR) {
-            std::cout << "out of date frame.\n";
-            std::cout.flush();
-            // Make sure the device is done doing shit before we try to
-            // destroy the swapchain
-            vkDeviceWaitIdle(device.logical);
-            recreate_swapchain(
-                window,
-                device,
-                command_pool,
-                render_pass,
-                swapchain,
-                framebuffers,
-                depth_buffer,
-                depth_buffer_view,
-                depth_buffer_memory
+        const auto target_extent =
+            headless ? headless_extent.value() : swapchain.extent;
+        const auto animation_time =
+            headless || benchmark
+                ? static_cast<double>(frames.frame_count) * FIXED_FRAME_TIME
+                : glfwGetTime();
+
+        // Headless frames always render into the one offscreen target.
+        uint32_t image_index = 0;
+        auto acquire_time = 0.0;
+        if (!headless) {
+            PROFILE_ZONE("vkAcquireNextImageKHR");
+
+            const auto acquire_start = clock_type::now();
+            const auto result = vkAcquireNextImageKHR(
+                device.logical,
+                swapchain.swapchain,
+                UINT64_MAX,
+                frame.image_available_semaphore.semaphore,
+                VK_NULL_HANDLE,
+                &image_index
             );
 
-            continue;
-        } else if (result != VK_SUCCESS && result != VK_SUBOPTIMAL_KHR) {
-            throw mv::vulkan_exception{result};
-        }
-
-        vkResetFences(device.logical, 1, &frame_fence.fence);
+            if (result == VK_ERROR_OUT_OF_DATE_KHR) {
+                std::cout << "out of date frame.\n";
+                std::cout.flush();
+                recreate_swapchain(
+                    window,
+                    device,
+                    allocator,
+                    immediate,
+                    frames,
+                    render_pass,
+                    swapchain,
+                    framebuffers,
+                    depth_buffer,
+                    depth_buffer_view,
+                    descriptor_sets
+                );
+
+                continue;
+            } else if (result != VK_SUCCESS && result != VK_SUBOPTIMAL_KHR) {
+                throw mv::vulkan_exception{result};
+            }
 
-        vkResetCommandBuffer(command_buffer, 0);
+            acquire_time = milliseconds_since(acquire_start);
+            blocked_time += acquire_time;
+        }
 
         const VkCommandBufferBeginInfo begin_info{
             .sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO,
@@ -637,6 +1340,12 @@ int main(int p_argc, const char *const *const p_argv) try {
 
         VK_ERROR(vkBeginCommandBuffer(command_buffer, &begin_info));
 
+        gpu_profiler.begin_frame(command_buffer, frame.index);
+        gpu_profiler.begin_scope(command_buffer, "frame");
+        pipeline_statistics.begin_frame(command_buffer, frame.index);
+
+        mv::command_counters_t counters{};
+
         const VkClearValue clear_color{
             .color = {.float32 = {0.0f, 0.00f, 0.00f, 1.0f}},
         };
@@ -647,6 +1356,120 @@ int main(int p_argc, const char *const *const p_argv) try {
 
         const VkClearValue clear_values[]{clear_color, clear_depth};
 
+        uniform_ring.begin_frame(frame.index);
+
+        // The shadow pass writes its set again every frame, out of the
+        // frame's own pools. That's only a pointer bump, and begin_frame()
+        // throws them all away at once the next time around.
+        const auto shadow_descriptor_set =
+            frame.descriptors.allocate(shadow_descriptor_set_layout);
+        shadow_descriptor_set_layout.update(
+            shadow_descriptor_set, shadow_descriptors
+        );
+
+        const pass_t shadow_pass{
+            .pipeline = shadow_pipeline.pipeline,
+            .layout = shadow_pipeline.layout,
+            .descriptor_set = shadow_descriptor_set,
+            .texture_set = VK_NULL_HANDLE,
+            .dynamic_offset = uniform_ring.push(shadow_ubo),
+            .extent = {.width = SHADOW_SIZE, .height = SHADOW_SIZE},
+            .vertex_buffer = vertex_buffer.buffer.buffer,
+            .index_buffer = index_buffer.buffer.buffer,
+            .push_constants = std::nullopt,
+        };
+
+        const pass_t main_pass{
+            .pipeline = pipeline.pipeline,
+            .layout = pipeline.layout,
+            .descriptor_set =
+                descriptor_sets.get(descriptor_set_layout, main_descriptors),
+            .texture_set = textures.set,
+            .dynamic_offset = uniform_ring.push(ubo),
+            .extent = target_extent,
+            .vertex_buffer = vertex_buffer.buffer.buffer,
+            .index_buffer = index_buffer.buffer.buffer,
+            .push_constants =
+                push_constants_t{
+                    .t = static_cast<float>(animation_time),
+                },
+        };
+
+        const auto framebuffer = framebuffers.framebuffers.at(image_index);
+
+        const auto recording_start = std::chrono::steady_clock::now();
+
+        // Each worker records its slice of the draws for both passes, and the
+        // primary just strings them together.
+        std::vector<VkCommandBuffer> shadow_secondaries;
+        std::vector<VkCommandBuffer> main_secondaries;
+
+        if (threaded) {
+            PROFILE_ZONE("record_secondaries");
+
+            std::vector<std::future<void>> jobs;
+            std::vector<mv::command_counters_t> worker_counters(
+                recording_pool.size()
+            );
+
+            for (uint32_t i = 0; i < recording_pool.size(); i++) {
+                const auto first = draws.size() * i / recording_pool.size();
+                const auto last = draws.size() * (i + 1) / recording_pool.size();
+                if (first == last) {
+                    continue;
+                }
+
+                const std::span slice{draws.data() + first, last - first};
+                auto &worker = frame.workers.at(i);
+
+                const auto shadow_secondary =
+                    worker.get_secondary_command_buffer(0);
+                const auto main_secondary =
+                    worker.get_secondary_command_buffer(1);
+
+                shadow_secondaries.push_back(shadow_secondary);
+                main_secondaries.push_back(main_secondary);
+
+                jobs.push_back(recording_pool.submit([&,
+                                                      i,
+                                                      slice,
+                                                      shadow_secondary,
+                                                      main_secondary]() {
+                    record_secondary(
+                        shadow_secondary,
+                        shadow_render_pass.render_pass,
+                        shadow_framebuffer.framebuffer,
+                        shadow_pass,
+                        slice,
+                        pipeline_statistics.get_inherited_flags(),
+                        worker_counters[i]
+                    );
+
+                    record_secondary(
+                        main_secondary,
+                        render_pass.render_pass,
+                        framebuffer,
+                        main_pass,
+                        slice,
+                        pipeline_statistics.get_inherited_flags(),
+                        worker_counters[i]
+                    );
+                }));
+            }
+
+            for (auto &job : jobs) {
+                job.get();
+            }
+
+            for (const auto &c : worker_counters) {
+                counters += c;
+            }
+        }
+
+        const auto subpass_contents =
+            threaded ? VK_SUBPASS_CONTENTS_SECONDARY_COMMAND_BUFFERS
+                     : VK_SUBPASS_CONTENTS_INLINE;
+
         const VkRenderPassBeginInfo shadow_render_pass_begin_info{
             .sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO,
             .pNext = nullptr,
@@ -665,210 +1488,341 @@ int main(int p_argc, const char *const *const p_argv) try {
             .pClearValues = &clear_values[1],
         };
 
+        gpu_profiler.begin_scope(command_buffer, "shadow_pass");
+        pipeline_statistics.begin_pass(command_buffer, "shadow_pass");
         vkCmdBeginRenderPass(
-            command_buffer,
-            &shadow_render_pass_begin_info,
-            VK_SUBPASS_CONTENTS_INLINE
-        );
-
-        auto data = shadow_uniform_buffer.map_memory();
-        memcpy(data, &shadow_ubo, sizeof(shadow_ubo));
-        shadow_uniform_buffer.unmap_memory();
-
-        vkCmdBindPipeline(
-            command_buffer,
-            VK_PIPELINE_BIND_POINT_GRAPHICS,
-            shadow_pipeline.pipeline
-        );
-
-        vkCmdBindDescriptorSets(
-            command_buffer,
-            VK_PIPELINE_BIND_POINT_GRAPHICS,
-            shadow_pipeline.layout,
-            0,
-            1,
-            &shadow_descriptor_set,
-            0,
-            nullptr
+            command_buffer, &shadow_render_pass_begin_info, subpass_contents
         );
 
-        const VkViewport shadow_viewport{
-            .x = 0.0f,
-            .y = 0.0f,
-            .width = SHADOW_SIZE,
-            .height = SHADOW_SIZE,
-            .minDepth = 0.0f,
-            .maxDepth = 1.0f,
-        };
-
-        const VkRect2D shadow_scissor{
-            .offset = {0, 0},
-            .extent = {.width = SHADOW_SIZE, .height = SHADOW_SIZE},
-        };
-
-        vkCmdSetViewport(command_buffer, 0, 1, &shadow_viewport);
-        vkCmdSetScissor(command_buffer, 0, 1, &shadow_scissor);
-
-        const VkDeviceSize offset = 0;
-        vkCmdBindVertexBuffers(
-            command_buffer, 0, 1, &vertex_buffer.buffer.buffer, &offset
-        );
-
-        vkCmdBindIndexBuffer(
-            command_buffer, index_buffer.buffer.buffer, 0, VK_INDEX_TYPE_UINT32
-        );
-
-        vkCmdDrawIndexed(command_buffer, cube.indices.size(), 1, 0, 0, 1);
+        if (threaded) {
+            vkCmdExecuteCommands(
+                command_buffer,
+                static_cast<uint32_t>(shadow_secondaries.size()),
+                shadow_secondaries.data()
+            );
+        } else {
+            record_draws(command_buffer, shadow_pass, draws, counters);
+        }
 
         vkCmdEndRenderPass(command_buffer);
+        pipeline_statistics.end_pass(command_buffer);
+        gpu_profiler.end_scope(command_buffer);
 
         const VkRenderPassBeginInfo render_pass_begin_info{
             .sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO,
             .pNext = nullptr,
             .renderPass = render_pass.render_pass,
-            .framebuffer = framebuffers.framebuffers.at(image_index),
+            .framebuffer = framebuffer,
             .renderArea =
                 {
                     .offset = {0, 0},
-                    .extent = swapchain.extent,
+                    .extent = target_extent,
                 },
             .clearValueCount = 2,
             .pClearValues = clear_values,
         };
 
+        gpu_profiler.begin_scope(command_buffer, "main_pass");
+        pipeline_statistics.begin_pass(command_buffer, "main_pass");
         vkCmdBeginRenderPass(
-            command_buffer, &render_pass_begin_info, VK_SUBPASS_CONTENTS_INLINE
+            command_buffer, &render_pass_begin_info, subpass_contents
         );
 
-        vkCmdBindPipeline(
-            command_buffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipeline.pipeline
-        );
+        if (threaded) {
+            vkCmdExecuteCommands(
+                command_buffer,
+                static_cast<uint32_t>(main_secondaries.size()),
+                main_secondaries.data()
+            );
+        } else {
+            record_draws(command_buffer, main_pass, draws, counters);
+        }
 
-        data = uniform_buffer.map_memory();
-        memcpy(data, &ubo, sizeof ubo);
-        uniform_buffer.unmap_memory();
+        vkCmdEndRenderPass(command_buffer);
+        pipeline_statistics.end_pass(command_buffer);
+        gpu_profiler.end_scope(command_buffer);
 
-        vkCmdBindDescriptorSets(
-            command_buffer,
-            VK_PIPELINE_BIND_POINT_GRAPHICS,
-            pipeline.layout,
-            0,
-            1,
-            &descriptor_set,
-            0,
-            nullptr
-        );
+        gpu_profiler.end_scope(command_buffer);
 
-        const VkViewport viewport{
-            .x = 0.0f,
-            .y = 0.0f,
-            .width = static_cast<float>(swapchain.extent.width),
-            .height = static_cast<float>(swapchain.extent.height),
-            .minDepth = 0.0f,
-            .maxDepth = 1.0f,
-        };
+        VK_ERROR(vkEndCommandBuffer(command_buffer));
 
-        const VkRect2D scissor{
-            .offset = {0, 0},
-            .extent = swapchain.extent,
+        recording_time += std::chrono::duration<double>(
+                              std::chrono::steady_clock::now() - recording_start
+        )
+                              .count();
+
+        // Headless frames have no image to wait for and nothing to present,
+        // so they only signal the frame timeline.
+        const std::array image_available_waits{mv::semaphore_wait_t{
+            .semaphore = frame.image_available_semaphore.semaphore,
+            .value = 0,
+            .stage_mask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT,
+        }};
+        const std::array signals{
+            mv::semaphore_signal_t{
+                .semaphore = frames.timeline.semaphore,
+                .value = frames.get_signal_value(),
+            },
+            mv::semaphore_signal_t{
+                .semaphore = frame.render_done_semaphore.semaphore,
+                .value = 0,
+            },
         };
 
-        vkCmdSetViewport(command_buffer, 0, 1, &viewport);
-        vkCmdSetScissor(command_buffer, 0, 1, &scissor);
-
-        vkCmdBindVertexBuffers(
-            command_buffer, 0, 1, &vertex_buffer.buffer.buffer, &offset
+        const auto submit_start = clock_type::now();
+        mv::submit(
+            device.graphics_queue,
+            std::array{command_buffer},
+            std::span{image_available_waits}.first(headless ? 0 : 1),
+            std::span{signals}.first(headless ? 1 : 2)
         );
+        const auto submit_time = milliseconds_since(submit_start);
 
-        vkCmdBindIndexBuffer(
-            command_buffer, index_buffer.buffer.buffer, 0, VK_INDEX_TYPE_UINT32
-        );
+        frames.end_frame();
 
-        const push_constants_t push_constants{
-            .t = static_cast<float>(glfwGetTime()),
-        };
+        auto present_time = 0.0;
+        if (!headless) {
+            PROFILE_ZONE("vkQueuePresentKHR");
 
-        vkCmdPushConstants(
-            command_buffer,
-            pipeline.layout,
-            VK_SHADER_STAGE_FRAGMENT_BIT,
-            0,
-            sizeof(push_constants_t),
-            &push_constants
-        );
+            const VkPresentInfoKHR present_info{
+                .sType = VK_STRUCTURE_TYPE_PRESENT_INFO_KHR,
+                .pNext = nullptr,
+                .waitSemaphoreCount = 1,
+                .pWaitSemaphores = &frame.render_done_semaphore.semaphore,
+                .swapchainCount = 1,
+                .pSwapchains = &swapchain.swapchain,
+                .pImageIndices = &image_index,
+                .pResults = nullptr,
+            };
+
+            const auto present_start = clock_type::now();
+            const auto result =
+                vkQueuePresentKHR(device.present_queue, &present_info);
+            present_time = milliseconds_since(present_start);
+            blocked_time += present_time;
+
+            if (result == VK_SUBOPTIMAL_KHR) {
+                // Still presentable, so it can wait for the resize to settle.
+                window.resized = true;
+            } else if (result == VK_ERROR_OUT_OF_DATE_KHR) {
+                std::cout << "second out of date frame.\n";
+                std::cout.flush();
+
+                recreate_swapchain(
+                    window,
+                    device,
+                    allocator,
+                    immediate,
+                    frames,
+                    render_pass,
+                    swapchain,
+                    framebuffers,
+                    depth_buffer,
+                    depth_buffer_view,
+                    descriptor_sets
+                );
+            } else if (result != VK_SUCCESS) {
+                throw mv::vulkan_exception{result};
+            }
+        }
 
-        // vkCmdDraw(command_buffer, 3, 1, 0, 0);
-        vkCmdDrawIndexed(command_buffer, cube.indices.size(), 1, 0, 0, 1);
+        const auto end_time = glfwGetTime();
+        delta_time = end_time - start_time;
+        total_time += delta_time;
 
-        vkCmdEndRenderPass(command_buffer);
-        VK_ERROR(vkEndCommandBuffer(command_buffer));
+        total_counters += counters;
 
-        const VkPipelineStageFlags wait_stage =
-            VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
+        if (measuring) {
+            // Nothing in the frame goes through barrier_builder_t, since the
+            // render passes' dependencies take care of it, so there's no
+            // series for barriers.
+            report.count("draws", static_cast<double>(counters.draws));
+            report.count(
+                "pipeline_binds", static_cast<double>(counters.pipeline_binds)
+            );
+            report.count(
+                "descriptor_set_binds",
+                static_cast<double>(counters.descriptor_set_binds)
+            );
 
-        const VkSubmitInfo submit_info{
-            .sType = VK_STRUCTURE_TYPE_SUBMIT_INFO,
-            .pNext = nullptr,
-            .waitSemaphoreCount = 1,
-            .pWaitSemaphores = &image_available_semaphore.semaphore,
-            .pWaitDstStageMask = &wait_stage,
-            .commandBufferCount = 1,
-            .pCommandBuffers = &command_buffer,
-            .signalSemaphoreCount = 1,
-            .pSignalSemaphores = &render_done_semaphore.semaphore,
-        };
+            report.add("frame_ms", delta_time * 1000.0);
+            report.add("cpu_frame_ms", delta_time * 1000.0 - blocked_time);
+            report.add("frame_wait_ms", frame_wait_time);
+            if (!headless) {
+                report.add("acquire_ms", acquire_time);
+            }
+            report.add("submit_ms", submit_time);
+            if (!headless) {
+                report.add("present_ms", present_time);
+            }
+        }
+    }
 
-        VK_ERROR(vkQueueSubmit(
-            device.graphics_queue, 1, &submit_info, frame_fence.fence
-        ));
+    vkDeviceWaitIdle(device.logical);
 
-        const VkPresentInfoKHR present_info{
-            .sType = VK_STRUCTURE_TYPE_PRESENT_INFO_KHR,
-            .pNext = nullptr,
-            .waitSemaphoreCount = 1,
-            .pWaitSemaphores = &render_done_semaphore.semaphore,
-            .swapchainCount = 1,
-            .pSwapchains = &swapchain.swapchain,
-            .pImageIndices = &image_index,
-            .pResults = nullptr,
-        };
+    pipeline_cache.save();
 
-        result = vkQueuePresentKHR(device.present_queue, &present_info);
+    if (headless && screenshot_path != nullptr && frames.frame_count > 0) {
+        save_screenshot(
+            device, allocator, immediate, offscreen, screenshot_path
+        );
+    }
 
-        if (result == VK_ERROR_OUT_OF_DATE_KHR || result == VK_SUBOPTIMAL_KHR) {
-            std::cout << "second out of date frame.\n";
-            std::cout.flush();
-            // Make sure the device is done doing shit before we try to
-            // destroy the swapchain
-            vkDeviceWaitIdle(device.logical);
+    // Run with --frames-in-flight 1 to see what waiting on every frame costs.
+    if (frames.frame_count > 0) {
+        std::cout << "[INFO]: " << frames.frame_count << " frames with "
+                  << frames.size() << " in flight spent "
+                  << frames.fence_wait_time * 1000.0
+                  << " ms waiting on the GPU ("
+                  << frames.get_average_fence_wait_time() * 1000.0
+                  << " ms per frame, "
+                  << frames.fence_wait_time / total_time * 100.0
+                  << "% of the frame time).\n";
+
+        std::cout << "[INFO]: Recording " << draws.size() << " draws per pass on "
+                  << recording_pool.size() << " thread(s) took "
+                  << recording_time * 1000.0 /
+                         static_cast<double>(frames.frame_count)
+                  << " ms per frame.\n";
+
+        if (limiter.is_enabled()) {
+            std::cout << "[INFO]: The frame limiter held each frame back by "
+                      << limiter.wait_time * 1000.0 /
+                             static_cast<double>(frames.frame_count)
+                      << " ms on average.\n";
+        }
 
-            recreate_swapchain(
-                window,
-                device,
-                command_pool,
-                render_pass,
-                swapchain,
-                framebuffers,
-                depth_buffer,
-                depth_buffer_view,
-                depth_buffer_memory
-            );
-        } else if (result != VK_SUCCESS) {
-            throw mv::vulkan_exception{result};
+        // Everything's idle, so the frames still in flight can be read too.
+        for (uint32_t i = 0; i < frames.size(); i++) {
+            const auto gpu_timings = gpu_profiler.collect(i);
+            const auto pass_statistics = pipeline_statistics.collect(i);
+            if (benchmark &&
+                frames.frame_count >= warmup_frames + frames.size()) {
+                add_gpu_timings(gpu_timings);
+                add_pass_statistics(pass_statistics);
+            }
         }
 
-        glfwPollEvents();
+        for (const auto &result : gpu_profiler.get_results()) {
+            std::cout << "[INFO]: GPU " << std::string(result.depth * 2, ' ')
+                      << result.name << ": " << result.average
+                      << " ms on average over up to the last "
+                      << mv::gpu_profiler_t::AVERAGE_WINDOW << " frames.\n";
+        }
 
-        const auto end_time = glfwGetTime();
-        delta_time = end_time - start_time;
+        for (const auto &pass : pipeline_statistics.latest) {
+            const auto &values = pass.values;
+            std::cout << "[INFO]: " << pass.name << " took "
+                      << values.input_vertices << " vertices and "
+                      << values.input_primitives << " primitives in, ran "
+                      << values.vertex_invocations << " vertex and "
+                      << values.fragment_invocations
+                      << " fragment invocations, and kept "
+                      << values.clipping_primitives
+                      << " primitives after clipping.\n";
+        }
+
+        if (memory_budget.eviction_count > 0) {
+            std::cout << "[INFO]: Evicted " << memory_budget.eviction_count
+                      << " resource(s) ("
+                      << static_cast<double>(memory_budget.evicted_bytes) /
+                             (1024.0 * 1024.0)
+                      << " MiB) to stay under " << high_water_mark
+                      << "% of the memory budget.\n";
+        }
+
+        const auto frame_count = static_cast<double>(frames.frame_count);
+        std::cout << "[INFO]: Each frame recorded "
+                  << static_cast<double>(total_counters.draws) / frame_count
+                  << " draws, "
+                  << static_cast<double>(total_counters.pipeline_binds) /
+                         frame_count
+                  << " pipeline binds, "
+                  << static_cast<double>(total_counters.descriptor_set_binds) /
+                         frame_count
+                  << " descriptor set binds and "
+                  << static_cast<double>(total_counters.barriers) / frame_count
+                  << " barriers on average.\n";
     }
 
-    vkDeviceWaitIdle(device.logical);
+    std::cout << "[INFO]: Descriptor set cache: " << descriptor_sets.hits
+              << " hit(s) and " << descriptor_sets.misses << " miss(es), with "
+              << descriptors.get_pool_count() << " descriptor pool(s).\n";
+
+    if (trace_path != nullptr) {
+#ifdef MV_PROFILE
+        mv::write_chrome_trace(trace_path);
+        std::cout << "[INFO]: Wrote the CPU trace to " << trace_path << ".\n";
+#else
+        std::cerr << "[ERROR]: --trace needs a build with MV_PROFILE on.\n";
+#endif
+    }
+
+    if (benchmark && frames.frame_count > warmup_frames) {
+        const auto extent =
+            headless ? headless_extent.value() : swapchain.extent;
+
+        report.set("device", device.properties.deviceName);
+        report.set("width", extent.width);
+        report.set("height", extent.height);
+        report.set(
+            "present_mode",
+            headless ? "offscreen"
+                     : mv::get_present_mode_name(swapchain.present_mode)
+        );
+        report.set("frames_in_flight", frames.size());
+        report.set("pipeline_cache_loaded", pipeline_cache.loaded ? 1.0 : 0.0);
+        report.set("pipeline_creation_ms", pipeline_creation_time);
+        report.set("pipeline_build_ms", pipelines.get_build_milliseconds());
+        report.set("pipeline_wait_ms", pipeline_wait_time);
+        report.set("shader_module_hits", shader_modules.hits);
+        report.set("shader_module_misses", shader_modules.misses);
+        report.set("descriptor_set_misses", descriptor_sets.misses);
+        report.set("shadows", lighting.shadows ? 1.0 : 0.0);
+        report.set("pcf_size", lighting.pcf_size);
+        report.set("pipeline_creation_cold_ms", cold_pipeline_creation_time);
+        report.set("pipeline_creation_warm_ms", warm_pipeline_creation_time);
+        report.set("pipeline_creation_cold_wall_ms", cold_pipeline_wall_time);
+        report.set("pipeline_creation_warm_wall_ms", warm_pipeline_wall_time);
+        report.set("threads", recording_pool.size());
+        report.set("cubes", extra_cubes);
+        report.set("warmup_frames", static_cast<double>(warmup_frames));
+        report.set(
+            "frames", static_cast<double>(frames.frame_count - warmup_frames)
+        );
+
+        if (json_path != nullptr) {
+            std::ofstream file{json_path};
+            if (!file.is_open()) {
+                throw mv::file_exception(
+                    mv::file_exception::type_t::open, json_path
+                );
+            }
+
+            report.write_json(file);
+            std::cout << "[INFO]: Wrote the benchmark results to " << json_path
+                      << ".\n";
+        } else {
+            report.write_json(results);
+            results.flush();
+        }
+
+        if (baseline_path != nullptr) {
+            const auto baseline =
+                mv::benchmark_report_t::read_summaries(baseline_path);
+            if (!report.compare(baseline, tolerance, std::cout)) {
+                std::cerr << "[ERROR]: Slower than " << baseline_path
+                          << " by more than " << tolerance * 100.0 << "%.\n";
+                return EXIT_FAILURE;
+            }
+        }
+    }
 } catch (const mv::vulkan_exception &e) {
     std::cerr << "[ERROR]: Vulkan error " << e.error_code << '\n';
     return EXIT_FAILURE;
 } catch (const mv::file_exception &e) {
     std::cerr << "[ERROR]: Failed to " << e.type << " " << e.file_name << '\n';
+    return EXIT_FAILURE;
 } catch (const std::exception &e) {
     std::cerr << "[ERROR]: Failed to " << e.what() << '\n';
     return EXIT_FAILURE;
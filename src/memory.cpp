@@ -1,49 +1,430 @@
+#include <algorithm>
+#include <bit>
+
+#include "errors.hpp"
+
 #include "memory.hpp"
 
-auto mv::vulkan_memory_t::allocate(
-    const vulkan_device_t &device,
-    std::span<const VkMemoryRequirements> requirements,
-    VkMemoryPropertyFlags property_flags
-) -> vulkan_memory_t {
-    VkDeviceSize total_size = 0;
-    for (const auto &req : requirements) {
-        const auto offset = (total_size / req.alignment + 1) * req.alignment;
-        total_size = req.size + offset;
+namespace mv {
+
+namespace {
+auto get_order(VkDeviceSize size) -> uint32_t {
+    const auto node_size =
+        std::bit_ceil(std::max(size, memory_block_t::MIN_NODE_SIZE));
+    return static_cast<uint32_t>(
+        std::countr_zero(node_size / memory_block_t::MIN_NODE_SIZE)
+    );
+}
+
+// Maps the whole of `memory`, and frees it if that fails so that it doesn't
+// leak on the way out.
+auto map_or_free(
+    const vulkan_device_t &device, VkDeviceMemory memory, void **mapped
+) -> void {
+    const auto result =
+        vkMapMemory(device.logical, memory, 0, VK_WHOLE_SIZE, 0, mapped);
+    if (result != VK_SUCCESS) {
+        vkFreeMemory(device.logical, memory, nullptr);
+        std::cerr << "[ERROR]: vkMapMemory failed.\n";
+        throw vulkan_exception{result};
+    }
+}
+} // namespace
+
+auto vulkan_memory_t::bind_buffer(VkBuffer buffer) const -> void {
+    VK_ERROR(
+        vkBindBufferMemory(allocator->device.logical, buffer, memory, offset)
+    );
+}
+
+auto vulkan_memory_t::bind_image(VkImage image) const -> void {
+    VK_ERROR(
+        vkBindImageMemory(allocator->device.logical, image, memory, offset)
+    );
+}
+
+vulkan_memory_t::~vulkan_memory_t() {
+    if (allocator != nullptr && memory != VK_NULL_HANDLE) {
+        allocator->free(*this);
+    }
+}
+
+auto memory_block_t::allocate(uint32_t order) -> std::optional<VkDeviceSize> {
+    // Find the smallest free node that is big enough
+    auto found_order = order;
+    while (found_order <= max_order() && free_lists[found_order].empty()) {
+        found_order++;
+    }
+
+    if (found_order > max_order()) {
+        return std::nullopt;
+    }
+
+    const auto offset = *free_lists[found_order].begin();
+    free_lists[found_order].erase(free_lists[found_order].begin());
+
+    // Split it down until it's the right size, putting the upper halves back
+    // on the free lists.
+    while (found_order > order) {
+        found_order--;
+        free_lists[found_order].insert(
+            offset + (MIN_NODE_SIZE << found_order)
+        );
+    }
+
+    used += MIN_NODE_SIZE << order;
+    allocation_count++;
+
+    return offset;
+}
+
+auto memory_block_t::free(VkDeviceSize offset, uint32_t order) -> void {
+    used -= MIN_NODE_SIZE << order;
+    allocation_count--;
+
+    // Merge with the buddy for as long as the buddy is free as well.
+    while (order < max_order()) {
+        const auto buddy = offset ^ (MIN_NODE_SIZE << order);
+        const auto it = free_lists[order].find(buddy);
+        if (it == free_lists[order].end()) {
+            break;
+        }
+
+        free_lists[order].erase(it);
+        offset = std::min(offset, buddy);
+        order++;
+    }
+
+    free_lists[order].insert(offset);
+}
+
+auto memory_block_t::get_largest_free_size() const -> VkDeviceSize {
+    for (auto order = max_order() + 1; order > 0; order--) {
+        if (!free_lists[order - 1].empty()) {
+            return MIN_NODE_SIZE << (order - 1);
+        }
     }
 
+    return 0;
+}
+
+memory_allocator_t::memory_allocator_t(
+    const vulkan_device_t &p_device, VkDeviceSize p_block_size
+)
+    : device(p_device),
+      block_size(std::bit_ceil(
+          std::max(p_block_size, memory_block_t::MIN_NODE_SIZE)
+      )),
+      buffer_image_granularity(
+          p_device.properties.limits.bufferImageGranularity
+      ),
+      heaps(p_device.memory_properties.memoryHeapCount) {}
+
+auto memory_allocator_t::create(
+    const vulkan_device_t &device, VkDeviceSize block_size
+) -> memory_allocator_t {
+    return memory_allocator_t{device, block_size};
+}
+
+auto memory_allocator_t::create_block(uint32_t memory_type_index, bool linear)
+    -> memory_block_t & {
     const VkMemoryAllocateInfo allocate_info{
         .sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO,
         .pNext = nullptr,
-        .allocationSize = total_size,
-        .memoryTypeIndex = get_memory_type_index(
-            device, requirements[0].memoryTypeBits, property_flags
-        ),
+        .allocationSize = block_size,
+        .memoryTypeIndex = memory_type_index,
     };
 
     VkDeviceMemory memory;
-    const auto result =
-        vkAllocateMemory(device.logical, &allocate_info, nullptr, &memory);
+    VK_ERROR(vkAllocateMemory(device.logical, &allocate_info, nullptr, &memory)
+    );
 
-    if (result != VK_SUCCESS) {
-        throw vulkan_exception{result};
+    void *mapped = nullptr;
+    if (device.memory_properties.memoryTypes[memory_type_index].propertyFlags &
+        VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT) {
+        map_or_free(device, memory, &mapped);
+    }
+
+    auto block = std::make_unique<memory_block_t>(memory_block_t{
+        .memory = memory,
+        .size = block_size,
+        .memory_type_index = memory_type_index,
+        .linear = linear,
+        .mapped = mapped,
+        .used = 0,
+        .allocation_count = 0,
+        .free_lists =
+            std::vector<std::set<VkDeviceSize>>(get_order(block_size) + 1),
+    });
+
+    // The whole block starts off as a single free node.
+    block->free_lists[block->max_order()].insert(0);
+
+    const auto heap_index =
+        device.memory_properties.memoryTypes[memory_type_index].heapIndex;
+    heaps[heap_index].allocated += block_size;
+
+    blocks.push_back(std::move(block));
+    return *blocks.back();
+}
+
+auto memory_allocator_t::allocate(
+    VkMemoryRequirements requirements,
+    VkMemoryPropertyFlags property_flags,
+    bool linear,
+    memory_category_t category
+) -> vulkan_memory_t {
+    const auto memory_type_index = get_memory_type_index(
+        device, requirements.memoryTypeBits, property_flags
+    );
+
+    // Nodes are aligned to their own size, so asking for a node at least as big
+    // as the alignment takes care of that. If the granularity is bigger than
+    // the smallest node, linear and optimal resources could end up on the same
+    // page, so they get blocks of their own.
+    const auto order =
+        get_order(std::max(requirements.size, requirements.alignment));
+    const auto segregate =
+        buffer_image_granularity > memory_block_t::MIN_NODE_SIZE;
+    linear = segregate && linear;
+
+    const auto host_visible =
+        (device.memory_properties.memoryTypes[memory_type_index].propertyFlags &
+         VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT) != 0;
+
+    std::lock_guard lock{mutex};
+
+    vulkan_memory_t allocation{};
+    allocation.allocator = this;
+    allocation.size = requirements.size;
+    allocation.heap_index =
+        device.memory_properties.memoryTypes[memory_type_index].heapIndex;
+    allocation.category = category;
+
+    // Only counted once the memory has actually been found, since anything
+    // below can throw.
+    auto &heap = heaps[allocation.heap_index];
+    auto &category_usage = heap.categories[static_cast<size_t>(category)];
+
+    if ((memory_block_t::MIN_NODE_SIZE << order) > block_size) {
+        // Too big for a block, so it gets an allocation of its own.
+        const VkMemoryAllocateInfo allocate_info{
+            .sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO,
+            .pNext = nullptr,
+            .allocationSize = requirements.size,
+            .memoryTypeIndex = memory_type_index,
+        };
+
+        VkDeviceMemory memory;
+        VK_ERROR(
+            vkAllocateMemory(device.logical, &allocate_info, nullptr, &memory)
+        );
+
+        void *mapped = nullptr;
+        if (host_visible) {
+            map_or_free(device, memory, &mapped);
+        }
+
+        allocation.memory = memory;
+        allocation.mapped = mapped;
+
+        dedicated_allocation_count++;
+        dedicated_bytes += requirements.size;
+        heap.allocated += requirements.size;
+        category_usage += requirements.size;
+
+        return allocation;
+    }
+
+    for (const auto &block : blocks) {
+        if (block->memory_type_index != memory_type_index ||
+            block->linear != linear) {
+            continue;
+        }
+
+        const auto offset = block->allocate(order);
+        if (offset.has_value()) {
+            allocation.block = block.get();
+            allocation.order = order;
+            allocation.memory = block->memory;
+            allocation.offset = offset.value();
+            if (block->mapped != nullptr) {
+                allocation.mapped =
+                    static_cast<std::byte *>(block->mapped) + offset.value();
+            }
+
+            category_usage += requirements.size;
+            return allocation;
+        }
+    }
+
+    auto &block = create_block(memory_type_index, linear);
+    const auto offset = block.allocate(order).value();
+
+    allocation.block = &block;
+    allocation.order = order;
+    allocation.memory = block.memory;
+    allocation.offset = offset;
+    if (block.mapped != nullptr) {
+        allocation.mapped = static_cast<std::byte *>(block.mapped) + offset;
+    }
+
+    category_usage += requirements.size;
+    return allocation;
+}
+
+auto memory_allocator_t::free(vulkan_memory_t &memory) -> void {
+    std::lock_guard lock{mutex};
+
+    auto &heap = heaps[memory.heap_index];
+    heap.categories[static_cast<size_t>(memory.category)] -= memory.size;
+
+    if (memory.block == nullptr) {
+        vkFreeMemory(device.logical, memory.memory, nullptr);
+        dedicated_allocation_count--;
+        dedicated_bytes -= memory.size;
+        heap.allocated -= memory.size;
+    } else {
+        auto block = memory.block;
+        block->free(memory.offset, memory.order);
+
+        // Hang on to one empty block per memory type so that something that
+        // gets freed and reallocated every frame doesn't hit vkAllocateMemory
+        // every time.
+        if (block->allocation_count == 0) {
+            const auto has_other_empty_block = std::any_of(
+                blocks.begin(),
+                blocks.end(),
+                [&](const auto &other) {
+                    return other.get() != block &&
+                           other->memory_type_index ==
+                               block->memory_type_index &&
+                           other->linear == block->linear &&
+                           other->allocation_count == 0;
+                }
+            );
+
+            if (has_other_empty_block) {
+                vkFreeMemory(device.logical, block->memory, nullptr);
+                heap.allocated -= block->size;
+                std::erase_if(blocks, [&](const auto &other) {
+                    return other.get() == block;
+                });
+            }
+        }
+    }
+
+    memory.memory = VK_NULL_HANDLE;
+    memory.mapped = nullptr;
+    memory.block = nullptr;
+}
+
+auto memory_allocator_t::get_statistics() const -> statistics_t {
+    std::lock_guard lock{mutex};
+
+    statistics_t statistics{
+        .blocks = {},
+        .dedicated_allocation_count = dedicated_allocation_count,
+        .dedicated_bytes = dedicated_bytes,
+    };
+
+    for (const auto &block : blocks) {
+        statistics.blocks.push_back({
+            .memory_type_index = block->memory_type_index,
+            .linear = block->linear,
+            .size = block->size,
+            .used = block->used,
+            .largest_free = block->get_largest_free_size(),
+            .allocation_count = block->allocation_count,
+        });
+    }
+
+    return statistics;
+}
+
+auto memory_allocator_t::get_heap_budgets() const
+    -> std::vector<heap_budget_t> {
+    const auto &memory_properties = device.memory_properties;
+
+    VkPhysicalDeviceMemoryBudgetPropertiesEXT budget_properties{};
+    budget_properties.sType =
+        VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_MEMORY_BUDGET_PROPERTIES_EXT;
+
+    if (device.memory_budget) {
+        VkPhysicalDeviceMemoryProperties2 properties{};
+        properties.sType =
+            VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_MEMORY_PROPERTIES_2;
+        properties.pNext = &budget_properties;
+
+        vkGetPhysicalDeviceMemoryProperties2(device.physical, &properties);
+    }
+
+    std::lock_guard lock{mutex};
+
+    std::vector<heap_budget_t> budgets;
+    budgets.reserve(memory_properties.memoryHeapCount);
+
+    for (uint32_t i = 0; i < memory_properties.memoryHeapCount; i++) {
+        const auto &heap = memory_properties.memoryHeaps[i];
+
+        budgets.push_back({
+            .heap_index = i,
+            .device_local =
+                (heap.flags & VK_MEMORY_HEAP_DEVICE_LOCAL_BIT) != 0,
+            .size = heap.size,
+            .budget = device.memory_budget
+                          ? budget_properties.heapBudget[i]
+                          : static_cast<VkDeviceSize>(
+                                static_cast<double>(heap.size) *
+                                DEFAULT_BUDGET_FRACTION
+                            ),
+            .usage = device.memory_budget ? budget_properties.heapUsage[i]
+                                          : heaps[i].allocated,
+            .allocator_usage = heaps[i],
+        });
+    }
+
+    return budgets;
+}
+
+memory_allocator_t::~memory_allocator_t() {
+    for (const auto &block : blocks) {
+        vkFreeMemory(device.logical, block->memory, nullptr);
     }
+}
 
-    return {memory, total_size, device};
+auto get_memory_category_name(memory_category_t category) -> std::string_view {
+    switch (category) {
+    case memory_category_t::textures:
+        return "textures";
+    case memory_category_t::geometry:
+        return "geometry";
+    case memory_category_t::attachments:
+        return "attachments";
+    case memory_category_t::staging:
+        return "staging";
+    case memory_category_t::uniforms:
+        return "uniforms";
+    case memory_category_t::other:
+        return "other";
+    }
+
+    return "unknown";
 }
 
-auto mv::get_memory_type_index(
+auto get_memory_type_index(
     const vulkan_device_t &device,
     uint32_t type_bits,
     VkMemoryPropertyFlags property_flags
 ) -> uint32_t {
-    VkPhysicalDeviceMemoryProperties memory_properties;
-    vkGetPhysicalDeviceMemoryProperties(device.physical, &memory_properties);
+    const auto &memory_properties = device.memory_properties;
 
     for (uint32_t i = 0; i < memory_properties.memoryTypeCount; i++) {
         const auto has_type_bit = (type_bits & (1 << i)) != 0;
 
         const auto has_property_flags =
-            (property_flags & property_flags) == property_flags;
+            (memory_properties.memoryTypes[i].propertyFlags & property_flags) ==
+            property_flags;
 
         if (has_type_bit && has_property_flags) {
             return i;
@@ -52,3 +433,5 @@ auto mv::get_memory_type_index(
 
     throw no_adequate_memory_type_exception{};
 }
+
+} // namespace mv
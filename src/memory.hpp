@@ -1,62 +1,225 @@
 #pragma once
 
-#include "images.hpp"
+#include <array>
+#include <memory>
+#include <mutex>
+#include <set>
+#include <string_view>
+
+#include <vulkan/vulkan.h>
+
+#include "common.hpp"
+#include "device.hpp"
 
 namespace mv {
+struct memory_allocator_t;
+struct memory_block_t;
+
+// What an allocation is for, so that the allocator can say where the memory
+// went.
+enum class memory_category_t {
+    textures,
+    geometry,
+    attachments,
+    staging,
+    uniforms,
+    other,
+};
 
+constexpr size_t MEMORY_CATEGORY_COUNT =
+    static_cast<size_t>(memory_category_t::other) + 1;
+
+auto get_memory_category_name(memory_category_t category) -> std::string_view;
+
+// A sub-allocation out of one of the allocator's blocks (or a dedicated
+// allocation, if it was too big to fit in a block). Hands the memory back to
+// the allocator when destroyed.
 struct vulkan_memory_t {
-    VkDeviceMemory memory;
-    VkDeviceSize size;
-    VkDeviceSize bind_offset{0};
+    VkDeviceMemory memory{VK_NULL_HANDLE};
+    VkDeviceSize offset{0};
+    VkDeviceSize size{0};
 
-    const vulkan_device_t *device;
+    // Points into the persistent mapping for host visible memory, and is null
+    // for everything else.
+    void *mapped{nullptr};
 
-    vulkan_memory_t(
-        VkDeviceMemory p_memory,
-        VkDeviceSize p_size,
-        const vulkan_device_t &p_device
-    )
-        : memory(p_memory), size(p_size), device(&p_device) {}
+    memory_allocator_t *allocator{nullptr};
 
-    static auto allocate(
-        const vulkan_device_t &device,
-        std::span<const VkMemoryRequirements> requirements,
-        VkMemoryPropertyFlags property_flags
-    ) -> vulkan_memory_t;
+    // Null for dedicated allocations.
+    memory_block_t *block{nullptr};
+    uint32_t order{0};
 
-    inline auto
-    bind_image(const vulkan_image_t &image, VkMemoryRequirements requirements)
-        -> void {
-        const auto offset_factor = bind_offset / requirements.alignment;
-        bind_offset = (offset_factor + 1) * requirements.alignment;
-        vkBindImageMemory(device->logical, image.image, memory, bind_offset);
-        bind_offset += requirements.size;
-    }
+    uint32_t heap_index{0};
+    memory_category_t category{memory_category_t::other};
+
+    vulkan_memory_t() = default;
 
     NO_COPY(vulkan_memory_t);
 
-    inline vulkan_memory_t(vulkan_memory_t &&other) {
+    inline vulkan_memory_t(vulkan_memory_t &&other) noexcept {
         memory = other.memory;
+        offset = other.offset;
         size = other.size;
-        device = other.device;
+        mapped = other.mapped;
+        allocator = other.allocator;
+        block = other.block;
+        order = other.order;
+        heap_index = other.heap_index;
+        category = other.category;
 
         other.memory = VK_NULL_HANDLE;
+        other.offset = 0;
         other.size = 0;
-        other.device = nullptr;
+        other.mapped = nullptr;
+        other.allocator = nullptr;
+        other.block = nullptr;
+        other.order = 0;
     }
 
-    inline auto operator=(vulkan_memory_t&& other) -> vulkan_memory_t& {
+    inline auto operator=(vulkan_memory_t &&other) noexcept
+        -> vulkan_memory_t & {
         std::swap(memory, other.memory);
+        std::swap(offset, other.offset);
         std::swap(size, other.size);
-        std::swap(device, other.device);
+        std::swap(mapped, other.mapped);
+        std::swap(allocator, other.allocator);
+        std::swap(block, other.block);
+        std::swap(order, other.order);
+        std::swap(heap_index, other.heap_index);
+        std::swap(category, other.category);
 
         return *this;
     }
 
-    inline ~vulkan_memory_t() {
-        if (device != nullptr && memory != VK_NULL_HANDLE)
-            vkFreeMemory(device->logical, memory, nullptr);
+    auto bind_buffer(VkBuffer buffer) const -> void;
+    auto bind_image(VkImage image) const -> void;
+
+    ~vulkan_memory_t();
+};
+
+// One big VkDeviceMemory that gets carved up with a buddy allocator. A node of
+// order k is MIN_NODE_SIZE << k bytes, and is always aligned to its own size.
+struct memory_block_t {
+    static constexpr VkDeviceSize MIN_NODE_SIZE = 256;
+
+    VkDeviceMemory memory;
+    VkDeviceSize size;
+    uint32_t memory_type_index;
+
+    // Whether this block holds linear resources (buffers) or optimal ones
+    // (images). Only matters when the two have to be kept apart to respect
+    // bufferImageGranularity.
+    bool linear;
+
+    void *mapped;
+
+    VkDeviceSize used{0};
+    uint32_t allocation_count{0};
+
+    // The offsets of the free nodes, one set per order.
+    std::vector<std::set<VkDeviceSize>> free_lists;
+
+    auto max_order() const -> uint32_t {
+        return static_cast<uint32_t>(free_lists.size() - 1);
     }
+
+    auto allocate(uint32_t order) -> std::optional<VkDeviceSize>;
+    auto free(VkDeviceSize offset, uint32_t order) -> void;
+
+    auto get_largest_free_size() const -> VkDeviceSize;
+};
+
+struct memory_allocator_t {
+    static constexpr VkDeviceSize DEFAULT_BLOCK_SIZE = 64 * 1024 * 1024;
+
+    struct block_statistics_t {
+        uint32_t memory_type_index;
+        bool linear;
+        VkDeviceSize size;
+        VkDeviceSize used;
+        VkDeviceSize largest_free;
+        uint32_t allocation_count;
+    };
+
+    struct statistics_t {
+        std::vector<block_statistics_t> blocks;
+        uint32_t dedicated_allocation_count;
+        VkDeviceSize dedicated_bytes;
+    };
+
+    // Everything the allocator has taken out of one heap.
+    struct heap_usage_t {
+        // In VkDeviceMemory objects, blocks and dedicated allocations alike.
+        VkDeviceSize allocated{0};
+
+        // What has been handed out of that, by category.
+        std::array<VkDeviceSize, MEMORY_CATEGORY_COUNT> categories{};
+    };
+
+    struct heap_budget_t {
+        uint32_t heap_index;
+        bool device_local;
+        VkDeviceSize size;
+
+        // With VK_EXT_memory_budget, these are what the driver reports for
+        // the whole process. Without it, the budget is a fixed share of the
+        // heap and the usage is what this allocator has allocated.
+        VkDeviceSize budget;
+        VkDeviceSize usage;
+
+        heap_usage_t allocator_usage;
+    };
+
+    // Without VK_EXT_memory_budget, this much of each heap is taken to be
+    // usable.
+    static constexpr double DEFAULT_BUDGET_FRACTION = 0.8;
+
+    const vulkan_device_t &device;
+    VkDeviceSize block_size;
+    VkDeviceSize buffer_image_granularity;
+
+    std::vector<std::unique_ptr<memory_block_t>> blocks;
+
+    uint32_t dedicated_allocation_count{0};
+    VkDeviceSize dedicated_bytes{0};
+
+    std::vector<heap_usage_t> heaps;
+
+    // Buffers and images get created from more than one thread.
+    mutable std::mutex mutex;
+
+    memory_allocator_t(
+        const vulkan_device_t &p_device, VkDeviceSize p_block_size
+    );
+
+    static auto create(
+        const vulkan_device_t &device,
+        VkDeviceSize block_size = DEFAULT_BLOCK_SIZE
+    ) -> memory_allocator_t;
+
+    NO_COPY(memory_allocator_t);
+
+    // `linear` should be true for buffers and linearly tiled images, and false
+    // for optimally tiled images.
+    auto allocate(
+        VkMemoryRequirements requirements,
+        VkMemoryPropertyFlags property_flags,
+        bool linear,
+        memory_category_t category = memory_category_t::other
+    ) -> vulkan_memory_t;
+
+    auto free(vulkan_memory_t &memory) -> void;
+
+    auto get_statistics() const -> statistics_t;
+
+    // One per heap.
+    auto get_heap_budgets() const -> std::vector<heap_budget_t>;
+
+    ~memory_allocator_t();
+
+  private:
+    auto create_block(uint32_t memory_type_index, bool linear)
+        -> memory_block_t &;
 };
 
 auto get_memory_type_index(
@@ -53,7 +53,7 @@ auto mv::mesh_t::append_cube_face(
 
     const std::array new_indices{0, 1, 2, 0, 2, 3};
 
-    const auto pivot_index = static_cast<uint16_t>(vertices.size());
+    const auto pivot_index = static_cast<uint32_t>(vertices.size());
 
     for (int i = 0; i < 4; i++) {
         float x_value, y_value, z_value;
@@ -7,6 +7,8 @@ namespace mv {
 enum class axis_t { x, y, z };
 
 struct mesh_t {
+    static constexpr uint32_t CUBE_INDEX_COUNT = 36;
+
     std::vector<vertex_t> vertices;
     std::vector<uint32_t> indices;
 
@@ -0,0 +1,144 @@
+#include <algorithm>
+#include <charconv>
+#include <thread>
+
+#include "profiler.hpp"
+
+#include "pacing.hpp"
+
+namespace mv {
+
+namespace {
+auto has_mode(std::span<const VkPresentModeKHR> modes, VkPresentModeKHR mode)
+    -> bool {
+    return std::find(modes.begin(), modes.end(), mode) != modes.end();
+}
+} // namespace
+
+auto present_policy_t::parse(std::string_view name)
+    -> std::optional<present_policy_t> {
+    if (name == "low-latency") {
+        return present_policy_t{.type = type_t::low_latency, .fps = 0.0};
+    } else if (name == "max-throughput") {
+        return present_policy_t{.type = type_t::max_throughput, .fps = 0.0};
+    } else if (name == "power-saving") {
+        return present_policy_t{.type = type_t::power_saving, .fps = 0.0};
+    }
+
+    double fps = 0.0;
+    const auto [end, error] =
+        std::from_chars(name.data(), name.data() + name.size(), fps);
+    if (error != std::errc{} || end != name.data() + name.size() || fps <= 0.0) {
+        return std::nullopt;
+    }
+
+    return present_policy_t{.type = type_t::capped, .fps = fps};
+}
+
+auto present_policy_t::choose_present_mode(
+    std::span<const VkPresentModeKHR> modes
+) const -> VkPresentModeKHR {
+    switch (type) {
+    case type_t::low_latency:
+    case type_t::capped:
+        if (has_mode(modes, VK_PRESENT_MODE_MAILBOX_KHR)) {
+            return VK_PRESENT_MODE_MAILBOX_KHR;
+        }
+        if (has_mode(modes, VK_PRESENT_MODE_IMMEDIATE_KHR)) {
+            return VK_PRESENT_MODE_IMMEDIATE_KHR;
+        }
+        break;
+    case type_t::max_throughput:
+        if (has_mode(modes, VK_PRESENT_MODE_IMMEDIATE_KHR)) {
+            return VK_PRESENT_MODE_IMMEDIATE_KHR;
+        }
+        if (has_mode(modes, VK_PRESENT_MODE_MAILBOX_KHR)) {
+            return VK_PRESENT_MODE_MAILBOX_KHR;
+        }
+        break;
+    case type_t::power_saving:
+        break;
+    }
+
+    return VK_PRESENT_MODE_FIFO_KHR;
+}
+
+auto present_policy_t::choose_image_count(
+    const VkSurfaceCapabilitiesKHR &capabilities
+) const -> uint32_t {
+    auto image_count = capabilities.minImageCount;
+    switch (type) {
+    case type_t::low_latency:
+    case type_t::capped:
+        image_count += 1;
+        break;
+    case type_t::max_throughput:
+        image_count += 2;
+        break;
+    case type_t::power_saving:
+        break;
+    }
+
+    // A max of zero means there isn't one.
+    if (capabilities.maxImageCount != 0) {
+        image_count = std::min(image_count, capabilities.maxImageCount);
+    }
+
+    return image_count;
+}
+
+auto get_present_mode_name(VkPresentModeKHR mode) -> std::string_view {
+    switch (mode) {
+    case VK_PRESENT_MODE_IMMEDIATE_KHR:
+        return "IMMEDIATE";
+    case VK_PRESENT_MODE_MAILBOX_KHR:
+        return "MAILBOX";
+    case VK_PRESENT_MODE_FIFO_KHR:
+        return "FIFO";
+    case VK_PRESENT_MODE_FIFO_RELAXED_KHR:
+        return "FIFO_RELAXED";
+    default:
+        return "UNKNOWN";
+    }
+}
+
+auto frame_limiter_t::create(double fps) -> frame_limiter_t {
+    const auto period =
+        fps > 0.0 ? std::chrono::duration_cast<clock_type::duration>(
+                        std::chrono::duration<double>(1.0 / fps)
+                    )
+                  : clock_type::duration::zero();
+
+    return frame_limiter_t{
+        .period = period,
+        .next = clock_type::now() + period,
+    };
+}
+
+auto frame_limiter_t::wait() -> void {
+    if (!is_enabled()) {
+        return;
+    }
+
+    PROFILE_ZONE("frame_limiter_t::wait");
+
+    const auto start = clock_type::now();
+    if (start < next) {
+        if (next - start > SPIN_TIME) {
+            std::this_thread::sleep_for(next - start - SPIN_TIME);
+        }
+
+        while (clock_type::now() < next) {
+        }
+    }
+
+    const auto now = clock_type::now();
+    wait_time += std::chrono::duration<double>(now - start).count();
+
+    // A frame that ran a little long is made up for by waiting less on the
+    // next one, but one that missed by a whole period just restarts the
+    // schedule, rather than rushing a burst of frames out to catch up.
+    next = std::max(next + period, now);
+}
+
+} // namespace mv
@@ -0,0 +1,75 @@
+#pragma once
+
+#include <chrono>
+#include <optional>
+#include <span>
+#include <string_view>
+
+#include <vulkan/vulkan.h>
+
+namespace mv {
+
+// How the swapchain trades input latency against GPU utilisation.
+struct present_policy_t {
+    enum class type_t {
+        // The newest frame replaces whatever is queued (MAILBOX, or IMMEDIATE
+        // if there is no MAILBOX).
+        low_latency,
+
+        // Never waits for the display (IMMEDIATE, or MAILBOX), with an extra
+        // image so that the GPU always has somewhere to render to.
+        max_throughput,
+
+        // FIFO with as few images as possible, so the GPU only renders as fast
+        // as the display refreshes and idles the rest of the time.
+        power_saving,
+
+        // Like low_latency, but the frame limiter holds it at `fps`.
+        capped,
+    };
+
+    type_t type{type_t::low_latency};
+    double fps{0.0};
+
+    // Takes "low-latency", "max-throughput", "power-saving", or a frame rate
+    // to cap at.
+    static auto parse(std::string_view name) -> std::optional<present_policy_t>;
+
+    // Falls back to FIFO, which is always there.
+    auto choose_present_mode(std::span<const VkPresentModeKHR> modes) const
+        -> VkPresentModeKHR;
+
+    auto choose_image_count(const VkSurfaceCapabilitiesKHR &capabilities
+    ) const -> uint32_t;
+};
+
+auto get_present_mode_name(VkPresentModeKHR mode) -> std::string_view;
+
+// Holds the loop at a fixed rate. Call wait() right before input is sampled,
+// so that the time spent waiting doesn't end up between the input and the
+// frame that shows it.
+struct frame_limiter_t {
+    using clock_type = std::chrono::steady_clock;
+
+    // sleep_for tends to overshoot by up to a millisecond or so (and by a lot
+    // more on some platforms), so it stops this much short and spins the
+    // rest.
+    static constexpr auto SPIN_TIME = std::chrono::microseconds{1500};
+
+    clock_type::duration period;
+    clock_type::time_point next;
+
+    // In seconds.
+    double wait_time{0.0};
+
+    // Zero means no limit.
+    static auto create(double fps) -> frame_limiter_t;
+
+    inline auto is_enabled() const -> bool {
+        return period != clock_type::duration::zero();
+    }
+
+    auto wait() -> void;
+};
+
+} // namespace mv
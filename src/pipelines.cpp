@@ -0,0 +1,186 @@
+#include <algorithm>
+#include <chrono>
+
+#include "profiler.hpp"
+
+#include "pipelines.hpp"
+
+namespace mv {
+
+auto pipeline_build_queue_t::create(
+    const vulkan_device_t &p_device,
+    thread_pool_t &p_pool,
+    VkPipelineCache p_cache,
+    shader_module_cache_t *p_shader_modules
+) -> pipeline_build_queue_t {
+    return pipeline_build_queue_t{p_device, p_pool, p_cache, p_shader_modules};
+}
+
+auto pipeline_build_queue_t::submit(
+    std::string_view p_name, pipeline_description_t p_description
+) -> pipeline_handle_t {
+    const auto handle = pipeline_handle_t{
+        .index = static_cast<uint32_t>(entries.size()),
+    };
+
+    auto future = pool.submit(
+        [this, description = std::move(p_description)]() -> built_t {
+            PROFILE_ZONE("pipeline_build_queue_t::build");
+
+            const auto start = std::chrono::steady_clock::now();
+
+            const auto vertex_specialization =
+                description.vertex_constants.get_info();
+            const auto fragment_specialization =
+                description.fragment_constants.get_info();
+
+            // Constructed in place, graphics_pipeline_t can't really be moved.
+            auto pipeline = std::unique_ptr<graphics_pipeline_t>(
+                new graphics_pipeline_t(graphics_pipeline_t::create(
+                    device,
+                    description.render_pass,
+                    description.vertex_shader_path,
+                    description.fragment_shader_path,
+                    description.push_constant_ranges,
+                    description.descriptor_set_layouts,
+                    cache,
+                    shader_modules,
+                    description.vertex_constants.entries.empty()
+                        ? nullptr
+                        : &vertex_specialization,
+                    description.fragment_constants.entries.empty()
+                        ? nullptr
+                        : &fragment_specialization
+                ))
+            );
+
+            const auto elapsed = std::chrono::steady_clock::now() - start;
+
+            return built_t{
+                .pipeline = std::move(pipeline),
+                .milliseconds =
+                    std::chrono::duration<double, std::milli>(elapsed).count(),
+            };
+        }
+    );
+
+    entries.push_back(entry_t{
+        .name = std::string{p_name},
+        .future = std::move(future),
+        .built = std::nullopt,
+        .error = nullptr,
+    });
+
+    return handle;
+}
+
+auto pipeline_build_queue_t::get(pipeline_handle_t p_handle)
+    -> const graphics_pipeline_t & {
+    auto &entry = entries.at(p_handle.index);
+
+    if (!entry.built.has_value() && entry.error == nullptr) {
+        PROFILE_ZONE("pipeline_build_queue_t::get");
+        try {
+            entry.built = entry.future.get();
+        } catch (...) {
+            entry.error = std::current_exception();
+        }
+    }
+
+    if (entry.error != nullptr) {
+        std::rethrow_exception(entry.error);
+    }
+
+    return *entry.built->pipeline;
+}
+
+auto pipeline_build_queue_t::is_ready(pipeline_handle_t p_handle) const
+    -> bool {
+    const auto &entry = entries.at(p_handle.index);
+    return entry.built.has_value() || entry.error != nullptr ||
+           entry.future.wait_for(std::chrono::seconds{0}) ==
+               std::future_status::ready;
+}
+
+auto pipeline_build_queue_t::wait_all() -> void {
+    for (uint32_t i = 0; i < entries.size(); i++) {
+        get(pipeline_handle_t{.index = i});
+    }
+}
+
+auto pipeline_build_queue_t::get_build_milliseconds() const -> double {
+    auto total = 0.0;
+    for (const auto &entry : entries) {
+        if (entry.built.has_value()) {
+            total += entry.built->milliseconds;
+        }
+    }
+
+    return total;
+}
+
+pipeline_build_queue_t::~pipeline_build_queue_t() {
+    // Can't throw from here, and whatever failed has been thrown from get()
+    // already if anyone cared about it.
+    for (auto &entry : entries) {
+        if (entry.future.valid()) {
+            entry.future.wait();
+        }
+    }
+}
+
+auto lighting_variant_t::get_constants() const -> specialization_constants_t {
+    specialization_constants_t constants{};
+    constants.set(SHADOWS, shadows)
+        .set(PCF_SIZE, static_cast<int32_t>(pcf_size))
+        .set(LIGHT_COUNT, static_cast<int32_t>(light_count))
+        .set(SPOTLIGHT, spotlight)
+        .set(SHADOW_BIAS, shadow_bias);
+
+    return constants;
+}
+
+auto lighting_variant_t::normalized() const -> lighting_variant_t {
+    auto variant = *this;
+    variant.pcf_size = pcf_size / 2 * 2 + 1;
+    variant.light_count = std::min(light_count, 1u);
+
+    return variant;
+}
+
+auto lighting_pipelines_t::create(
+    pipeline_build_queue_t &p_queue, pipeline_description_t p_description
+) -> lighting_pipelines_t {
+    return lighting_pipelines_t{p_queue, std::move(p_description)};
+}
+
+auto lighting_pipelines_t::request(const lighting_variant_t &p_variant)
+    -> pipeline_handle_t {
+    const auto key = p_variant.normalized();
+
+    const auto variant = variants.find(key);
+    if (variant != variants.end()) {
+        return variant->second;
+    }
+
+    auto variant_description = description;
+    variant_description.fragment_constants = key.get_constants();
+
+    const auto handle = queue.submit(
+        "lit (shadows " + std::to_string(key.shadows) + ", pcf " +
+            std::to_string(key.pcf_size) + ", lights " +
+            std::to_string(key.light_count) + ", spotlight " +
+            std::to_string(key.spotlight) + ")",
+        std::move(variant_description)
+    );
+
+    variants.emplace(key, handle);
+    return handle;
+}
+
+auto lighting_pipelines_t::get(const lighting_variant_t &p_variant)
+    -> const graphics_pipeline_t & {
+    return queue.get(request(p_variant));
+}
+
+} // namespace mv
@@ -0,0 +1,219 @@
+#pragma once
+
+#include <cstring>
+#include <deque>
+#include <exception>
+#include <future>
+#include <map>
+#include <memory>
+#include <string>
+#include <type_traits>
+#include <vector>
+
+#include <vulkan/vulkan.h>
+
+#include "caches.hpp"
+#include "common.hpp"
+#include "device.hpp"
+#include "graphics.hpp"
+#include "threads.hpp"
+
+namespace mv {
+
+// The values of a stage's specialization constants, along with the map
+// entries that say where each one is.
+struct specialization_constants_t {
+    std::vector<VkSpecializationMapEntry> entries;
+    std::vector<uint8_t> data;
+
+    template <typename T>
+    auto set(uint32_t constant_id, T value) -> specialization_constants_t & {
+        static_assert(std::is_trivially_copyable_v<T>);
+
+        entries.push_back(VkSpecializationMapEntry{
+            .constantID = constant_id,
+            .offset = static_cast<uint32_t>(data.size()),
+            .size = sizeof(T),
+        });
+
+        data.resize(data.size() + sizeof(T));
+        std::memcpy(data.data() + data.size() - sizeof(T), &value, sizeof(T));
+
+        return *this;
+    }
+
+    // Booleans are 32 bits wide in SPIR-V.
+    inline auto set(uint32_t constant_id, bool value)
+        -> specialization_constants_t & {
+        return set<VkBool32>(constant_id, value ? VK_TRUE : VK_FALSE);
+    }
+
+    // Only valid for as long as this is left alone.
+    inline auto get_info() const -> VkSpecializationInfo {
+        return VkSpecializationInfo{
+            .mapEntryCount = static_cast<uint32_t>(entries.size()),
+            .pMapEntries = entries.data(),
+            .dataSize = data.size(),
+            .pData = data.data(),
+        };
+    }
+};
+
+// Everything graphics_pipeline_t::create needs, owned, so that it can be
+// handed to another thread.
+struct pipeline_description_t {
+    const render_pass_t &render_pass;
+    std::string vertex_shader_path;
+    std::string fragment_shader_path;
+    std::vector<VkPushConstantRange> push_constant_ranges;
+    std::vector<VkDescriptorSetLayout> descriptor_set_layouts;
+
+    // Left empty for stages without any.
+    specialization_constants_t vertex_constants{};
+    specialization_constants_t fragment_constants{};
+};
+
+struct pipeline_handle_t {
+    uint32_t index;
+};
+
+// Builds pipelines on a thread pool instead of one after the other on the
+// caller's thread. Everything goes through the same VkPipelineCache, which
+// Vulkan already synchronizes internally, so the workers can share it, and the
+// same shader module cache, if there is one.
+//
+// submit() only queues the build. get() blocks until that one pipeline is
+// done, so the caller only ever waits for the pipelines it is about to use,
+// and whatever else it does in between overlaps with the compiles.
+struct pipeline_build_queue_t {
+    struct built_t {
+        std::unique_ptr<graphics_pipeline_t> pipeline;
+
+        // How long the build took on the worker.
+        double milliseconds;
+    };
+
+    struct entry_t {
+        std::string name;
+        std::future<built_t> future;
+        std::optional<built_t> built;
+
+        // What the build threw. The future only hands it out once, so it's
+        // kept here for every get() after the first.
+        std::exception_ptr error;
+    };
+
+    const vulkan_device_t &device;
+    thread_pool_t &pool;
+    VkPipelineCache cache;
+    shader_module_cache_t *shader_modules;
+
+    // A deque, so that references from get() stay valid as more are queued.
+    std::deque<entry_t> entries;
+
+    pipeline_build_queue_t(
+        const vulkan_device_t &p_device,
+        thread_pool_t &p_pool,
+        VkPipelineCache p_cache,
+        shader_module_cache_t *p_shader_modules
+    )
+        : device(p_device), pool(p_pool), cache(p_cache),
+          shader_modules(p_shader_modules) {}
+
+    static auto create(
+        const vulkan_device_t &device,
+        thread_pool_t &pool,
+        VkPipelineCache cache = VK_NULL_HANDLE,
+        shader_module_cache_t *shader_modules = nullptr
+    ) -> pipeline_build_queue_t;
+
+    NO_COPY(pipeline_build_queue_t);
+
+    auto submit(std::string_view name, pipeline_description_t description)
+        -> pipeline_handle_t;
+
+    // Blocks until the pipeline is built. Rethrows whatever the build threw,
+    // every time it's called.
+    auto get(pipeline_handle_t handle) -> const graphics_pipeline_t &;
+
+    auto is_ready(pipeline_handle_t handle) const -> bool;
+
+    // Rethrows the first failure, like get().
+    auto wait_all() -> void;
+
+    // The sum of the build times of everything that is done so far, which is
+    // how long it would have taken on one thread.
+    auto get_build_milliseconds() const -> double;
+
+    // The workers still hold references to the device and the cache, so
+    // nothing is left running once the queue is gone.
+    ~pipeline_build_queue_t();
+};
+
+// Which lighting features basic.frag gets built with. They end up as
+// specialization constants, so every combination is a pipeline of its own
+// that only does the work it needs.
+struct lighting_variant_t {
+    // The constant IDs in basic.frag.
+    enum constant_id_t : uint32_t {
+        SHADOWS = 0,
+        PCF_SIZE = 1,
+        LIGHT_COUNT = 2,
+        SPOTLIGHT = 3,
+        SHADOW_BIAS = 4,
+    };
+
+    bool shadows{true};
+
+    // The width of the block of shadow map texels averaged for each
+    // fragment. basic.frag goes PCF_SIZE / 2 texels either way, so an even
+    // size gets the block of the odd size after it.
+    uint32_t pcf_size{1};
+
+    // basic.frag only has the one light in its uniforms, so anything past
+    // one is still one.
+    uint32_t light_count{1};
+    bool spotlight{true};
+
+    // How far in front of the shadow map a fragment has to be to be lit, to
+    // keep surfaces from shadowing themselves.
+    float shadow_bias{0.0005f};
+
+    auto operator<=>(const lighting_variant_t &) const = default;
+
+    auto get_constants() const -> specialization_constants_t;
+
+    // The same variant, with the sizes and counts basic.frag would really
+    // use, so that variants that end up the same also compare the same.
+    auto normalized() const -> lighting_variant_t;
+};
+
+// Builds the lit pipeline once for each lighting variant that's asked for,
+// and hands out the same one every time after that. The variants only
+// differ in their constants, so they share their shader modules.
+struct lighting_pipelines_t {
+    pipeline_build_queue_t &queue;
+    pipeline_description_t description;
+
+    std::map<lighting_variant_t, pipeline_handle_t> variants;
+
+    lighting_pipelines_t(
+        pipeline_build_queue_t &p_queue, pipeline_description_t p_description
+    )
+        : queue(p_queue), description(std::move(p_description)) {}
+
+    static auto create(
+        pipeline_build_queue_t &queue, pipeline_description_t description
+    ) -> lighting_pipelines_t;
+
+    NO_COPY(lighting_pipelines_t);
+
+    // Queues the variant up if it hasn't been already, without waiting for
+    // it. The variant is normalized first.
+    auto request(const lighting_variant_t &variant) -> pipeline_handle_t;
+
+    // Blocks until the variant is built.
+    auto get(const lighting_variant_t &variant) -> const graphics_pipeline_t &;
+};
+
+} // namespace mv
@@ -19,6 +19,8 @@ auto framebuffer_size_callback(
         reinterpret_cast<window_t *>(glfwGetWindowUserPointer(p_window));
     window->width = p_width;
     window->height = p_height;
+    window->resized = true;
+    window->last_resize_time = glfwGetTime();
 }
 } // namespace
 
@@ -57,8 +59,21 @@ auto window_t::create(
     };
 }
 
+auto window_t::create_headless(int p_width, int p_height) -> window_t {
+    return {
+        .window = nullptr,
+        .surface = VK_NULL_HANDLE,
+        .instance = VK_NULL_HANDLE,
+        .width = p_width,
+        .height = p_height,
+    };
+}
+
 auto mv::swapchain_t::create(
-    const vulkan_device_t &p_device, const window_t &p_window
+    const vulkan_device_t &p_device,
+    const window_t &p_window,
+    present_policy_t p_policy,
+    VkSwapchainKHR p_old_swapchain
 ) -> swapchain_t {
     uint32_t surface_format_count;
     vkGetPhysicalDeviceSurfaceFormatsKHR(
@@ -103,13 +118,7 @@ auto mv::swapchain_t::create(
         throw no_adequate_swapchain_settings_exception{};
     }
 
-    auto present_mode = VK_PRESENT_MODE_IMMEDIATE_KHR;
-    for (auto mode : present_modes) {
-        if (mode == VK_PRESENT_MODE_MAILBOX_KHR) {
-            present_mode = mode;
-            break;
-        }
-    }
+    const auto present_mode = p_policy.choose_present_mode(present_modes);
 
     VkSurfaceCapabilitiesKHR surface_capabilities;
     vkGetPhysicalDeviceSurfaceCapabilitiesKHR(
@@ -147,12 +156,12 @@ auto mv::swapchain_t::create(
         sharing_mode = VK_SHARING_MODE_CONCURRENT;
     }
 
-    VkSwapchainCreateInfoKHR swapchain_create_info{
+    const VkSwapchainCreateInfoKHR swapchain_create_info{
         .sType = VK_STRUCTURE_TYPE_SWAPCHAIN_CREATE_INFO_KHR,
         .pNext = nullptr,
         .flags = 0,
         .surface = p_window.surface,
-        .minImageCount = surface_capabilities.minImageCount + 1,
+        .minImageCount = p_policy.choose_image_count(surface_capabilities),
         .imageFormat = surface_format.format,
         .imageColorSpace = surface_format.colorSpace,
         .imageExtent = swap_extent,
@@ -166,18 +175,9 @@ auto mv::swapchain_t::create(
         .compositeAlpha = VK_COMPOSITE_ALPHA_OPAQUE_BIT_KHR,
         .presentMode = present_mode,
         .clipped = VK_TRUE,
-        .oldSwapchain = VK_NULL_HANDLE,
+        .oldSwapchain = p_old_swapchain,
     };
 
-    const auto no_max_image_count = surface_capabilities.maxImageCount == 0;
-    const auto exceeds_max_image_count = swapchain_create_info.minImageCount >
-                                         surface_capabilities.maxImageCount;
-
-    if (!no_max_image_count && exceeds_max_image_count) {
-        swapchain_create_info.minImageCount =
-            surface_capabilities.maxImageCount;
-    }
-
     VkSwapchainKHR swapchain;
     const auto result = vkCreateSwapchainKHR(
         p_device.logical, &swapchain_create_info, nullptr, &swapchain
@@ -243,16 +243,22 @@ auto mv::swapchain_t::create(
         std::move(images),
         std::move(image_views),
         surface_format.format,
-        swap_extent
+        swap_extent,
+        p_policy,
+        present_mode
     };
 }
 
-auto mv::swapchain_t::create_framebuffers(
-    const render_pass_t &render_pass, const vulkan_image_view_t &p_depth_buffer
-) const -> mv::swapchain_t::framebuffers_t {
+auto mv::swapchain_t::framebuffers_t::create(
+    const vulkan_device_t &p_device,
+    const render_pass_t &render_pass,
+    std::span<const VkImageView> p_color_views,
+    const vulkan_image_view_t &p_depth_buffer,
+    VkExtent2D p_extent
+) -> framebuffers_t {
     std::vector<VkFramebuffer> framebuffers;
 
-    for (auto view : image_views) {
+    for (auto view : p_color_views) {
         const std::array attachments{view, p_depth_buffer.image_view};
 
         const VkFramebufferCreateInfo create_info{
@@ -262,18 +268,26 @@ auto mv::swapchain_t::create_framebuffers(
             .renderPass = render_pass.render_pass,
             .attachmentCount = attachments.size(),
             .pAttachments = attachments.data(),
-            .width = extent.width,
-            .height = extent.height,
+            .width = p_extent.width,
+            .height = p_extent.height,
             .layers = 1,
         };
 
         VkFramebuffer framebuffer;
         VK_ERROR(vkCreateFramebuffer(
-            device->logical, &create_info, nullptr, &framebuffer
+            p_device.logical, &create_info, nullptr, &framebuffer
         ));
 
         framebuffers.push_back(framebuffer);
     }
 
-    return {std::move(framebuffers), *device};
+    return {std::move(framebuffers), p_device};
+}
+
+auto mv::swapchain_t::create_framebuffers(
+    const render_pass_t &render_pass, const vulkan_image_view_t &p_depth_buffer
+) const -> mv::swapchain_t::framebuffers_t {
+    return framebuffers_t::create(
+        *device, render_pass, image_views, p_depth_buffer, extent
+    );
 }
@@ -6,6 +6,7 @@
 #include <GLFW/glfw3.h>
 
 #include "device.hpp"
+#include "pacing.hpp"
 
 namespace mv {
 
@@ -19,18 +20,37 @@ struct window_t {
 
     int width, height;
 
+    // Set whenever the framebuffer gets resized, so that a burst of resize
+    // events can be turned into a single swapchain rebuild.
+    bool resized{false};
+    double last_resize_time{0.0};
+
     static auto create(
         VkInstance p_instance, std::string_view p_title, int p_width,
         int p_height
     ) -> window_t;
 
+    // No window and no surface, just the size of what gets rendered. GLFW
+    // still has to be initialised, but can be on the null platform.
+    static auto create_headless(int p_width, int p_height) -> window_t;
+
+    inline auto is_headless() const -> bool {
+        return window == nullptr;
+    }
+
     inline auto set_user_pointer() -> void {
-        glfwSetWindowUserPointer(window, this);
+        if (window != nullptr) {
+            glfwSetWindowUserPointer(window, this);
+        }
     }
 
     inline ~window_t() {
-        vkDestroySurfaceKHR(instance, surface, nullptr);
-        glfwDestroyWindow(window);
+        if (surface != VK_NULL_HANDLE) {
+            vkDestroySurfaceKHR(instance, surface, nullptr);
+        }
+        if (window != nullptr) {
+            glfwDestroyWindow(window);
+        }
         glfwTerminate();
     }
 };
@@ -42,6 +62,10 @@ struct swapchain_t {
     VkFormat format;
     VkExtent2D extent;
 
+    // What it was created with, so that it can be recreated the same way.
+    present_policy_t policy;
+    VkPresentModeKHR present_mode;
+
     const vulkan_device_t *device;
 
     swapchain_t() = default;
@@ -50,14 +74,23 @@ struct swapchain_t {
         VkSwapchainKHR p_swapchain, const vulkan_device_t &p_device,
         std::vector<VkImage> &&p_images,
         std::vector<VkImageView> &&p_image_views, VkFormat p_format,
-        VkExtent2D p_extent
+        VkExtent2D p_extent, present_policy_t p_policy,
+        VkPresentModeKHR p_present_mode
     )
         : swapchain(p_swapchain), images(p_images), image_views(p_image_views),
-          format(p_format), extent(p_extent), device(&p_device) {
+          format(p_format), extent(p_extent), policy(p_policy),
+          present_mode(p_present_mode), device(&p_device) {
     }
 
-    static auto create(const vulkan_device_t &device, const window_t &window)
-        -> swapchain_t;
+    // Passing the swapchain that is being replaced lets the driver reuse its
+    // resources, and lets frames that are still in flight present to it. It
+    // is retired either way, and has to be destroyed by the caller.
+    static auto create(
+        const vulkan_device_t &device,
+        const window_t &window,
+        present_policy_t policy = {},
+        VkSwapchainKHR old_swapchain = VK_NULL_HANDLE
+    ) -> swapchain_t;
 
     struct framebuffers_t {
         std::vector<VkFramebuffer> framebuffers;
@@ -73,6 +106,15 @@ struct swapchain_t {
 
         NO_COPY(framebuffers_t);
 
+        // One framebuffer per color view, all sharing the depth buffer.
+        static auto create(
+            const vulkan_device_t &device,
+            const render_pass_t &render_pass,
+            std::span<const VkImageView> color_views,
+            const vulkan_image_view_t &depth_buffer,
+            VkExtent2D extent
+        ) -> framebuffers_t;
+
         YES_MOVE(framebuffers_t);
 
         auto operator=(framebuffers_t &&other) noexcept -> framebuffers_t & {
@@ -104,7 +146,17 @@ struct swapchain_t {
         -> framebuffers_t;
 
     NO_COPY(swapchain_t);
-    YES_MOVE(swapchain_t);
+
+    swapchain_t(swapchain_t &&other) noexcept
+        : swapchain(other.swapchain), images(std::move(other.images)),
+          image_views(std::move(other.image_views)), format(other.format),
+          extent(other.extent), policy(other.policy),
+          present_mode(other.present_mode), device(other.device) {
+        other.swapchain = VK_NULL_HANDLE;
+        other.device = nullptr;
+        other.images.clear();
+        other.image_views.clear();
+    }
 
     auto operator=(swapchain_t &&other) noexcept -> swapchain_t & {
         fucking_destroy();
@@ -114,6 +166,8 @@ struct swapchain_t {
         image_views = std::move(other.image_views);
         format = other.format;
         extent = other.extent;
+        policy = other.policy;
+        present_mode = other.present_mode;
         device = other.device;
 
         other.swapchain = VK_NULL_HANDLE;
@@ -0,0 +1,112 @@
+#include <chrono>
+#include <fstream>
+#include <iomanip>
+#include <memory>
+#include <mutex>
+
+#include "benchmark.hpp"
+#include "errors.hpp"
+
+#include "profiler.hpp"
+
+namespace mv {
+
+namespace {
+const auto start_time = std::chrono::steady_clock::now();
+
+// Rings are never freed, so that a thread's events are still there after it
+// has exited. The lock is only taken when a thread first records something
+// and when writing the trace.
+std::mutex threads_mutex;
+std::vector<std::unique_ptr<profile_thread_t>> threads;
+} // namespace
+
+auto get_profile_time() -> uint64_t {
+    return static_cast<uint64_t>(
+        std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::steady_clock::now() - start_time
+        )
+            .count()
+    );
+}
+
+auto get_profile_thread() -> profile_thread_t & {
+    thread_local profile_thread_t *thread = nullptr;
+
+    if (thread == nullptr) {
+        std::lock_guard lock{threads_mutex};
+
+        auto new_thread = std::make_unique<profile_thread_t>();
+        new_thread->id = static_cast<uint32_t>(threads.size() + 1);
+        new_thread->name = "thread " + std::to_string(new_thread->id);
+
+        thread = new_thread.get();
+        threads.push_back(std::move(new_thread));
+    }
+
+    return *thread;
+}
+
+auto set_profile_thread_name(std::string_view name) -> void {
+    auto &thread = get_profile_thread();
+
+    std::lock_guard lock{threads_mutex};
+    thread.name = name;
+}
+
+auto write_chrome_trace(std::ostream &stream) -> void {
+    std::lock_guard lock{threads_mutex};
+
+    auto first = true;
+    const auto separator = [&]() -> std::ostream & {
+        stream << (first ? "\n    " : ",\n    ");
+        first = false;
+        return stream;
+    };
+
+    const auto flags = stream.flags();
+    stream << std::fixed << std::setprecision(3);
+
+    stream << "{\"displayTimeUnit\": \"ms\", \"traceEvents\": [";
+
+    for (const auto &thread : threads) {
+        separator() << "{\"ph\": \"M\", \"name\": \"thread_name\", "
+                       "\"pid\": 1, \"tid\": "
+                    << thread->id << ", \"args\": {\"name\": ";
+        write_json_string(stream, thread->name);
+        stream << "}}";
+
+        const auto head = thread->head.load(std::memory_order_acquire);
+        const auto tail =
+            head > profile_thread_t::RING_SIZE
+                ? head - profile_thread_t::RING_SIZE
+                : 0;
+
+        for (auto i = tail; i < head; i++) {
+            const auto &event = thread->events[i % profile_thread_t::RING_SIZE];
+
+            // Timestamps are in microseconds.
+            separator() << "{\"ph\": \"X\", \"name\": ";
+            write_json_string(stream, event.name);
+            stream << ", \"pid\": 1, \"tid\": " << thread->id
+                   << ", \"ts\": " << static_cast<double>(event.begin) / 1000.0
+                   << ", \"dur\": "
+                   << static_cast<double>(event.end - event.begin) / 1000.0
+                   << '}';
+        }
+    }
+
+    stream << "\n]}\n";
+    stream.flags(flags);
+}
+
+auto write_chrome_trace(std::string_view path) -> void {
+    std::ofstream file{std::string{path}};
+    if (!file.is_open()) {
+        throw file_exception(file_exception::type_t::open, path);
+    }
+
+    write_chrome_trace(file);
+}
+
+} // namespace mv
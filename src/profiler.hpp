@@ -0,0 +1,91 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <ostream>
+#include <string>
+#include <string_view>
+
+#include "common.hpp"
+
+// Scoped CPU zones, written out as a Chrome trace that Perfetto or
+// chrome://tracing can open. Define MV_PROFILE to turn them on. Without it the
+// macros expand to nothing, so the zones cost nothing at all.
+#ifdef MV_PROFILE
+#define PROFILE_CONCAT_INNER(a, b) a##b
+#define PROFILE_CONCAT(a, b) PROFILE_CONCAT_INNER(a, b)
+
+// The name has to outlive the profiler, so it should be a string literal.
+#define PROFILE_ZONE(name)                                                     \
+    const mv::profile_zone_t PROFILE_CONCAT(profile_zone_, __LINE__) { name }
+#define PROFILE_THREAD(name) mv::set_profile_thread_name(name)
+#else
+#define PROFILE_ZONE(name) static_cast<void>(0)
+#define PROFILE_THREAD(name) static_cast<void>(0)
+#endif
+
+namespace mv {
+
+struct profile_event_t {
+    const char *name;
+
+    // Nanoseconds since the profiler started.
+    uint64_t begin;
+    uint64_t end;
+};
+
+// Each thread records into a ring of its own, so recording never takes a lock.
+// Only the owning thread writes to it, and `head` is published after the event
+// is, so a reader sees whole events. Once the ring is full the oldest events
+// get overwritten.
+struct profile_thread_t {
+    static constexpr size_t RING_SIZE = 64 * 1024;
+
+    uint32_t id;
+    std::string name;
+
+    std::array<profile_event_t, RING_SIZE> events;
+
+    // How many events were ever recorded. Only goes up.
+    std::atomic<uint64_t> head{0};
+
+    inline auto record(const profile_event_t &event) -> void {
+        const auto index = head.load(std::memory_order_relaxed);
+        events[index % RING_SIZE] = event;
+        head.store(index + 1, std::memory_order_release);
+    }
+};
+
+auto get_profile_time() -> uint64_t;
+
+// The calling thread's ring, which gets registered the first time round.
+auto get_profile_thread() -> profile_thread_t &;
+
+auto set_profile_thread_name(std::string_view name) -> void;
+
+// Writes every thread's events out in Chrome's trace_event format. Threads
+// that are still recording can lose the events that get overwritten while this
+// runs, so it's best called once things have gone quiet.
+auto write_chrome_trace(std::ostream &stream) -> void;
+auto write_chrome_trace(std::string_view path) -> void;
+
+struct profile_zone_t {
+    const char *name;
+    uint64_t begin;
+
+    inline explicit profile_zone_t(const char *p_name)
+        : name(p_name), begin(get_profile_time()) {}
+
+    NO_COPY(profile_zone_t);
+
+    inline ~profile_zone_t() {
+        get_profile_thread().record({
+            .name = name,
+            .begin = begin,
+            .end = get_profile_time(),
+        });
+    }
+};
+
+} // namespace mv
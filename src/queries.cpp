@@ -0,0 +1,327 @@
+#include <algorithm>
+#include <numeric>
+
+#include "errors.hpp"
+
+#include "queries.hpp"
+
+namespace mv {
+
+auto gpu_profiler_t::create(const vulkan_device_t &device, uint32_t frame_count)
+    -> gpu_profiler_t {
+    uint32_t family_count;
+    vkGetPhysicalDeviceQueueFamilyProperties(
+        device.physical, &family_count, nullptr
+    );
+    std::vector<VkQueueFamilyProperties> families(family_count);
+    vkGetPhysicalDeviceQueueFamilyProperties(
+        device.physical, &family_count, families.data()
+    );
+
+    const auto valid_bits =
+        families[device.graphics_family].timestampValidBits;
+    const auto period = device.properties.limits.timestampPeriod;
+
+    VkQueryPool query_pool = VK_NULL_HANDLE;
+    if (valid_bits != 0 && period > 0.0f) {
+        const VkQueryPoolCreateInfo create_info{
+            .sType = VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO,
+            .pNext = nullptr,
+            .flags = 0,
+            .queryType = VK_QUERY_TYPE_TIMESTAMP,
+            .queryCount = frame_count * MAX_SCOPES * 2,
+            .pipelineStatistics = 0,
+        };
+
+        VK_ERROR(vkCreateQueryPool(
+            device.logical, &create_info, nullptr, &query_pool
+        ));
+    }
+
+    return gpu_profiler_t{
+        device,
+        query_pool,
+        period,
+        valid_bits >= 64 ? ~uint64_t{0} : (uint64_t{1} << valid_bits) - 1,
+        frame_count,
+    };
+}
+
+auto gpu_profiler_t::collect(uint32_t frame_index) -> std::vector<timing_t> {
+    auto &frame = frames[frame_index];
+    if (!frame.recorded || frame.scopes.empty()) {
+        frame.recorded = false;
+        return {};
+    }
+    frame.recorded = false;
+
+    std::vector<uint64_t> timestamps(frame.scopes.size() * 2);
+    const auto result = vkGetQueryPoolResults(
+        device.logical,
+        query_pool,
+        frame_index * MAX_SCOPES * 2,
+        static_cast<uint32_t>(timestamps.size()),
+        timestamps.size() * sizeof(uint64_t),
+        timestamps.data(),
+        sizeof(uint64_t),
+        VK_QUERY_RESULT_64_BIT
+    );
+
+    // Something was left open, so the frame is no good.
+    if (result == VK_NOT_READY) {
+        return {};
+    }
+    VK_ERROR(result);
+
+    std::vector<timing_t> timings;
+    timings.reserve(frame.scopes.size());
+
+    for (const auto &scope : frame.scopes) {
+        const auto ticks = (timestamps[scope.query + 1] -
+                            timestamps[scope.query]) &
+                           timestamp_mask;
+        const auto milliseconds =
+            static_cast<double>(ticks) * timestamp_period / 1'000'000.0;
+
+        timings.push_back({
+            .name = scope.name,
+            .path = scope.path,
+            .depth = scope.depth,
+            .milliseconds = milliseconds,
+        });
+
+        auto history_it =
+            std::find_if(history.begin(), history.end(), [&](const auto &h) {
+                return h.path == scope.path;
+            });
+        if (history_it == history.end()) {
+            history.push_back({
+                .name = scope.name,
+                .path = scope.path,
+                .depth = scope.depth,
+                .samples = {},
+            });
+            history_it = history.end() - 1;
+        }
+
+        if (history_it->samples.size() < AVERAGE_WINDOW) {
+            history_it->samples.push_back(milliseconds);
+        } else {
+            history_it->samples[history_it->next] = milliseconds;
+            history_it->next = (history_it->next + 1) % AVERAGE_WINDOW;
+        }
+        history_it->last = milliseconds;
+    }
+
+    return timings;
+}
+
+auto gpu_profiler_t::begin_frame(
+    VkCommandBuffer command_buffer, uint32_t frame_index
+) -> void {
+    current = frame_index;
+
+    auto &frame = frames[frame_index];
+    frame.scopes.clear();
+    frame.open.clear();
+    frame.recorded = is_supported();
+
+    if (!is_supported()) {
+        return;
+    }
+
+    vkCmdResetQueryPool(
+        command_buffer, query_pool, frame_index * MAX_SCOPES * 2, MAX_SCOPES * 2
+    );
+}
+
+auto gpu_profiler_t::begin_scope(
+    VkCommandBuffer command_buffer, std::string_view name
+) -> void {
+    auto &frame = frames[current];
+
+    if (!is_supported() || frame.scopes.size() >= MAX_SCOPES) {
+        frame.open.push_back(MAX_SCOPES);
+        return;
+    }
+
+    const auto parent = std::find_if(
+        frame.open.rbegin(),
+        frame.open.rend(),
+        [](uint32_t open) { return open != MAX_SCOPES; }
+    );
+
+    auto path = parent == frame.open.rend()
+                    ? std::string{}
+                    : frame.scopes[*parent].path + '/';
+    path += name;
+
+    const auto query = static_cast<uint32_t>(frame.scopes.size() * 2);
+    frame.open.push_back(static_cast<uint32_t>(frame.scopes.size()));
+    frame.scopes.push_back({
+        .name = std::string{name},
+        .path = std::move(path),
+        .depth = static_cast<uint32_t>(frame.open.size() - 1),
+        .query = query,
+    });
+
+    vkCmdWriteTimestamp(
+        command_buffer,
+        VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT,
+        query_pool,
+        current * MAX_SCOPES * 2 + query
+    );
+}
+
+auto gpu_profiler_t::end_scope(VkCommandBuffer command_buffer) -> void {
+    auto &frame = frames[current];
+
+    const auto scope = frame.open.back();
+    frame.open.pop_back();
+
+    if (scope == MAX_SCOPES) {
+        return;
+    }
+
+    vkCmdWriteTimestamp(
+        command_buffer,
+        VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT,
+        query_pool,
+        current * MAX_SCOPES * 2 + frame.scopes[scope].query + 1
+    );
+}
+
+auto gpu_profiler_t::get_results() const -> std::vector<result_t> {
+    std::vector<result_t> results;
+    results.reserve(history.size());
+
+    for (const auto &h : history) {
+        results.push_back({
+            .name = h.name,
+            .path = h.path,
+            .depth = h.depth,
+            .last = h.last,
+            .average =
+                std::accumulate(h.samples.begin(), h.samples.end(), 0.0) /
+                static_cast<double>(std::max<size_t>(h.samples.size(), 1)),
+        });
+    }
+
+    return results;
+}
+
+auto pipeline_statistics_t::create(
+    const vulkan_device_t &device,
+    uint32_t frame_count,
+    bool enable,
+    bool secondaries
+) -> pipeline_statistics_t {
+    const auto &features = device.enabled_features;
+    enable = enable && features.pipelineStatisticsQuery == VK_TRUE &&
+             (!secondaries || features.inheritedQueries == VK_TRUE);
+
+    VkQueryPool query_pool = VK_NULL_HANDLE;
+    if (enable) {
+        const VkQueryPoolCreateInfo create_info{
+            .sType = VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO,
+            .pNext = nullptr,
+            .flags = 0,
+            .queryType = VK_QUERY_TYPE_PIPELINE_STATISTICS,
+            .queryCount = frame_count * MAX_PASSES,
+            .pipelineStatistics = FLAGS,
+        };
+
+        VK_ERROR(vkCreateQueryPool(
+            device.logical, &create_info, nullptr, &query_pool
+        ));
+    }
+
+    return pipeline_statistics_t{device, query_pool, frame_count};
+}
+
+auto pipeline_statistics_t::collect(uint32_t frame_index)
+    -> std::vector<pass_t> {
+    auto &frame = frames[frame_index];
+    if (!frame.recorded || frame.passes.empty()) {
+        frame.recorded = false;
+        return {};
+    }
+    frame.recorded = false;
+
+    std::vector<values_t> values(frame.passes.size());
+    const auto result = vkGetQueryPoolResults(
+        device.logical,
+        query_pool,
+        frame_index * MAX_PASSES,
+        static_cast<uint32_t>(values.size()),
+        values.size() * sizeof(values_t),
+        values.data(),
+        sizeof(values_t),
+        VK_QUERY_RESULT_64_BIT
+    );
+
+    if (result == VK_NOT_READY) {
+        return {};
+    }
+    VK_ERROR(result);
+
+    latest.clear();
+    for (size_t i = 0; i < values.size(); i++) {
+        latest.push_back({.name = frame.passes[i], .values = values[i]});
+    }
+
+    return latest;
+}
+
+auto pipeline_statistics_t::begin_frame(
+    VkCommandBuffer command_buffer, uint32_t frame_index
+) -> void {
+    current = frame_index;
+
+    auto &frame = frames[frame_index];
+    frame.passes.clear();
+    frame.recorded = is_enabled();
+    frame.active = false;
+
+    if (!is_enabled()) {
+        return;
+    }
+
+    vkCmdResetQueryPool(
+        command_buffer, query_pool, frame_index * MAX_PASSES, MAX_PASSES
+    );
+}
+
+auto pipeline_statistics_t::begin_pass(
+    VkCommandBuffer command_buffer, std::string_view name
+) -> void {
+    auto &frame = frames[current];
+    if (!is_enabled() || frame.passes.size() >= MAX_PASSES) {
+        return;
+    }
+
+    vkCmdBeginQuery(
+        command_buffer,
+        query_pool,
+        current * MAX_PASSES + static_cast<uint32_t>(frame.passes.size()),
+        0
+    );
+    frame.passes.emplace_back(name);
+    frame.active = true;
+}
+
+auto pipeline_statistics_t::end_pass(VkCommandBuffer command_buffer) -> void {
+    auto &frame = frames[current];
+    if (!frame.active) {
+        return;
+    }
+    frame.active = false;
+
+    vkCmdEndQuery(
+        command_buffer,
+        query_pool,
+        current * MAX_PASSES + static_cast<uint32_t>(frame.passes.size() - 1)
+    );
+}
+
+} // namespace mv
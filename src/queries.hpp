@@ -0,0 +1,259 @@
+#pragma once
+
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include <vulkan/vulkan.h>
+
+#include "common.hpp"
+#include "device.hpp"
+
+namespace mv {
+
+// Times regions of a frame's command buffer on the GPU. Scopes can be nested,
+// and each one gets a timestamp at the top of the pipe when it begins and one
+// at the bottom when it ends, so a scope covers everything recorded inside it.
+// Each frame context has its own range of queries, which is read back when the
+// context comes round again. By then its frame is done, so reading it never
+// stalls.
+//
+// Timestamps can't be written in a render pass that only executes secondary
+// command buffers, so passes are timed from just outside of them.
+struct gpu_profiler_t {
+    static constexpr uint32_t MAX_SCOPES = 32;
+
+    // How many frames the averages are over.
+    static constexpr size_t AVERAGE_WINDOW = 64;
+
+    // How long one scope took in one frame.
+    struct timing_t {
+        std::string name;
+
+        // The names of all the enclosing scopes and this one, joined by '/'.
+        std::string path;
+        uint32_t depth;
+
+        double milliseconds;
+    };
+
+    struct result_t {
+        std::string name;
+        std::string path;
+        uint32_t depth;
+
+        double last;
+        double average;
+    };
+
+    struct scope_t {
+        std::string name;
+        std::string path;
+        uint32_t depth;
+
+        // Index of the query that the begin timestamp goes into, relative to
+        // the frame's range. The end one goes right after it.
+        uint32_t query;
+    };
+
+    struct frame_t {
+        std::vector<scope_t> scopes;
+
+        // Into `scopes`, or MAX_SCOPES for a scope that didn't fit.
+        std::vector<uint32_t> open;
+
+        bool recorded{false};
+    };
+
+    struct history_t {
+        std::string name;
+        std::string path;
+        uint32_t depth;
+
+        // Used as a ring once it's full.
+        std::vector<double> samples;
+        size_t next{0};
+        double last{0.0};
+    };
+
+    const vulkan_device_t &device;
+
+    // Null if the graphics queue can't write timestamps, in which case
+    // nothing gets recorded.
+    VkQueryPool query_pool;
+
+    // Nanoseconds per tick.
+    double timestamp_period;
+    uint64_t timestamp_mask;
+
+    std::vector<frame_t> frames;
+    uint32_t current{0};
+
+    // In the order the scopes were first seen.
+    std::vector<history_t> history;
+
+    gpu_profiler_t(
+        const vulkan_device_t &p_device,
+        VkQueryPool p_query_pool,
+        double p_timestamp_period,
+        uint64_t p_timestamp_mask,
+        uint32_t p_frame_count
+    )
+        : device(p_device), query_pool(p_query_pool),
+          timestamp_period(p_timestamp_period),
+          timestamp_mask(p_timestamp_mask), frames(p_frame_count) {}
+
+    static auto create(const vulkan_device_t &device, uint32_t frame_count)
+        -> gpu_profiler_t;
+
+    NO_COPY(gpu_profiler_t);
+
+    inline auto is_supported() const -> bool {
+        return query_pool != VK_NULL_HANDLE;
+    }
+
+    // Reads back what the frame context recorded last time round, and returns
+    // the timings. Only call this once that frame is done, which it is right
+    // after frame_contexts_t::begin_frame().
+    auto collect(uint32_t frame_index) -> std::vector<timing_t>;
+
+    // Has to be recorded at the start of the frame's command buffer, before
+    // any scopes.
+    auto begin_frame(VkCommandBuffer command_buffer, uint32_t frame_index)
+        -> void;
+
+    // Both have to be recorded outside of render passes that execute
+    // secondary command buffers.
+    auto begin_scope(VkCommandBuffer command_buffer, std::string_view name)
+        -> void;
+    auto end_scope(VkCommandBuffer command_buffer) -> void;
+
+    // The last time and the rolling average of every scope seen so far, in
+    // milliseconds.
+    auto get_results() const -> std::vector<result_t>;
+
+    inline ~gpu_profiler_t() {
+        if (query_pool != VK_NULL_HANDLE) {
+            vkDestroyQueryPool(device.logical, query_pool, nullptr);
+        }
+    }
+};
+
+// Counts how much vertex and fragment work each pass generates, with one
+// pipeline statistics query around each pass. Like the profiler, each frame
+// context has its own queries, which are read back when it comes round again.
+// Only one of these queries can be active at a time, so passes can't nest.
+//
+// Secondary command buffers executed during a pass have to be recorded with
+// get_inherited_flags() in their inheritance info.
+struct pipeline_statistics_t {
+    static constexpr uint32_t MAX_PASSES = 8;
+
+    static constexpr VkQueryPipelineStatisticFlags FLAGS =
+        VK_QUERY_PIPELINE_STATISTIC_INPUT_ASSEMBLY_VERTICES_BIT |
+        VK_QUERY_PIPELINE_STATISTIC_INPUT_ASSEMBLY_PRIMITIVES_BIT |
+        VK_QUERY_PIPELINE_STATISTIC_VERTEX_SHADER_INVOCATIONS_BIT |
+        VK_QUERY_PIPELINE_STATISTIC_CLIPPING_PRIMITIVES_BIT |
+        VK_QUERY_PIPELINE_STATISTIC_FRAGMENT_SHADER_INVOCATIONS_BIT;
+
+    // In the order the query writes them, which is the order of the bits.
+    struct values_t {
+        uint64_t input_vertices;
+        uint64_t input_primitives;
+        uint64_t vertex_invocations;
+        uint64_t clipping_primitives;
+        uint64_t fragment_invocations;
+    };
+
+    struct pass_t {
+        std::string name;
+        values_t values;
+    };
+
+    struct frame_t {
+        std::vector<std::string> passes;
+        bool recorded{false};
+
+        // Whether the last begin_pass() got a query.
+        bool active{false};
+    };
+
+    const vulkan_device_t &device;
+
+    // Null if the statistics weren't asked for or can't be had, in which case
+    // nothing gets recorded.
+    VkQueryPool query_pool;
+
+    std::vector<frame_t> frames;
+    uint32_t current{0};
+
+    // What the last collected frame did.
+    std::vector<pass_t> latest;
+
+    pipeline_statistics_t(
+        const vulkan_device_t &p_device,
+        VkQueryPool p_query_pool,
+        uint32_t p_frame_count
+    )
+        : device(p_device), query_pool(p_query_pool), frames(p_frame_count) {}
+
+    // `secondaries` says whether the passes execute secondary command buffers,
+    // which needs the inheritedQueries feature on top.
+    static auto create(
+        const vulkan_device_t &device,
+        uint32_t frame_count,
+        bool enable,
+        bool secondaries
+    ) -> pipeline_statistics_t;
+
+    NO_COPY(pipeline_statistics_t);
+
+    inline auto is_enabled() const -> bool {
+        return query_pool != VK_NULL_HANDLE;
+    }
+
+    inline auto get_inherited_flags() const -> VkQueryPipelineStatisticFlags {
+        return is_enabled() ? FLAGS : 0;
+    }
+
+    // Same as gpu_profiler_t::collect(), and updates `latest` if there was
+    // anything to read.
+    auto collect(uint32_t frame_index) -> std::vector<pass_t>;
+
+    auto begin_frame(VkCommandBuffer command_buffer, uint32_t frame_index)
+        -> void;
+
+    // Both have to be recorded outside of the render pass.
+    auto begin_pass(VkCommandBuffer command_buffer, std::string_view name)
+        -> void;
+    auto end_pass(VkCommandBuffer command_buffer) -> void;
+
+    inline ~pipeline_statistics_t() {
+        if (query_pool != VK_NULL_HANDLE) {
+            vkDestroyQueryPool(device.logical, query_pool, nullptr);
+        }
+    }
+};
+
+// Ends the scope when it goes out of scope.
+struct gpu_scope_t {
+    gpu_profiler_t &profiler;
+    VkCommandBuffer command_buffer;
+
+    inline gpu_scope_t(
+        gpu_profiler_t &p_profiler,
+        VkCommandBuffer p_command_buffer,
+        std::string_view p_name
+    )
+        : profiler(p_profiler), command_buffer(p_command_buffer) {
+        profiler.begin_scope(command_buffer, p_name);
+    }
+
+    NO_COPY(gpu_scope_t);
+
+    inline ~gpu_scope_t() {
+        profiler.end_scope(command_buffer);
+    }
+};
+
+} // namespace mv
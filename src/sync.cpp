@@ -1,11 +1,14 @@
+#include "profiler.hpp"
+
 #include "sync.hpp"
 
-auto mv::vulkan_fence_t::create(const vulkan_device_t &p_device)
+auto mv::vulkan_fence_t::create(const vulkan_device_t &p_device, bool signaled)
     -> vulkan_fence_t {
     const VkFenceCreateInfo fence_info{
         .sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO,
         .pNext = nullptr,
-        .flags = VK_FENCE_CREATE_SIGNALED_BIT,
+        .flags = signaled ? VkFenceCreateFlags{VK_FENCE_CREATE_SIGNALED_BIT}
+                          : VkFenceCreateFlags{0},
     };
 
     VkFence fence;
@@ -27,3 +30,115 @@ auto mv::vulkan_semaphore_t::create(const vulkan_device_t &p_device)
     ));
     return vulkan_semaphore_t(semaphore, p_device);
 }
+
+auto mv::vulkan_timeline_semaphore_t::create(
+    const vulkan_device_t &p_device, uint64_t p_initial_value
+) -> vulkan_timeline_semaphore_t {
+    const VkSemaphoreTypeCreateInfo type_info{
+        .sType = VK_STRUCTURE_TYPE_SEMAPHORE_TYPE_CREATE_INFO,
+        .pNext = nullptr,
+        .semaphoreType = VK_SEMAPHORE_TYPE_TIMELINE,
+        .initialValue = p_initial_value,
+    };
+
+    const VkSemaphoreCreateInfo semaphore_info{
+        .sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO,
+        .pNext = &type_info,
+        .flags = 0,
+    };
+
+    VkSemaphore semaphore;
+    VK_ERROR(vkCreateSemaphore(
+        p_device.logical, &semaphore_info, nullptr, &semaphore
+    ));
+    return vulkan_timeline_semaphore_t(semaphore, p_device);
+}
+
+auto mv::vulkan_timeline_semaphore_t::get_value() const -> uint64_t {
+    uint64_t value;
+    VK_ERROR(vkGetSemaphoreCounterValue(device.logical, semaphore, &value));
+    return value;
+}
+
+auto mv::vulkan_timeline_semaphore_t::wait(uint64_t value, uint64_t timeout)
+    const -> bool {
+    const VkSemaphoreWaitInfo wait_info{
+        .sType = VK_STRUCTURE_TYPE_SEMAPHORE_WAIT_INFO,
+        .pNext = nullptr,
+        .flags = 0,
+        .semaphoreCount = 1,
+        .pSemaphores = &semaphore,
+        .pValues = &value,
+    };
+
+    const auto result = vkWaitSemaphores(device.logical, &wait_info, timeout);
+    if (result == VK_TIMEOUT) {
+        return false;
+    }
+
+    VK_ERROR(result);
+    return true;
+}
+
+auto mv::vulkan_timeline_semaphore_t::signal(uint64_t value) const -> void {
+    const VkSemaphoreSignalInfo signal_info{
+        .sType = VK_STRUCTURE_TYPE_SEMAPHORE_SIGNAL_INFO,
+        .pNext = nullptr,
+        .semaphore = semaphore,
+        .value = value,
+    };
+
+    VK_ERROR(vkSignalSemaphore(device.logical, &signal_info));
+}
+
+auto mv::submit(
+    VkQueue queue,
+    std::span<const VkCommandBuffer> command_buffers,
+    std::span<const semaphore_wait_t> waits,
+    std::span<const semaphore_signal_t> signals,
+    VkFence fence
+) -> void {
+    PROFILE_ZONE("submit");
+
+    std::vector<VkSemaphore> wait_semaphores;
+    std::vector<uint64_t> wait_values;
+    std::vector<VkPipelineStageFlags> wait_stages;
+
+    for (const auto &wait : waits) {
+        wait_semaphores.push_back(wait.semaphore);
+        wait_values.push_back(wait.value);
+        wait_stages.push_back(wait.stage_mask);
+    }
+
+    std::vector<VkSemaphore> signal_semaphores;
+    std::vector<uint64_t> signal_values;
+
+    for (const auto &signal : signals) {
+        signal_semaphores.push_back(signal.semaphore);
+        signal_values.push_back(signal.value);
+    }
+
+    const VkTimelineSemaphoreSubmitInfo timeline_info{
+        .sType = VK_STRUCTURE_TYPE_TIMELINE_SEMAPHORE_SUBMIT_INFO,
+        .pNext = nullptr,
+        .waitSemaphoreValueCount = static_cast<uint32_t>(wait_values.size()),
+        .pWaitSemaphoreValues = wait_values.data(),
+        .signalSemaphoreValueCount =
+            static_cast<uint32_t>(signal_values.size()),
+        .pSignalSemaphoreValues = signal_values.data(),
+    };
+
+    const VkSubmitInfo submit_info{
+        .sType = VK_STRUCTURE_TYPE_SUBMIT_INFO,
+        .pNext = &timeline_info,
+        .waitSemaphoreCount = static_cast<uint32_t>(wait_semaphores.size()),
+        .pWaitSemaphores = wait_semaphores.data(),
+        .pWaitDstStageMask = wait_stages.data(),
+        .commandBufferCount = static_cast<uint32_t>(command_buffers.size()),
+        .pCommandBuffers = command_buffers.data(),
+        .signalSemaphoreCount = static_cast<uint32_t>(signal_semaphores.size()),
+        .pSignalSemaphores = signal_semaphores.data(),
+    };
+
+    VK_ERROR(vkQueueSubmit(queue, 1, &submit_info, fence));
+}
@@ -19,7 +19,8 @@ struct vulkan_fence_t {
     NO_COPY(vulkan_fence_t);
     YES_MOVE(vulkan_fence_t);
 
-    static auto create(const vulkan_device_t &p_device) -> vulkan_fence_t;
+    static auto create(const vulkan_device_t &p_device, bool signaled = true)
+        -> vulkan_fence_t;
 
     ~vulkan_fence_t() {
         vkDestroyFence(device.logical, fence, nullptr);
@@ -43,4 +44,54 @@ struct vulkan_semaphore_t {
     }
 };
 
+// A semaphore with a 64-bit counter that only goes up. The GPU and the host can
+// both wait for it to reach a value, and both can signal it.
+struct vulkan_timeline_semaphore_t {
+    VkSemaphore semaphore;
+    const vulkan_device_t &device;
+
+    vulkan_timeline_semaphore_t(
+        VkSemaphore p_semaphore, const vulkan_device_t &p_device
+    )
+        : semaphore(p_semaphore), device(p_device) {}
+
+    NO_COPY(vulkan_timeline_semaphore_t);
+
+    static auto
+    create(const vulkan_device_t &p_device, uint64_t p_initial_value = 0)
+        -> vulkan_timeline_semaphore_t;
+
+    auto get_value() const -> uint64_t;
+
+    // Returns false if the timeout ran out first.
+    auto wait(uint64_t value, uint64_t timeout = UINT64_MAX) const -> bool;
+
+    auto signal(uint64_t value) const -> void;
+
+    ~vulkan_timeline_semaphore_t() {
+        vkDestroySemaphore(device.logical, semaphore, nullptr);
+    }
+};
+
+// The value is ignored for binary semaphores.
+struct semaphore_wait_t {
+    VkSemaphore semaphore;
+    uint64_t value;
+    VkPipelineStageFlags stage_mask;
+};
+
+struct semaphore_signal_t {
+    VkSemaphore semaphore;
+    uint64_t value;
+};
+
+// One vkQueueSubmit with any mix of binary and timeline semaphores.
+auto submit(
+    VkQueue queue,
+    std::span<const VkCommandBuffer> command_buffers,
+    std::span<const semaphore_wait_t> waits,
+    std::span<const semaphore_signal_t> signals,
+    VkFence fence = VK_NULL_HANDLE
+) -> void;
+
 } // namespace mv
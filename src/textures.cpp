@@ -0,0 +1,198 @@
+#include <algorithm>
+#include <array>
+
+#include "errors.hpp"
+
+#include "textures.hpp"
+
+namespace mv {
+
+auto texture_registry_t::create(const vulkan_device_t &device)
+    -> texture_registry_t {
+    if (!device.descriptor_indexing) {
+        std::cerr << "[ERROR]: The device doesn't support the descriptor "
+                     "indexing features needed for bindless textures.\n";
+        throw vulkan_exception{VK_ERROR_FEATURE_NOT_PRESENT};
+    }
+
+    VkPhysicalDeviceVulkan12Properties vulkan12_properties{};
+    vulkan12_properties.sType =
+        VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_2_PROPERTIES;
+
+    VkPhysicalDeviceProperties2 properties{
+        .sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PROPERTIES_2,
+        .pNext = &vulkan12_properties,
+        .properties = {},
+    };
+    vkGetPhysicalDeviceProperties2(device.physical, &properties);
+
+    const auto capacity = std::min({
+        MAX_TEXTURES,
+        vulkan12_properties.maxPerStageDescriptorUpdateAfterBindSampledImages,
+        vulkan12_properties.maxDescriptorSetUpdateAfterBindSampledImages,
+    });
+    const auto sampler_capacity = std::min({
+        MAX_SAMPLERS,
+        vulkan12_properties.maxPerStageDescriptorUpdateAfterBindSamplers,
+        vulkan12_properties.maxDescriptorSetUpdateAfterBindSamplers,
+    });
+
+    const std::array bindings{
+        VkDescriptorSetLayoutBinding{
+            .binding = TEXTURES_BINDING,
+            .descriptorType = VK_DESCRIPTOR_TYPE_SAMPLED_IMAGE,
+            .descriptorCount = capacity,
+            .stageFlags = VK_SHADER_STAGE_FRAGMENT_BIT,
+            .pImmutableSamplers = nullptr,
+        },
+        VkDescriptorSetLayoutBinding{
+            .binding = SAMPLERS_BINDING,
+            .descriptorType = VK_DESCRIPTOR_TYPE_SAMPLER,
+            .descriptorCount = sampler_capacity,
+            .stageFlags = VK_SHADER_STAGE_FRAGMENT_BIT,
+            .pImmutableSamplers = nullptr,
+        },
+    };
+
+    const VkDescriptorBindingFlags binding_flags =
+        VK_DESCRIPTOR_BINDING_UPDATE_AFTER_BIND_BIT |
+        VK_DESCRIPTOR_BINDING_UPDATE_UNUSED_WHILE_PENDING_BIT |
+        VK_DESCRIPTOR_BINDING_PARTIALLY_BOUND_BIT;
+    const std::array all_binding_flags{binding_flags, binding_flags};
+
+    auto layout = descriptor_set_layout_t::create(
+        device,
+        bindings,
+        all_binding_flags,
+        VK_DESCRIPTOR_SET_LAYOUT_CREATE_UPDATE_AFTER_BIND_POOL_BIT
+    );
+
+    const std::array pool_sizes{
+        VkDescriptorPoolSize{
+            .type = VK_DESCRIPTOR_TYPE_SAMPLED_IMAGE,
+            .descriptorCount = capacity,
+        },
+        VkDescriptorPoolSize{
+            .type = VK_DESCRIPTOR_TYPE_SAMPLER,
+            .descriptorCount = sampler_capacity,
+        },
+    };
+
+    const VkDescriptorPoolCreateInfo pool_info{
+        .sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO,
+        .pNext = nullptr,
+        .flags = VK_DESCRIPTOR_POOL_CREATE_UPDATE_AFTER_BIND_BIT,
+        .maxSets = 1,
+        .poolSizeCount = static_cast<uint32_t>(pool_sizes.size()),
+        .pPoolSizes = pool_sizes.data(),
+    };
+
+    VkDescriptorPool pool;
+    VK_ERROR(vkCreateDescriptorPool(device.logical, &pool_info, nullptr, &pool)
+    );
+
+    const VkDescriptorSetAllocateInfo allocate_info{
+        .sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO,
+        .pNext = nullptr,
+        .descriptorPool = pool,
+        .descriptorSetCount = 1,
+        .pSetLayouts = &layout.layout,
+    };
+
+    VkDescriptorSet set;
+    VK_ERROR(vkAllocateDescriptorSets(device.logical, &allocate_info, &set));
+
+    std::cout << "[INFO]: The texture registry has room for " << capacity
+              << " textures and " << sampler_capacity << " samplers.\n";
+
+    return texture_registry_t{
+        device, std::move(layout), pool, set, capacity, sampler_capacity
+    };
+}
+
+auto texture_registry_t::add(VkImageView p_view, VkImageLayout p_layout)
+    -> uint32_t {
+    uint32_t index;
+    if (!free_indices.empty()) {
+        index = free_indices.back();
+        free_indices.pop_back();
+        textures[index] = p_view;
+    } else if (textures.size() < capacity) {
+        index = static_cast<uint32_t>(textures.size());
+        textures.push_back(p_view);
+    } else {
+        throw vulkan_exception{VK_ERROR_OUT_OF_POOL_MEMORY};
+    }
+
+    const VkDescriptorImageInfo image_info{
+        .sampler = VK_NULL_HANDLE,
+        .imageView = p_view,
+        .imageLayout = p_layout,
+    };
+
+    const VkWriteDescriptorSet write{
+        .sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET,
+        .pNext = nullptr,
+        .dstSet = set,
+        .dstBinding = TEXTURES_BINDING,
+        .dstArrayElement = index,
+        .descriptorCount = 1,
+        .descriptorType = VK_DESCRIPTOR_TYPE_SAMPLED_IMAGE,
+        .pImageInfo = &image_info,
+        .pBufferInfo = nullptr,
+        .pTexelBufferView = nullptr,
+    };
+
+    vkUpdateDescriptorSets(device.logical, 1, &write, 0, nullptr);
+    return index;
+}
+
+auto texture_registry_t::add_sampler(VkSampler p_sampler) -> uint32_t {
+    if (samplers.size() >= sampler_capacity) {
+        throw vulkan_exception{VK_ERROR_OUT_OF_POOL_MEMORY};
+    }
+
+    const auto index = static_cast<uint32_t>(samplers.size());
+    samplers.push_back(p_sampler);
+
+    const VkDescriptorImageInfo image_info{
+        .sampler = p_sampler,
+        .imageView = VK_NULL_HANDLE,
+        .imageLayout = VK_IMAGE_LAYOUT_UNDEFINED,
+    };
+
+    const VkWriteDescriptorSet write{
+        .sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET,
+        .pNext = nullptr,
+        .dstSet = set,
+        .dstBinding = SAMPLERS_BINDING,
+        .dstArrayElement = index,
+        .descriptorCount = 1,
+        .descriptorType = VK_DESCRIPTOR_TYPE_SAMPLER,
+        .pImageInfo = &image_info,
+        .pBufferInfo = nullptr,
+        .pTexelBufferView = nullptr,
+    };
+
+    vkUpdateDescriptorSets(device.logical, 1, &write, 0, nullptr);
+    return index;
+}
+
+auto texture_registry_t::remove(uint32_t p_index, frame_contexts_t &frames)
+    -> void {
+    // The descriptor itself is left as it is. The binding is partially
+    // bound, so a stale slot is fine as long as nothing reads from it.
+    textures.at(p_index) = VK_NULL_HANDLE;
+
+    // Writing the slot again while a frame that reads it is in flight isn't
+    // allowed, even with update-after-bind.
+    frames.deletion_queue.push(frames.get_signal_value(), [this, p_index]() {
+        free_indices.push_back(p_index);
+    });
+}
+
+texture_registry_t::~texture_registry_t() {
+    vkDestroyDescriptorPool(device.logical, pool, nullptr);
+}
+
+} // namespace mv
@@ -0,0 +1,93 @@
+#pragma once
+
+#include <vector>
+
+#include <vulkan/vulkan.h>
+
+#include "common.hpp"
+#include "device.hpp"
+#include "frames.hpp"
+#include "graphics.hpp"
+
+namespace mv {
+
+// Every texture in one big descriptor array, which shaders index into with
+// the texture's index instead of each texture having a binding of its own.
+// A texture keeps its index for as long as it's registered, so the index can
+// go in per-draw data, and switching textures between draws doesn't mean
+// binding anything.
+//
+// The array is update-after-bind and partially bound. Textures can be added
+// while frames in flight are using the set, as long as those frames don't
+// use the slot being written, and the slots no one has filled don't need to
+// hold anything. Samplers go in a small array of their own, so
+// any texture can be used with any sampler.
+struct texture_registry_t {
+    static constexpr uint32_t MAX_TEXTURES = 4096;
+    static constexpr uint32_t MAX_SAMPLERS = 16;
+
+    static constexpr uint32_t TEXTURES_BINDING = 0;
+    static constexpr uint32_t SAMPLERS_BINDING = 1;
+
+    const vulkan_device_t &device;
+
+    descriptor_set_layout_t layout;
+    VkDescriptorPool pool;
+    VkDescriptorSet set;
+
+    // At most MAX_TEXTURES and MAX_SAMPLERS, and less on devices that can't
+    // have that many.
+    uint32_t capacity;
+    uint32_t sampler_capacity;
+
+    // Indexed by texture index. Slots that were removed are null.
+    std::vector<VkImageView> textures;
+
+    // Only the slots that no frame in flight can still be reading.
+    std::vector<uint32_t> free_indices;
+
+    std::vector<VkSampler> samplers;
+
+    texture_registry_t(
+        const vulkan_device_t &p_device,
+        descriptor_set_layout_t &&p_layout,
+        VkDescriptorPool p_pool,
+        VkDescriptorSet p_set,
+        uint32_t p_capacity,
+        uint32_t p_sampler_capacity
+    )
+        : device(p_device), layout(std::move(p_layout)), pool(p_pool),
+          set(p_set),
+          capacity(p_capacity), sampler_capacity(p_sampler_capacity) {}
+
+    // Throws a vulkan_exception with VK_ERROR_FEATURE_NOT_PRESENT if the
+    // device doesn't have descriptor indexing.
+    static auto create(const vulkan_device_t &device) -> texture_registry_t;
+
+    NO_COPY(texture_registry_t);
+
+    // The view has to stay alive until it's removed again. Throws a
+    // vulkan_exception with VK_ERROR_OUT_OF_POOL_MEMORY when the array is
+    // full.
+    auto add(
+        VkImageView view,
+        VkImageLayout layout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL
+    ) -> uint32_t;
+
+    // Throws like add() when the sampler array is full.
+    auto add_sampler(VkSampler sampler) -> uint32_t;
+
+    // The index only gets handed out again once the frames that might still
+    // be reading it are done, so nothing may use it after the frame being
+    // recorded. The registry has to outlive `frames`.
+    auto remove(uint32_t index, frame_contexts_t &frames) -> void;
+
+    // Counts removed textures until their slots are free again.
+    inline auto size() const -> uint32_t {
+        return static_cast<uint32_t>(textures.size() - free_indices.size());
+    }
+
+    ~texture_registry_t();
+};
+
+} // namespace mv
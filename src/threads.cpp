@@ -0,0 +1,60 @@
+#include <algorithm>
+
+#include "profiler.hpp"
+
+#include "threads.hpp"
+
+namespace mv {
+
+thread_pool_t::thread_pool_t(uint32_t thread_count) {
+    threads.reserve(thread_count);
+    for (uint32_t i = 0; i < thread_count; i++) {
+        threads.emplace_back([this]() { work(); });
+    }
+}
+
+auto thread_pool_t::create(uint32_t thread_count) -> thread_pool_t {
+    if (thread_count == 0) {
+        thread_count = std::max(1u, std::thread::hardware_concurrency());
+    }
+
+    return thread_pool_t{thread_count};
+}
+
+auto thread_pool_t::work() -> void {
+    PROFILE_THREAD("worker");
+
+    while (true) {
+        std::function<void()> job;
+
+        {
+            std::unique_lock lock{mutex};
+            condition.wait(lock, [this]() { return stopping || !jobs.empty(); });
+
+            // Whatever is still queued gets done before the pool goes away.
+            if (jobs.empty()) {
+                return;
+            }
+
+            job = std::move(jobs.front());
+            jobs.pop_front();
+        }
+
+        PROFILE_ZONE("job");
+        job();
+    }
+}
+
+thread_pool_t::~thread_pool_t() {
+    {
+        std::lock_guard lock{mutex};
+        stopping = true;
+    }
+
+    condition.notify_all();
+    for (auto &thread : threads) {
+        thread.join();
+    }
+}
+
+} // namespace mv
@@ -0,0 +1,60 @@
+#pragma once
+
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <type_traits>
+
+#include "common.hpp"
+
+namespace mv {
+
+// A fixed number of worker threads pulling jobs off a shared queue.
+struct thread_pool_t {
+    std::vector<std::thread> threads;
+
+    std::deque<std::function<void()>> jobs;
+    std::mutex mutex;
+    std::condition_variable condition;
+    bool stopping{false};
+
+    explicit thread_pool_t(uint32_t thread_count);
+
+    // Zero threads means one per core.
+    static auto create(uint32_t thread_count = 0) -> thread_pool_t;
+
+    NO_COPY(thread_pool_t);
+
+    inline auto size() const -> uint32_t {
+        return static_cast<uint32_t>(threads.size());
+    }
+
+    template <typename F>
+    auto submit(F &&job) -> std::future<std::invoke_result_t<F>> {
+        // std::function has to be copyable, and packaged_task isn't.
+        auto task =
+            std::make_shared<std::packaged_task<std::invoke_result_t<F>()>>(
+                std::forward<F>(job)
+            );
+        auto future = task->get_future();
+
+        {
+            std::lock_guard lock{mutex};
+            jobs.emplace_back([task]() { (*task)(); });
+        }
+
+        condition.notify_one();
+        return future;
+    }
+
+    ~thread_pool_t();
+
+  private:
+    auto work() -> void;
+};
+
+} // namespace mv
@@ -0,0 +1,503 @@
+#include "errors.hpp"
+#include "profiler.hpp"
+
+#include "upload.hpp"
+
+namespace mv {
+
+auto upload_service_t::create(
+    const vulkan_device_t &p_device,
+    memory_allocator_t &p_allocator,
+    VkDeviceSize p_ring_size
+) -> upload_service_t {
+    const VkCommandPoolCreateInfo pool_info{
+        .sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO,
+        .pNext = nullptr,
+        .flags = VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT,
+        .queueFamilyIndex = p_device.transfer_family,
+    };
+
+    VkCommandPool command_pool;
+    VK_ERROR(
+        vkCreateCommandPool(p_device.logical, &pool_info, nullptr, &command_pool)
+    );
+
+    VkCommandPool acquire_command_pool = VK_NULL_HANDLE;
+    if (p_device.transfer_family != p_device.graphics_family) {
+        const VkCommandPoolCreateInfo acquire_pool_info{
+            .sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO,
+            .pNext = nullptr,
+            .flags = VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT,
+            .queueFamilyIndex = p_device.graphics_family,
+        };
+
+        VK_ERROR(vkCreateCommandPool(
+            p_device.logical, &acquire_pool_info, nullptr, &acquire_command_pool
+        ));
+    }
+
+    // Image copies need the buffer offset to be a multiple of the texel size,
+    // so never go below 16.
+    const auto alignment = std::max<VkDeviceSize>(
+        16, p_device.properties.limits.optimalBufferCopyOffsetAlignment
+    );
+
+    return upload_service_t{
+        p_device,
+        p_allocator,
+        staging_buffer_t::create(p_device, p_allocator, p_ring_size),
+        alignment,
+        command_pool,
+        acquire_command_pool,
+    };
+}
+
+auto upload_service_t::upload_buffer(
+    const buffer_t &p_destination,
+    const void *p_data,
+    VkDeviceSize p_size,
+    VkDeviceSize p_offset
+) -> void {
+    PROFILE_ZONE("upload_service_t::upload_buffer");
+
+    const auto ring_offset = allocate(p_size);
+    auto &batch = begin_batch();
+
+    if (ring_offset.has_value()) {
+        memcpy(
+            static_cast<std::byte *>(ring.map_memory()) + ring_offset.value(),
+            p_data,
+            p_size
+        );
+        p_destination.record_copy_from(
+            batch.command_buffer,
+            ring.buffer.buffer,
+            ring_offset.value(),
+            p_size,
+            p_offset
+        );
+    } else {
+        auto staging = staging_buffer_t::create(device, allocator, p_size);
+        memcpy(staging.map_memory(), p_data, p_size);
+        p_destination.record_copy_from(
+            batch.command_buffer, staging.buffer.buffer, 0, p_size, p_offset
+        );
+        batch.overflow.push_back(std::move(staging));
+    }
+
+    if (transfers_ownership()) {
+        batch.buffer_releases.push_back({
+            .sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER,
+            .pNext = nullptr,
+            .srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT,
+            .dstAccessMask = 0,
+            .srcQueueFamilyIndex = device.transfer_family,
+            .dstQueueFamilyIndex = device.graphics_family,
+            .buffer = p_destination.buffer,
+            .offset = p_offset,
+            .size = p_size,
+        });
+    }
+}
+
+auto upload_service_t::upload_image(
+    vulkan_image_t &p_destination, const image_t &p_image
+) -> void {
+    PROFILE_ZONE("upload_service_t::upload_image");
+
+    const VkDeviceSize size =
+        p_destination.width * p_destination.height * 4 * sizeof(uint8_t);
+
+    const auto ring_offset = allocate(size);
+    auto &batch = begin_batch();
+
+    p_destination.record_transition_layout(
+        batch.command_buffer, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL
+    );
+
+    if (ring_offset.has_value()) {
+        memcpy(
+            static_cast<std::byte *>(ring.map_memory()) + ring_offset.value(),
+            p_image.data,
+            size
+        );
+        p_destination.record_copy_from_buffer(
+            batch.command_buffer, ring.buffer.buffer, ring_offset.value()
+        );
+    } else {
+        auto staging = staging_buffer_t::create(device, allocator, size);
+        memcpy(staging.map_memory(), p_image.data, size);
+        p_destination.record_copy_from_buffer(
+            batch.command_buffer, staging.buffer.buffer, 0
+        );
+        batch.overflow.push_back(std::move(staging));
+    }
+
+    if (!transfers_ownership()) {
+        p_destination.record_transition_layout(
+            batch.command_buffer, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL
+        );
+        return;
+    }
+
+    // The layout transition happens as part of the ownership transfer, so the
+    // release and the acquire both have to ask for it.
+    batch.image_releases.push_back({
+        .sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER,
+        .pNext = nullptr,
+        .srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT,
+        .dstAccessMask = 0,
+        .oldLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+        .newLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL,
+        .srcQueueFamilyIndex = device.transfer_family,
+        .dstQueueFamilyIndex = device.graphics_family,
+        .image = p_destination.image,
+        .subresourceRange =
+            {
+                .aspectMask = VK_IMAGE_ASPECT_COLOR_BIT,
+                .baseMipLevel = 0,
+                .levelCount = 1,
+                .baseArrayLayer = 0,
+                .layerCount = 1,
+            },
+    });
+
+    p_destination.set_layout(
+        p_destination.get_subresource_range(),
+        VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL
+    );
+}
+
+auto upload_service_t::submit() -> uint64_t {
+    PROFILE_ZONE("upload_service_t::submit");
+
+    if (!recording.has_value()) {
+        return next_batch_id - 1;
+    }
+
+    auto batch = std::move(recording.value());
+    recording.reset();
+
+    if (transfers_ownership()) {
+        submit_with_ownership_transfer(batch);
+
+        batch.ring_end = head;
+        const auto id = batch.id;
+        in_flight.push_back(std::move(batch));
+
+        return id;
+    }
+
+    // Make the buffer copies visible to whatever reads them next. The images
+    // already took care of this with their layout transitions.
+    const VkMemoryBarrier barrier{
+        .sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER,
+        .pNext = nullptr,
+        .srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT,
+        .dstAccessMask = VK_ACCESS_VERTEX_ATTRIBUTE_READ_BIT |
+                         VK_ACCESS_INDEX_READ_BIT | VK_ACCESS_UNIFORM_READ_BIT |
+                         VK_ACCESS_SHADER_READ_BIT,
+    };
+
+    vkCmdPipelineBarrier(
+        batch.command_buffer,
+        VK_PIPELINE_STAGE_TRANSFER_BIT,
+        VK_PIPELINE_STAGE_VERTEX_INPUT_BIT |
+            VK_PIPELINE_STAGE_VERTEX_SHADER_BIT |
+            VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT,
+        0,
+        1,
+        &barrier,
+        0,
+        nullptr,
+        0,
+        nullptr
+    );
+
+    VK_ERROR(vkEndCommandBuffer(batch.command_buffer));
+
+    mv::submit(
+        device.transfer_queue,
+        std::array{batch.command_buffer},
+        {},
+        std::array{semaphore_signal_t{timeline.semaphore, batch.id}}
+    );
+
+    batch.ring_end = head;
+    const auto id = batch.id;
+    in_flight.push_back(std::move(batch));
+
+    return id;
+}
+
+auto upload_service_t::submit_with_ownership_transfer(batch_t &batch) -> void {
+    // Release everything on the transfer queue...
+    vkCmdPipelineBarrier(
+        batch.command_buffer,
+        VK_PIPELINE_STAGE_TRANSFER_BIT,
+        VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT,
+        0,
+        0,
+        nullptr,
+        static_cast<uint32_t>(batch.buffer_releases.size()),
+        batch.buffer_releases.data(),
+        static_cast<uint32_t>(batch.image_releases.size()),
+        batch.image_releases.data()
+    );
+
+    VK_ERROR(vkEndCommandBuffer(batch.command_buffer));
+
+    const VkSubmitInfo transfer_submit_info{
+        .sType = VK_STRUCTURE_TYPE_SUBMIT_INFO,
+        .pNext = nullptr,
+        .waitSemaphoreCount = 0,
+        .pWaitSemaphores = nullptr,
+        .pWaitDstStageMask = nullptr,
+        .commandBufferCount = 1,
+        .pCommandBuffers = &batch.command_buffer,
+        .signalSemaphoreCount = 1,
+        .pSignalSemaphores = &batch.semaphore,
+    };
+
+    VK_ERROR(vkQueueSubmit(
+        device.transfer_queue, 1, &transfer_submit_info, VK_NULL_HANDLE
+    ));
+
+    // ...and acquire it on the graphics queue. The acquire barriers are the
+    // release ones with the access masks moved over to the other side.
+    for (auto &barrier : batch.buffer_releases) {
+        barrier.srcAccessMask = 0;
+        barrier.dstAccessMask = VK_ACCESS_VERTEX_ATTRIBUTE_READ_BIT |
+                                VK_ACCESS_INDEX_READ_BIT |
+                                VK_ACCESS_UNIFORM_READ_BIT |
+                                VK_ACCESS_SHADER_READ_BIT;
+    }
+
+    for (auto &barrier : batch.image_releases) {
+        barrier.srcAccessMask = 0;
+        barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+    }
+
+    const VkCommandBufferBeginInfo begin_info{
+        .sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO,
+        .pNext = nullptr,
+        .flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT,
+        .pInheritanceInfo = nullptr,
+    };
+
+    VK_ERROR(vkBeginCommandBuffer(batch.acquire_command_buffer, &begin_info));
+
+    vkCmdPipelineBarrier(
+        batch.acquire_command_buffer,
+        VK_PIPELINE_STAGE_ALL_COMMANDS_BIT,
+        VK_PIPELINE_STAGE_VERTEX_INPUT_BIT |
+            VK_PIPELINE_STAGE_VERTEX_SHADER_BIT |
+            VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT,
+        0,
+        0,
+        nullptr,
+        static_cast<uint32_t>(batch.buffer_releases.size()),
+        batch.buffer_releases.data(),
+        static_cast<uint32_t>(batch.image_releases.size()),
+        batch.image_releases.data()
+    );
+
+    VK_ERROR(vkEndCommandBuffer(batch.acquire_command_buffer));
+
+    // Has to match the acquire barriers' source stage for the semaphore wait to
+    // chain into them.
+    const VkPipelineStageFlags wait_stage = VK_PIPELINE_STAGE_ALL_COMMANDS_BIT;
+
+    mv::submit(
+        device.graphics_queue,
+        std::array{batch.acquire_command_buffer},
+        std::array{semaphore_wait_t{batch.semaphore, 0, wait_stage}},
+        std::array{semaphore_signal_t{timeline.semaphore, batch.id}}
+    );
+
+    batch.buffer_releases.clear();
+    batch.image_releases.clear();
+}
+
+auto upload_service_t::wait(uint64_t p_batch_id) -> void {
+    PROFILE_ZONE("upload_service_t::wait");
+
+    if (recording.has_value() && recording->id <= p_batch_id) {
+        submit();
+    }
+
+    while (completed_batch_id < p_batch_id && !in_flight.empty()) {
+        retire_oldest(true);
+    }
+}
+
+auto upload_service_t::reclaim() -> void {
+    while (!in_flight.empty() && retire_oldest(false)) {
+    }
+}
+
+auto upload_service_t::begin_batch() -> batch_t & {
+    if (recording.has_value()) {
+        return recording.value();
+    }
+
+    if (free_batches.empty()) {
+        const VkCommandBufferAllocateInfo allocate_info{
+            .sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO,
+            .pNext = nullptr,
+            .commandPool = command_pool,
+            .level = VK_COMMAND_BUFFER_LEVEL_PRIMARY,
+            .commandBufferCount = 1,
+        };
+
+        VkCommandBuffer command_buffer;
+        VK_ERROR(vkAllocateCommandBuffers(
+            device.logical, &allocate_info, &command_buffer
+        ));
+
+        VkCommandBuffer acquire_command_buffer = VK_NULL_HANDLE;
+        VkSemaphore semaphore = VK_NULL_HANDLE;
+
+        if (transfers_ownership()) {
+            const VkCommandBufferAllocateInfo acquire_allocate_info{
+                .sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO,
+                .pNext = nullptr,
+                .commandPool = acquire_command_pool,
+                .level = VK_COMMAND_BUFFER_LEVEL_PRIMARY,
+                .commandBufferCount = 1,
+            };
+
+            VK_ERROR(vkAllocateCommandBuffers(
+                device.logical, &acquire_allocate_info, &acquire_command_buffer
+            ));
+
+            const VkSemaphoreCreateInfo semaphore_info{
+                .sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO,
+                .pNext = nullptr,
+                .flags = 0,
+            };
+
+            VK_ERROR(vkCreateSemaphore(
+                device.logical, &semaphore_info, nullptr, &semaphore
+            ));
+        }
+
+        free_batches.push_back({
+            .command_buffer = command_buffer,
+            .acquire_command_buffer = acquire_command_buffer,
+            .semaphore = semaphore,
+            .buffer_releases = {},
+            .image_releases = {},
+            .ring_end = 0,
+            .id = 0,
+            .overflow = {},
+        });
+    }
+
+    recording = std::move(free_batches.back());
+    free_batches.pop_back();
+    recording->id = next_batch_id++;
+
+    const VkCommandBufferBeginInfo begin_info{
+        .sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO,
+        .pNext = nullptr,
+        .flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT,
+        .pInheritanceInfo = nullptr,
+    };
+
+    VK_ERROR(vkBeginCommandBuffer(recording->command_buffer, &begin_info));
+
+    return recording.value();
+}
+
+auto upload_service_t::allocate(VkDeviceSize p_size)
+    -> std::optional<VkDeviceSize> {
+    const auto capacity = ring.buffer.size;
+    if (p_size > capacity) {
+        return std::nullopt;
+    }
+
+    while (true) {
+        if (in_flight.empty() && !recording.has_value()) {
+            // Nothing is using the ring, so start again from the beginning of
+            // it.
+            head = tail = (head + capacity - 1) / capacity * capacity;
+        }
+
+        auto start = (head + alignment - 1) / alignment * alignment;
+
+        // Allocations never wrap around the end, the rest of the ring just gets
+        // skipped instead.
+        const auto offset = start % capacity;
+        if (offset + p_size > capacity) {
+            start += capacity - offset;
+        }
+
+        if (start + p_size - tail <= capacity) {
+            head = start + p_size;
+            return start % capacity;
+        }
+
+        // Out of space. Wait for the oldest batch to give some back, or submit
+        // the one being recorded if that's the only thing holding on to it.
+        if (!in_flight.empty()) {
+            retire_oldest(true);
+        } else {
+            submit();
+        }
+    }
+}
+
+auto upload_service_t::retire_oldest(bool p_block) -> bool {
+    auto &batch = in_flight.front();
+
+    if (p_block) {
+        timeline.wait(batch.id);
+    } else if (timeline.get_value() < batch.id) {
+        return false;
+    }
+
+    tail = batch.ring_end;
+    completed_batch_id = batch.id;
+
+    VK_ERROR(vkResetCommandBuffer(batch.command_buffer, 0));
+    if (batch.acquire_command_buffer != VK_NULL_HANDLE) {
+        VK_ERROR(vkResetCommandBuffer(batch.acquire_command_buffer, 0));
+    }
+    batch.overflow.clear();
+
+    free_batches.push_back(std::move(batch));
+    in_flight.pop_front();
+
+    return true;
+}
+
+upload_service_t::~upload_service_t() {
+    const auto destroy_batch = [&](const batch_t &batch) {
+        vkDestroySemaphore(device.logical, batch.semaphore, nullptr);
+    };
+
+    if (!in_flight.empty()) {
+        timeline.wait(in_flight.back().id);
+    }
+
+    for (const auto &batch : in_flight) {
+        destroy_batch(batch);
+    }
+
+    for (const auto &batch : free_batches) {
+        destroy_batch(batch);
+    }
+
+    if (recording.has_value()) {
+        destroy_batch(recording.value());
+    }
+
+    // Takes the command buffers with them.
+    vkDestroyCommandPool(device.logical, command_pool, nullptr);
+    if (acquire_command_pool != VK_NULL_HANDLE) {
+        vkDestroyCommandPool(device.logical, acquire_command_pool, nullptr);
+    }
+}
+
+} // namespace mv
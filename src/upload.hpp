@@ -0,0 +1,142 @@
+#pragma once
+
+#include <deque>
+
+#include <vulkan/vulkan.h>
+
+#include "buffers.hpp"
+#include "common.hpp"
+#include "device.hpp"
+#include "images.hpp"
+#include "memory.hpp"
+#include "sync.hpp"
+
+namespace mv {
+
+// Batches buffer and image uploads through one persistently mapped staging
+// ring. Everything queued between two submit() calls is recorded into a single
+// command buffer and goes out in a single vkQueueSubmit. Batch ids double as
+// values on the service's timeline semaphore, which each batch signals when it
+// is done. Ring space is handed back once that has happened, so nothing ever
+// has to idle the queue, and other submits can wait on the timeline for the
+// uploads they need instead of the host doing it.
+//
+// The copies run on the device's transfer queue. If that is a different family
+// from the graphics one, the batch releases ownership of everything it wrote,
+// and a tiny command buffer on the graphics queue waits on the batch's
+// semaphore and acquires it, so the graphics queue never runs the copies
+// itself.
+struct upload_service_t {
+    static constexpr VkDeviceSize DEFAULT_RING_SIZE = 32 * 1024 * 1024;
+
+    struct batch_t {
+        VkCommandBuffer command_buffer;
+
+        // Only used when ownership has to be handed over to the graphics
+        // family. The timeline is then signalled by the acquire submit.
+        VkCommandBuffer acquire_command_buffer;
+        VkSemaphore semaphore;
+
+        std::vector<VkBufferMemoryBarrier> buffer_releases;
+        std::vector<VkImageMemoryBarrier> image_releases;
+
+        // Where the ring's head was when the batch was submitted. Everything
+        // before this is free once the batch is done.
+        VkDeviceSize ring_end;
+
+        uint64_t id;
+
+        // Staging buffers for uploads that did not fit in the ring at all.
+        std::vector<staging_buffer_t> overflow;
+    };
+
+    const vulkan_device_t &device;
+    memory_allocator_t &allocator;
+
+    staging_buffer_t ring;
+    VkDeviceSize alignment;
+
+    // Both of these only ever go up, and are wrapped around the ring's size
+    // when turned into an offset.
+    VkDeviceSize head{0};
+    VkDeviceSize tail{0};
+
+    // On the transfer family and the graphics family respectively. The second
+    // is null if they are the same family.
+    VkCommandPool command_pool;
+    VkCommandPool acquire_command_pool;
+
+    vulkan_timeline_semaphore_t timeline;
+
+    std::optional<batch_t> recording;
+    std::deque<batch_t> in_flight;
+    std::vector<batch_t> free_batches;
+
+    uint64_t next_batch_id{1};
+    uint64_t completed_batch_id{0};
+
+    upload_service_t(
+        const vulkan_device_t &p_device,
+        memory_allocator_t &p_allocator,
+        staging_buffer_t &&p_ring,
+        VkDeviceSize p_alignment,
+        VkCommandPool p_command_pool,
+        VkCommandPool p_acquire_command_pool
+    )
+        : device(p_device), allocator(p_allocator), ring(std::move(p_ring)),
+          alignment(p_alignment), command_pool(p_command_pool),
+          acquire_command_pool(p_acquire_command_pool),
+          timeline(vulkan_timeline_semaphore_t::create(p_device)) {}
+
+    static auto create(
+        const vulkan_device_t &device,
+        memory_allocator_t &allocator,
+        VkDeviceSize ring_size = DEFAULT_RING_SIZE
+    ) -> upload_service_t;
+
+    NO_COPY(upload_service_t);
+
+    // Queues a copy of `size` bytes of `data` into `destination`. The data is
+    // copied into the ring right away, so it doesn't need to outlive the call.
+    auto upload_buffer(
+        const buffer_t &destination,
+        const void *data,
+        VkDeviceSize size,
+        VkDeviceSize offset = 0
+    ) -> void;
+
+    // Queues a copy of an RGBA8 image, leaving the destination in the
+    // SHADER_READ_ONLY_OPTIMAL layout.
+    auto upload_image(vulkan_image_t &destination, const image_t &image)
+        -> void;
+
+    // Submits everything queued so far and returns the id of the batch, which
+    // can be handed to wait(). Returns the id of the last batch if there was
+    // nothing to submit.
+    auto submit() -> uint64_t;
+
+    // Blocks until the given batch is done.
+    auto wait(uint64_t batch_id) -> void;
+
+    // Submits whatever is queued and waits for all of it.
+    inline auto flush() -> void {
+        wait(submit());
+    }
+
+    // Recycles the batches that the GPU is done with, without blocking.
+    auto reclaim() -> void;
+
+    inline auto transfers_ownership() const -> bool {
+        return acquire_command_pool != VK_NULL_HANDLE;
+    }
+
+    ~upload_service_t();
+
+  private:
+    auto begin_batch() -> batch_t &;
+    auto submit_with_ownership_transfer(batch_t &batch) -> void;
+    auto allocate(VkDeviceSize size) -> std::optional<VkDeviceSize>;
+    auto retire_oldest(bool block) -> bool;
+};
+
+} // namespace mv